@@ -5,8 +5,9 @@
 // 2011-07-12 Zou Xu <zouivex@gmail.com>
 // 2012-02-11 GONG Chen <chen.sst@gmail.com>
 //
+#include <algorithm>
+#include <numeric>
 #include <queue>
-#include <boost/range/adaptor/reversed.hpp>
 #include <rime/algo/syllabifier.h>
 #include <rime/dict/corrector.h>
 #include <rime/dict/prism.h>
@@ -22,12 +23,182 @@ using VertexQueue =
 const double kCompletionPenalty = -0.6931471805599453;     // log(0.5)
 const double kCorrectionCredibility = -4.605170185988091;  // log(0.01)
 
+static bool edge_less(const SpellingEdge& a, const SpellingEdge& b) {
+  if (a.properties.end_pos != b.properties.end_pos)
+    return a.properties.end_pos < b.properties.end_pos;
+  return a.syllable_id < b.syllable_id;
+}
+
+// sorts edges by end position and syllable id, and merges edges of the same
+// syllable into the first found, with the best type of spelling
+static void merge_edges(vector<SpellingEdge>* edges) {
+  if (edges->empty())
+    return;
+  std::stable_sort(edges->begin(), edges->end(), edge_less);
+  auto last = edges->begin();
+  for (auto it = last + 1; it != edges->end(); ++it) {
+    if (it->syllable_id == last->syllable_id &&
+        it->properties.end_pos == last->properties.end_pos) {
+      last->properties.type = (std::min)(last->properties.type,
+                                         it->properties.type);
+    } else if (++last != it) {
+      *last = std::move(*it);
+    }
+  }
+  edges->erase(last + 1, edges->end());
+}
+
+// lists the edges from each position by syllable id, longer spellings first
+static void index_edges(CompactSyllableGraph* graph) {
+  const auto& edges(graph->edges);
+  auto& index(graph->index);
+  index.resize(edges.size());
+  std::iota(index.begin(), index.end(), 0);
+  for (size_t pos = 0; pos + 1 < graph->edge_offsets.size(); ++pos) {
+    std::sort(index.begin() + graph->begin_of(pos),
+              index.begin() + graph->end_of(pos),
+              [&edges](uint32_t a, uint32_t b) {
+                if (edges[a].syllable_id != edges[b].syllable_id)
+                  return edges[a].syllable_id < edges[b].syllable_id;
+                return edges[a].properties.end_pos >
+                       edges[b].properties.end_pos;
+              });
+  }
+}
+
+// CompactSyllableGraph members
+
+CompactSyllableGraph::CompactSyllableGraph(const SyllableGraph& graph)
+    : input_length(graph.input_length),
+      interpreted_length(graph.interpreted_length),
+      vertices(graph.vertices.begin(), graph.vertices.end()) {
+  size_t max_pos = input_length;
+  if (!graph.edges.empty())
+    max_pos = (std::max)(max_pos, graph.edges.rbegin()->first);
+  edge_offsets.resize(max_pos + 2);
+  size_t pos = 0;
+  for (const auto& start : graph.edges) {
+    while (pos <= start.first)
+      edge_offsets[pos++] = edges.size();
+    for (const auto& end : start.second) {
+      for (const auto& spelling : end.second) {
+        edges.push_back({spelling.first, spelling.second});
+      }
+    }
+  }
+  while (pos < edge_offsets.size())
+    edge_offsets[pos++] = edges.size();
+  index_edges(this);
+}
+
+pair<size_t, size_t> CompactSyllableGraph::FindSyllable(
+    size_t pos,
+    SyllableId syllable_id) const {
+  auto first = index.begin() + begin_of(pos);
+  auto last = index.begin() + end_of(pos);
+  auto lower = std::lower_bound(first, last, syllable_id,
+                                [this](uint32_t i, SyllableId id) {
+                                  return edges[i].syllable_id < id;
+                                });
+  auto upper = lower;
+  while (upper != last && edges[*upper].syllable_id == syllable_id)
+    ++upper;
+  return {lower - index.begin(), upper - index.begin()};
+}
+
+const SpellingEdge* CompactSyllableGraph::FindEdge(
+    size_t start,
+    size_t end,
+    SyllableId syllable_id) const {
+  SpellingEdge key;
+  key.syllable_id = syllable_id;
+  key.properties.end_pos = end;
+  auto first = edges.begin() + begin_of(start);
+  auto last = edges.begin() + end_of(start);
+  auto found = std::lower_bound(first, last, key, edge_less);
+  if (found == last || found->syllable_id != syllable_id ||
+      found->properties.end_pos != end)
+    return nullptr;
+  return &*found;
+}
+
+void CompactSyllableGraph::Clear() {
+  input_length = 0;
+  interpreted_length = 0;
+  vertices.clear();
+  edges.clear();
+  edge_offsets.clear();
+  index.clear();
+}
+
+void CompactSyllableGraph::Export(SyllableGraph* graph) const {
+  graph->input_length = input_length;
+  graph->interpreted_length = interpreted_length;
+  graph->vertices = VertexMap(vertices.begin(), vertices.end());
+  graph->edges.clear();
+  graph->indices.clear();
+  for (size_t pos = 0; pos + 1 < edge_offsets.size(); ++pos) {
+    if (!has_edges(pos))
+      continue;
+    auto& end_vertices(graph->edges[pos]);
+    for (size_t k = begin_of(pos); k < end_of(pos); ++k) {
+      const auto& edge = edges[k];
+      end_vertices[edge.properties.end_pos][edge.syllable_id] =
+          edge.properties;
+    }
+    auto& spelling_index(graph->indices[pos]);
+    for (size_t k = begin_of(pos); k < end_of(pos); ++k) {
+      const auto& edge = edges[index[k]];
+      spelling_index[edge.syllable_id].push_back(
+          &end_vertices[edge.properties.end_pos][edge.syllable_id]);
+    }
+  }
+}
+
+// Syllabifier members
+
 int Syllabifier::BuildSyllableGraph(const string& input,
                                     Prism& prism,
                                     SyllableGraph* graph) {
+  int farthest = BuildSyllableGraph(input, prism);
+  graph_.Export(graph);
+  return farthest;
+}
+
+int Syllabifier::BuildSyllableGraph(const string& input, Prism& prism) {
+  graph_.Clear();
   if (input.empty())
     return 0;
 
+  SyllableGraphCache* cache = corrector_ ? nullptr : cache_;
+  size_t unchanged = 0;
+  if (cache) {
+    if (cache->prism != &prism) {
+      cache->prism = &prism;
+      cache->edges.clear();
+    }
+    while (unchanged < input.length() && unchanged < cache->input.length() &&
+           input[unchanged] == cache->input[unchanged])
+      ++unchanged;
+    // drop edges that depend on the changed part of the input
+    for (auto it = cache->edges.begin(); it != cache->edges.end();) {
+      if (it->second.horizon > unchanged)
+        cache->edges.erase(it++);
+      else
+        ++it;
+    }
+    cache->input = input;
+  }
+
+  size_t length = input.length();
+  if (edges_.size() < length + 1)
+    edges_.resize(length + 1);
+  for (size_t i = 0; i <= length; ++i) {
+    edges_[i].clear();
+  }
+  vertex_types_.assign(length + 1, kInvalidSpelling);
+  visited_.assign(length + 1, false);
+
   size_t farthest = 0;
   VertexQueue queue;
   queue.push(Vertex{0, kNormalSpelling});  // start
@@ -38,166 +209,96 @@ int Syllabifier::BuildSyllableGraph(const string& input,
     size_t current_pos = vertex.first;
 
     // record a visit to the vertex
-    if (graph->vertices.find(current_pos) == graph->vertices.end()) {
-      graph->vertices.insert(vertex);  // preferred spelling type comes first
-    } else {
-      //      graph->vertices[current_pos] =
-      //          std::min(vertex.second, graph->vertices[current_pos]);
+    if (visited_[current_pos])
       continue;  // discard worse spelling types
-    }
+    // preferred spelling type comes first
+    visited_[current_pos] = true;
+    vertex_types_[current_pos] = vertex.second;
 
     if (current_pos > farthest)
       farthest = current_pos;
     DLOG(INFO) << "current_pos: " << current_pos;
 
     // see where we can go by advancing a syllable
-    vector<Prism::Match> matches;
-    set<SyllableId> exact_match_syllables;
-    auto current_input = input.substr(current_pos);
-    prism.CommonPrefixSearch(current_input, &matches);
-    if (corrector_) {
-      for (auto& m : matches) {
-        exact_match_syllables.insert(m.value);
-      }
-      Corrections corrections;
-      corrector_->ToleranceSearch(prism, current_input, &corrections, 5);
-      for (const auto& m : corrections) {
-        for (auto accessor = prism.QuerySpelling(m.first);
-             !accessor.exhausted(); accessor.Next()) {
-          if (accessor.properties().type == kNormalSpelling) {
-            matches.push_back({m.first, m.second.length});
-            break;
-          }
-        }
+    auto& edges(edges_[current_pos]);
+    if (cache && cache->edges.find(current_pos) != cache->edges.end()) {
+      edges = cache->edges[current_pos].edges;
+    } else {
+      size_t horizon = FindEdges(input, current_pos, prism, &edges);
+      if (cache && horizon != string::npos) {
+        cache->edges[current_pos] = {horizon, edges};
       }
     }
-
-    if (!matches.empty()) {
-      auto& end_vertices(graph->edges[current_pos]);
-      for (const auto& m : matches) {
-        if (m.length == 0)
-          continue;
-        size_t end_pos = current_pos + m.length;
-        // consume trailing delimiters
-        while (end_pos < input.length() &&
-               delimiters_.find(input[end_pos]) != string::npos)
-          ++end_pos;
-        DLOG(INFO) << "end_pos: " << end_pos;
-        bool matches_input = (current_pos == 0 && end_pos == input.length());
-        SpellingMap& spellings(end_vertices[end_pos]);
-        SpellingType end_vertex_type = kInvalidSpelling;
-        // when spelling algebra is enabled,
-        // a spelling evaluates to a set of syllables;
-        // otherwise, it resembles exactly the syllable itself.
-        SpellingAccessor accessor(prism.QuerySpelling(m.value));
-        while (!accessor.exhausted()) {
-          SyllableId syllable_id = accessor.syllable_id();
-          EdgeProperties props(accessor.properties());
-          if (strict_spelling_ && matches_input &&
-              props.type != kNormalSpelling) {
-            // disqualify fuzzy spelling or abbreviation as single word
-          } else {
-            props.end_pos = end_pos;
-            // add a syllable with properties to the edge's
-            // spelling-to-syllable map
-            if (corrector_ && exact_match_syllables.find(m.value) ==
-                                  exact_match_syllables.end()) {
-              props.is_correction = true;
-              props.credibility = kCorrectionCredibility;
-            }
-            auto it = spellings.find(syllable_id);
-            if (it == spellings.end()) {
-              spellings.insert({syllable_id, props});
-            } else {
-              it->second.type = (std::min)(it->second.type, props.type);
-            }
-            // let end_vertex_type be the best (smaller) type of spelling
-            // that ends at the vertex
-            if (end_vertex_type > props.type && !props.is_correction) {
-              end_vertex_type = props.type;
-            }
-          }
-          accessor.Next();
+    for (auto it = edges.begin(); it != edges.end();) {
+      size_t end_pos = it->properties.end_pos;
+      // let end_vertex_type be the best (smaller) type of spelling
+      // that ends at the vertex
+      SpellingType end_vertex_type = kInvalidSpelling;
+      for (; it != edges.end() && it->properties.end_pos == end_pos; ++it) {
+        if (end_vertex_type > it->properties.type &&
+            !it->properties.is_correction) {
+          end_vertex_type = it->properties.type;
         }
-        if (spellings.empty()) {
-          DLOG(INFO) << "not spelled.";
-          end_vertices.erase(end_pos);
-          continue;
-        }
-        // find the best common type in a path up to the end vertex
-        // eg. pinyin "shurfa" has vertex type kNormalSpelling at position 3,
-        // kAbbreviation at position 4 and kAbbreviation at position 6
-        if (end_vertex_type < vertex.second) {
-          end_vertex_type = vertex.second;
-        }
-        queue.push(Vertex{end_pos, end_vertex_type});
-        DLOG(INFO) << "added to syllable graph, edge: [" << current_pos << ", "
-                   << end_pos << ")";
       }
+      // find the best common type in a path up to the end vertex
+      // eg. pinyin "shurfa" has vertex type kNormalSpelling at position 3,
+      // kAbbreviation at position 4 and kAbbreviation at position 6
+      if (end_vertex_type < vertex.second) {
+        end_vertex_type = vertex.second;
+      }
+      queue.push(Vertex{end_pos, end_vertex_type});
+      DLOG(INFO) << "added to syllable graph, edge: [" << current_pos << ", "
+                 << end_pos << ")";
     }
   }
 
   DLOG(INFO) << "remove stale vertices and edges";
-  set<int> good;
-  good.insert(farthest);
+  // from here on, a visited vertex after the current one is a good vertex
   // fuzzy spellings are immune to invalidation by normal spellings
-  SpellingType last_type =
-      (std::max)(graph->vertices[farthest], kFuzzySpelling);
+  SpellingType last_type = (std::max)(vertex_types_[farthest], kFuzzySpelling);
   for (int i = farthest - 1; i >= 0; --i) {
-    if (graph->vertices.find(i) == graph->vertices.end())
+    if (!visited_[i])
       continue;
-    // remove stale edges
-    for (auto j = graph->edges[i].begin(); j != graph->edges[i].end();) {
-      if (good.find(j->first) == good.end()) {
-        // not connected
-        graph->edges[i].erase(j++);
-        continue;
-      }
-      // remove disqualified syllables (eg. matching abbreviated spellings)
-      // when there is a path of more favored type
+    auto& edges(edges_[i]);
+    // remove stale edges not connected, and disqualified syllables (eg.
+    // matching abbreviated spellings) when there is a path of more favored
+    // type. correction edges are not cared about.
+    edges.erase(std::remove_if(edges.begin(), edges.end(),
+                               [this, last_type](const SpellingEdge& edge) {
+                                 return !visited_[edge.properties.end_pos] ||
+                                        (!edge.properties.is_correction &&
+                                         edge.properties.type > last_type);
+                               }),
+                edges.end());
+    for (auto it = edges.begin(); it != edges.end();) {
+      size_t end_pos = it->properties.end_pos;
       SpellingType edge_type = kInvalidSpelling;
-      for (auto k = j->second.begin(); k != j->second.end();) {
-        if (k->second.is_correction) {
-          ++k;
-          continue;  // Don't care correction edges
-        }
-        if (k->second.type > last_type) {
-          j->second.erase(k++);
-        } else {
-          if (k->second.type < edge_type)
-            edge_type = k->second.type;
-          ++k;
-        }
-      }
-      if (j->second.empty()) {
-        graph->edges[i].erase(j++);
-      } else {
-        if (edge_type < kAbbreviation)
-          CheckOverlappedSpellings(graph, i, j->first);
-        ++j;
+      for (; it != edges.end() && it->properties.end_pos == end_pos; ++it) {
+        if (!it->properties.is_correction && it->properties.type < edge_type)
+          edge_type = it->properties.type;
       }
+      if (edge_type < kAbbreviation)
+        CheckOverlappedSpellings(i, end_pos);
     }
-    if (graph->vertices[i] > last_type || graph->edges[i].empty()) {
+    if (vertex_types_[i] > last_type || edges.empty()) {
       DLOG(INFO) << "remove stale vertex at " << i;
-      graph->vertices.erase(i);
-      graph->edges.erase(i);
+      visited_[i] = false;
+      edges.clear();
       continue;
     }
     // keep the valid vertex
-    good.insert(i);
   }
 
-  if (enable_completion_ && farthest < input.length()) {
+  if (enable_completion_ && farthest < length) {
     DLOG(INFO) << "completion enabled";
     const size_t kExpandSearchLimit = 512;
     vector<Prism::Match> keys;
     prism.ExpandSearch(input.substr(farthest), &keys, kExpandSearchLimit);
     if (!keys.empty()) {
       size_t current_pos = farthest;
-      size_t end_pos = input.length();
+      size_t end_pos = length;
       size_t code_length = end_pos - current_pos;
-      auto& end_vertices(graph->edges[current_pos]);
-      auto& spellings(end_vertices[end_pos]);
+      auto& edges(edges_[current_pos]);
       for (const auto& m : keys) {
         if (m.length < code_length)
           continue;
@@ -212,16 +313,15 @@ int Syllabifier::BuildSyllableGraph(const string& input,
             props.type = kCompletion;
             props.credibility += kCompletionPenalty;
             props.end_pos = end_pos;
-            // add a syllable with properties to the edge's
-            // spelling-to-syllable map
-            spellings.insert({syllable_id, props});
+            // add a syllable with properties to the edges
+            edges.push_back({syllable_id, props});
           }
           accessor.Next();
         }
       }
-      if (spellings.empty()) {
+      merge_edges(&edges);
+      if (edges.empty()) {
         DLOG(INFO) << "no completion could be made.";
-        end_vertices.erase(end_pos);
       } else {
         DLOG(INFO) << "added to syllable graph, completion: [" << current_pos
                    << ", " << end_pos << ")";
@@ -230,60 +330,135 @@ int Syllabifier::BuildSyllableGraph(const string& input,
     }
   }
 
-  graph->input_length = input.length();
-  graph->interpreted_length = farthest;
-  DLOG(INFO) << "input length: " << graph->input_length;
-  DLOG(INFO) << "syllabified length: " << graph->interpreted_length;
+  graph_.input_length = length;
+  graph_.interpreted_length = farthest;
+  DLOG(INFO) << "input length: " << graph_.input_length;
+  DLOG(INFO) << "syllabified length: " << graph_.interpreted_length;
 
-  Transpose(graph);
+  graph_.edge_offsets.resize(length + 2);
+  for (size_t i = 0; i <= length; ++i) {
+    if (visited_[i]) {
+      graph_.vertices.push_back({i, vertex_types_[i]});
+    }
+    graph_.edge_offsets[i] = graph_.edges.size();
+    graph_.edges.insert(graph_.edges.end(), edges_[i].begin(),
+                        edges_[i].end());
+  }
+  graph_.edge_offsets[length + 1] = graph_.edges.size();
+  index_edges(&graph_);
 
   return farthest;
 }
 
-void Syllabifier::CheckOverlappedSpellings(SyllableGraph* graph,
-                                           size_t start,
-                                           size_t end) {
+size_t Syllabifier::FindEdges(const string& input,
+                              size_t start,
+                              Prism& prism,
+                              vector<SpellingEdge>* edges) {
+  edges->clear();
+  size_t current_pos = start;
+  vector<Prism::Match> matches;
+  set<SyllableId> exact_match_syllables;
+  auto current_input = input.substr(current_pos);
+  prism.CommonPrefixSearch(current_input, &matches);
+  if (corrector_) {
+    for (auto& m : matches) {
+      exact_match_syllables.insert(m.value);
+    }
+    Corrections corrections;
+    corrector_->ToleranceSearch(prism, current_input, &corrections, 5);
+    for (const auto& m : corrections) {
+      for (auto accessor = prism.QuerySpelling(m.first); !accessor.exhausted();
+           accessor.Next()) {
+        if (accessor.properties().type == kNormalSpelling) {
+          matches.push_back({m.first, m.second.length});
+          break;
+        }
+      }
+    }
+  }
+
+  // the matches stay the same with more input if no longer spelling could
+  // match, as the traversal of the trie fails within the input
+  size_t horizon = string::npos;
+  if (!corrector_) {
+    size_t node_pos = 0;
+    size_t key_pos = 0;
+    if (prism.trie().traverse(current_input.c_str(), node_pos, key_pos,
+                              current_input.length()) == -2) {
+      horizon = current_pos + key_pos + 1;
+    }
+  }
+
+  for (const auto& m : matches) {
+    if (m.length == 0)
+      continue;
+    size_t end_pos = current_pos + m.length;
+    // consume trailing delimiters
+    while (end_pos < input.length() &&
+           delimiters_.find(input[end_pos]) != string::npos)
+      ++end_pos;
+    DLOG(INFO) << "end_pos: " << end_pos;
+    // the end of an edge is known when followed by more input
+    if (end_pos == input.length()) {
+      horizon = string::npos;
+    } else if (horizon != string::npos) {
+      horizon = (std::max)(horizon, end_pos + 1);
+    }
+    bool matches_input = (current_pos == 0 && end_pos == input.length());
+    // when spelling algebra is enabled,
+    // a spelling evaluates to a set of syllables;
+    // otherwise, it resembles exactly the syllable itself.
+    SpellingAccessor accessor(prism.QuerySpelling(m.value));
+    while (!accessor.exhausted()) {
+      SyllableId syllable_id = accessor.syllable_id();
+      EdgeProperties props(accessor.properties());
+      if (strict_spelling_ && matches_input && props.type != kNormalSpelling) {
+        // disqualify fuzzy spelling or abbreviation as single word
+      } else {
+        props.end_pos = end_pos;
+        if (corrector_ && exact_match_syllables.find(m.value) ==
+                              exact_match_syllables.end()) {
+          props.is_correction = true;
+          props.credibility = kCorrectionCredibility;
+        }
+        // add a syllable with properties to the edges
+        edges->push_back({syllable_id, props});
+      }
+      accessor.Next();
+    }
+  }
+  merge_edges(edges);
+  return horizon;
+}
+
+void Syllabifier::CheckOverlappedSpellings(size_t start, size_t end) {
   const double kPenaltyForAmbiguousSyllable =
       -23.025850929940457;  // log(1e-10)
-  if (!graph || graph->edges.find(start) == graph->edges.end())
-    return;
   // if "Z" = "YX", mark the vertex between Y and X an ambiguous syllable joint
-  auto& y_end_vertices(graph->edges[start]);
+  size_t last_joint = start;
   // enumerate Ys
-  for (const auto& y : y_end_vertices) {
-    size_t joint = y.first;
+  for (const auto& y : edges_[start]) {
+    size_t joint = y.properties.end_pos;
     if (joint >= end)
       break;
+    if (joint == last_joint)
+      continue;
+    last_joint = joint;
     // test X
-    if (graph->edges.find(joint) == graph->edges.end())
+    auto& x_edges(edges_[joint]);
+    auto x = std::find_if(x_edges.begin(), x_edges.end(),
+                          [end](const SpellingEdge& edge) {
+                            return edge.properties.end_pos >= end;
+                          });
+    if (x == x_edges.end() || x->properties.end_pos != end)
       continue;
-    auto& x_end_vertices(graph->edges[joint]);
-    for (auto& x : x_end_vertices) {
-      if (x.first < end)
-        continue;
-      if (x.first == end) {
-        // discourage syllables at an ambiguous joint
-        // bad cases include pinyin syllabification "niju'ede"
-        for (auto& spelling : x.second) {
-          spelling.second.credibility += kPenaltyForAmbiguousSyllable;
-        }
-        graph->vertices[joint] = kAmbiguousSpelling;
-        DLOG(INFO) << "ambiguous syllable joint at position " << joint << ".";
-      }
-      break;
-    }
-  }
-}
-
-void Syllabifier::Transpose(SyllableGraph* graph) {
-  for (const auto& start : graph->edges) {
-    auto& index(graph->indices[start.first]);
-    for (const auto& end : boost::adaptors::reverse(start.second)) {
-      for (const auto& spelling : end.second) {
-        SyllableId syll_id = spelling.first;
-        index[syll_id].push_back(&spelling.second);
-      }
+    // discourage syllables at an ambiguous joint
+    // bad cases include pinyin syllabification "niju'ede"
+    for (; x != x_edges.end() && x->properties.end_pos == end; ++x) {
+      x->properties.credibility += kPenaltyForAmbiguousSyllable;
     }
+    vertex_types_[joint] = kAmbiguousSpelling;
+    DLOG(INFO) << "ambiguous syllable joint at position " << joint << ".";
   }
 }
 
@@ -291,4 +466,8 @@ void Syllabifier::EnableCorrection(Corrector* corrector) {
   corrector_ = corrector;
 }
 
+void Syllabifier::EnableIncremental(SyllableGraphCache* cache) {
+  cache_ = cache;
+}
+
 }  // namespace rime
@@ -34,6 +34,8 @@ using SpellingPropertiesList = vector<const EdgeProperties*>;
 using SpellingIndex = map<SyllableId, SpellingPropertiesList>;
 using SpellingIndices = map<size_t, SpellingIndex>;
 
+// the syllable graph in nested maps, kept for plugins that read the maps;
+// translators use the CompactSyllableGraph built by the syllabifier
 struct SyllableGraph {
   size_t input_length = 0;
   size_t interpreted_length = 0;
@@ -42,6 +44,64 @@ struct SyllableGraph {
   SpellingIndices indices;
 };
 
+// a syllable spelled from a vertex to properties.end_pos
+struct SpellingEdge {
+  SyllableId syllable_id;
+  EdgeProperties properties;
+};
+
+// the syllable graph in flat arrays. edges from each position are stored
+// contiguously in the order of end position and syllable id, and the index
+// lists the same range of edges grouped by syllable id, longer spellings
+// first. the edges and index entries of a position are in the range
+// [begin_of(pos), end_of(pos)).
+struct CompactSyllableGraph {
+  size_t input_length = 0;
+  size_t interpreted_length = 0;
+  // in ascending order of position
+  vector<pair<size_t, SpellingType>> vertices;
+  vector<SpellingEdge> edges;
+  // of input_length + 2 elements
+  vector<uint32_t> edge_offsets;
+  // positions in edges
+  vector<uint32_t> index;
+
+  CompactSyllableGraph() = default;
+  RIME_API explicit CompactSyllableGraph(const SyllableGraph& graph);
+
+  size_t begin_of(size_t pos) const {
+    return pos + 1 < edge_offsets.size() ? edge_offsets[pos] : edges.size();
+  }
+  size_t end_of(size_t pos) const {
+    return pos + 1 < edge_offsets.size() ? edge_offsets[pos + 1]
+                                         : edges.size();
+  }
+  bool has_edges(size_t pos) const { return begin_of(pos) < end_of(pos); }
+  // the edges of a syllable from the position, in the index
+  RIME_API pair<size_t, size_t> FindSyllable(size_t pos,
+                                             SyllableId syllable_id) const;
+  RIME_API const SpellingEdge* FindEdge(size_t start,
+                                        size_t end,
+                                        SyllableId syllable_id) const;
+  RIME_API void Clear();
+  // converts to nested maps
+  RIME_API void Export(SyllableGraph* graph) const;
+};
+
+// edges found by advancing a syllable from the vertices of the last input,
+// kept to syllabify the input extended by following keystrokes
+struct SyllableGraphCache {
+  struct Edges {
+    // the edges stay valid while the input is unchanged before this position
+    size_t horizon = 0;
+    vector<SpellingEdge> edges;
+  };
+
+  const Prism* prism = nullptr;
+  string input;
+  map<size_t, Edges> edges;
+};
+
 class Syllabifier {
  public:
   Syllabifier() = default;
@@ -52,19 +112,39 @@ class Syllabifier {
         enable_completion_(enable_completion),
         strict_spelling_(strict_spelling) {}
 
+  // builds into the graph owned by the syllabifier, whose buffers are
+  // reused by the next build
+  RIME_API int BuildSyllableGraph(const string& input, Prism& prism);
+  // builds and exports the graph to nested maps
   RIME_API int BuildSyllableGraph(const string& input,
                                   Prism& prism,
                                   SyllableGraph* graph);
   RIME_API void EnableCorrection(Corrector* corrector);
+  // reuses edges of the last input in the cache that could not have changed;
+  // ignored when correction is enabled
+  RIME_API void EnableIncremental(SyllableGraphCache* cache);
+
+  const CompactSyllableGraph& syllable_graph() const { return graph_; }
 
  protected:
-  void CheckOverlappedSpellings(SyllableGraph* graph, size_t start, size_t end);
-  void Transpose(SyllableGraph* graph);
+  // returns the position up to which the input determines the edges, or
+  // string::npos if they might change as more input follows
+  size_t FindEdges(const string& input,
+                   size_t start,
+                   Prism& prism,
+                   vector<SpellingEdge>* edges);
+  void CheckOverlappedSpellings(size_t start, size_t end);
 
   string delimiters_;
   bool enable_completion_ = false;
   bool strict_spelling_ = false;
   Corrector* corrector_ = nullptr;
+  SyllableGraphCache* cache_ = nullptr;
+  CompactSyllableGraph graph_;
+  // edges from each position, and types of vertices visited while building
+  vector<vector<SpellingEdge>> edges_;
+  vector<SpellingType> vertex_types_;
+  vector<bool> visited_;
 };
 
 }  // namespace rime
@@ -21,6 +21,7 @@
 #include <utility>
 #include <vector>
 #include <boost/optional.hpp>
+#include <boost/utility/string_view.hpp>
 #define BOOST_BIND_NO_PLACEHOLDERS
 #ifdef RIME_BOOST_SIGNALS2
 #include <boost/signals2/connection.hpp>
@@ -44,6 +45,7 @@
 namespace rime {
 
 using boost::optional;
+using boost::string_view;
 using std::function;
 using std::list;
 using std::make_pair;
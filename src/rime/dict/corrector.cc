@@ -8,7 +8,6 @@
 #include "corrector.h"
 #include <algorithm>
 #include <numeric>
-#include <queue>
 #include <rime/schema.h>
 #include <rime/service.h>
 #include <rime/ticket.h>
@@ -16,55 +15,61 @@
 using namespace rime;
 using namespace corrector;
 
-static hash_map<char, hash_set<char>> keyboard_map = {
-    {'1', {'2', 'q', 'w'}},
-    {'2', {'1', '3', 'q', 'w', 'e'}},
-    {'3', {'2', '4', 'w', 'e', 'r'}},
-    {'4', {'3', '5', 'e', 'r', 't'}},
-    {'5', {'4', '6', 'r', 't', 'y'}},
-    {'6', {'5', '7', 't', 'y', 'u'}},
-    {'7', {'6', '8', 'y', 'u', 'i'}},
-    {'8', {'7', '9', 'u', 'i', 'o'}},
-    {'9', {'8', '0', 'i', 'o', 'p'}},
-    {'0', {'9', '-', 'o', 'p', '['}},
-    {'-', {'0', '=', 'p', '[', ']'}},
-    {'=', {'-', '[', ']', '\\'}},
-    {'q', {'w'}},
-    {'w', {'q', 'e'}},
-    {'e', {'w', 'r'}},
-    {'r', {'e', 't'}},
-    {'t', {'r', 'y'}},
-    {'y', {'t', 'u'}},
-    {'u', {'y', 'i'}},
-    {'i', {'u', 'o'}},
-    {'o', {'i', 'p'}},
-    {'p', {'o', '['}},
-    {'[', {'p', ']'}},
-    {']', {'[', '\\'}},
-    {'\\', {']'}},
-    {'a', {'s'}},
-    {'s', {'a', 'd'}},
-    {'d', {'s', 'f'}},
-    {'f', {'d', 'g'}},
-    {'g', {'f', 'h'}},
-    {'h', {'g', 'j'}},
-    {'j', {'h', 'k'}},
-    {'k', {'j', 'l'}},
-    {'l', {'k', ';'}},
-    {';', {'l', '\''}},
-    {'\'', {';'}},
-    {'z', {'x'}},
-    {'x', {'z', 'c'}},
-    {'c', {'x', 'v'}},
-    {'v', {'c', 'b'}},
-    {'b', {'v', 'n'}},
-    {'n', {'b', 'm'}},
-    {'m', {'n', ','}},
-    {',', {'m', '.'}},
-    {'.', {',', '/'}},
-    {'/', {'.'}},
+static const char* kQwertyRows[] = {
+    "1234567890-=",
+    "qwertyuiop[]\\",
+    "asdfghjkl;'",
+    "zxcvbnm,./",
 };
 
+static const char* kDvorakRows[] = {
+    "1234567890[]",
+    "',.pyfgcrl/=\\",
+    "aoeuidhtns-",
+    ";qjkxbmwvz",
+};
+
+KeyboardLayout::KeyboardLayout(const char* const rows[], size_t num_rows) {
+  for (size_t i = 0; i < num_rows; ++i) {
+    const string row(rows[i]);
+    for (size_t j = 0; j < row.length(); ++j) {
+      string& neighbors(neighbors_[static_cast<unsigned char>(row[j])]);
+      if (j > 0)
+        neighbors.push_back(row[j - 1]);
+      if (j + 1 < row.length())
+        neighbors.push_back(row[j + 1]);
+      // keys of the top row are also next to the keys below them
+      if (i == 0 && i + 1 < num_rows) {
+        const string below(rows[i + 1]);
+        for (size_t k = (j > 0 ? j - 1 : 0); k <= j + 1 && k < below.length();
+             ++k) {
+          neighbors.push_back(below[k]);
+        }
+      }
+    }
+  }
+}
+
+const KeyboardLayout& KeyboardLayout::Qwerty() {
+  static const KeyboardLayout qwerty(kQwertyRows,
+                                     sizeof(kQwertyRows) / sizeof(char*));
+  return qwerty;
+}
+
+const KeyboardLayout& KeyboardLayout::Dvorak() {
+  static const KeyboardLayout dvorak(kDvorakRows,
+                                     sizeof(kDvorakRows) / sizeof(char*));
+  return dvorak;
+}
+
+const KeyboardLayout* KeyboardLayout::Find(const string& name) {
+  if (name == "qwerty")
+    return &Qwerty();
+  if (name == "dvorak")
+    return &Dvorak();
+  return nullptr;
+}
+
 void DFSCollect(const string& origin,
                 const string& current,
                 size_t ed,
@@ -92,11 +97,105 @@ void DFSCollect(const string& origin,
     temp.erase(i, 1);
     Spelling spelling(origin);
     spelling.properties.tips = origin;
-    result[temp].push_back(spelling);
+    result[temp].push_back(std::move(spelling));
     DFSCollect(origin, temp, ed - 1, result);
   }
 }
 
+DistanceKernel::DistanceKernel(const string& input,
+                               bool restricted,
+                               const KeyboardLayout& layout)
+    : input_(input), restricted_(restricted), layout_(layout) {}
+
+void DistanceKernel::ComputeMasks(unsigned char ch) {
+  std::bitset<256> neighbors;
+  for (char key : layout_.neighbors(ch)) {
+    neighbors.set(static_cast<unsigned char>(key));
+  }
+  uint64_t same = 0;
+  uint64_t neighbor = 0;
+  for (size_t i = 0; i < input_.length(); ++i) {
+    uint64_t bit = uint64_t(1) << (i + 1);
+    unsigned char key = input_[i];
+    if (key == ch) {
+      same |= bit;
+    } else if (neighbors.test(key)) {
+      neighbor |= bit;
+    }
+  }
+  same_[ch] = same;
+  neighbor_[ch] = neighbor;
+  computed_.set(ch);
+}
+
+Distance DistanceKernel::Score(const string& spelling,
+                               Distance threshold,
+                               size_t input_length) {
+  const Distance kNeighborCost = 1;
+  const Distance kTypoCost = 4;
+  const Distance kSwapCost = 2;
+  const Distance indel_cost = restricted_ ? 2 : 1;
+  const size_t m = (std::min)(input_length, input_.length());
+  const size_t n = spelling.length();
+  // no spelling is farther than deleting all and inserting all
+  const Distance top = (std::min)(threshold, indel_cost * (m + n));
+  const size_t depth = top + 1;
+  const uint64_t all = (uint64_t(2) << m) - 1;
+  // distances of three successive columns, each a word per distance
+  levels_.resize(3 * depth);
+  uint64_t* current = &levels_[0];
+  uint64_t* previous = nullptr;
+  uint64_t* before = nullptr;
+  for (Distance k = 0; k < depth; ++k) {
+    current[k] = (uint64_t(2) << (std::min)(k / indel_cost, m)) - 1;
+  }
+  uint64_t last_same = 0;
+  for (size_t j = 1; j <= n; ++j) {
+    before = previous;
+    previous = current;
+    current = &levels_[(j % 3) * depth];
+    unsigned char ch = spelling[j - 1];
+    if (!computed_.test(ch)) {
+      ComputeMasks(ch);
+    }
+    const uint64_t same = same_[ch] & all;
+    const uint64_t neighbor = neighbor_[ch] & all;
+    // the last two characters are swapped in the input
+    const uint64_t swapped = restricted_ ? last_same & (same << 1) : 0;
+    for (Distance k = 0; k < depth; ++k) {
+      uint64_t r = (previous[k] << 1) & same;
+      if (k >= kNeighborCost)
+        r |= (previous[k - kNeighborCost] << 1) & neighbor;
+      if (k >= indel_cost)
+        r |= previous[k - indel_cost] | (current[k - indel_cost] << 1);
+      if (k >= kTypoCost)
+        r |= previous[k - kTypoCost] << 1;
+      if (swapped && k >= kSwapCost)
+        r |= (before[k - kSwapCost] << 2) & swapped;
+      current[k] = r & all;
+    }
+    // early termination: distances never decrease from column to column
+    if (!current[top])
+      return threshold + 1;
+    last_same = same_[ch];
+  }
+  for (Distance k = 0; k < depth; ++k) {
+    if (current[k] >> m & 1)
+      return k;
+  }
+  return threshold + 1;
+}
+
+vector<Distance> DistanceKernel::Score(const vector<string>& spellings,
+                                       Distance threshold) {
+  vector<Distance> distances;
+  distances.reserve(spellings.size());
+  for (const auto& spelling : spellings) {
+    distances.push_back(Score(spelling, threshold));
+  }
+  return distances;
+}
+
 void EditDistanceCorrector::ToleranceSearch(const Prism& prism,
                                             const string& key,
                                             Corrections* results,
@@ -106,6 +205,9 @@ void EditDistanceCorrector::ToleranceSearch(const Prism& prism,
   size_t key_len = key.length();
 
   vector<size_t> jump_pos(key_len);
+  // scores spellings against every prefix of the key
+  DistanceKernel kernel(key.substr(0, DistanceKernel::kMaxLength), true,
+                        layout_);
 
   auto match_next = [&](size_t& node, size_t& point) -> bool {
     auto res_val = trie_->traverse(key.c_str(), node, point, point + 1);
@@ -115,11 +217,13 @@ void EditDistanceCorrector::ToleranceSearch(const Prism& prism,
       for (auto accessor = QuerySpelling(res_val); !accessor.exhausted();
            accessor.Next()) {
         auto origin = accessor.properties().tips;
-        auto current_input = key.substr(0, point);
-        if (origin == current_input) {
+        if (origin.compare(0, string::npos, key, 0, point) == 0) {
           continue;  // early termination: this comparison is O(n)
         }
-        auto distance = RestrictedDistance(origin, current_input, threshold);
+        auto distance =
+            point <= kernel.input().length()
+                ? kernel.Score(origin, threshold, point)
+                : RestrictedDistance(origin, key.substr(0, point), threshold);
         if (distance <= threshold) {  // only trace near words
           SyllableId corrected;
           if (prism.GetValue(origin, &corrected)) {
@@ -149,10 +253,12 @@ void EditDistanceCorrector::ToleranceSearch(const Prism& prism,
   }
 }
 
-inline uint8_t SubstCost(char left, char right) {
+inline uint8_t SubstCost(char left,
+                         char right,
+                         const KeyboardLayout& layout) {
   if (left == right)
     return 0;
-  if (keyboard_map[left].find(right) != keyboard_map[left].end()) {
+  if (layout.IsNeighbor(left, right)) {
     return 1;
   }
   return 4;
@@ -162,6 +268,10 @@ inline uint8_t SubstCost(char left, char right) {
 // https://en.wikibooks.org/wiki/Algorithm_Implementation/Strings/Levenshtein_distance#C++
 Distance EditDistanceCorrector::LevenshteinDistance(const std::string& s1,
                                                     const std::string& s2) {
+  if (s2.length() <= DistanceKernel::kMaxLength) {
+    return DistanceKernel(s2, false, layout_)
+        .Score(s1, s1.length() + s2.length());
+  }
   // To change the type this function manipulates and returns, change
   // the return type and the types of the two variables below.
   auto s1len = (size_t)s1.size();
@@ -178,7 +288,7 @@ Distance EditDistanceCorrector::LevenshteinDistance(const std::string& s1,
     for (auto y = column_start; y <= s1len; y++) {
       auto old_diagonal = column[y];
       auto possibilities = {column[y] + 1, column[y - 1] + 1,
-                            last_diagonal + SubstCost(s1[y - 1], s2[x - 1])};
+                            last_diagonal + SubstCost(s1[y - 1], s2[x - 1], layout_)};
 
       column[y] = (std::min)(possibilities);
       last_diagonal = old_diagonal;
@@ -193,6 +303,9 @@ Distance EditDistanceCorrector::LevenshteinDistance(const std::string& s1,
 Distance EditDistanceCorrector::RestrictedDistance(const std::string& s1,
                                                    const std::string& s2,
                                                    Distance threshold) {
+  if (s2.length() <= DistanceKernel::kMaxLength) {
+    return DistanceKernel(s2, true, layout_).Score(s1, threshold);
+  }
   auto len1 = s1.size(), len2 = s2.size();
   vector<size_t> d((len1 + 1) * (len2 + 1));
 
@@ -209,7 +322,8 @@ Distance EditDistanceCorrector::RestrictedDistance(const std::string& s1,
     for (size_t j = 1; j <= len2; ++j) {
       d[index(i, j)] = (std::min)(
           {d[index(i - 1, j)] + 2, d[index(i, j - 1)] + 2,
-           d[index(i - 1, j - 1)] + SubstCost(s1[i - 1], s2[j - 1])});
+           d[index(i - 1, j - 1)] +
+               SubstCost(s1[i - 1], s2[j - 1], layout_)});
       if (i > 1 && j > 1 && s1[i - 2] == s2[j - 1] && s1[i - 1] == s2[j - 2]) {
         d[index(i, j)] = (std::min)(d[index(i, j)], d[index(i - 2, j - 2)] + 2);
       }
@@ -240,8 +354,9 @@ bool EditDistanceCorrector::Build(const Syllabary& syllabary,
   return Prism::Build(syllabary, &correction_script, dict_file_checksum,
                       schema_file_checksum);
 }
-EditDistanceCorrector::EditDistanceCorrector(const string& file_name)
-    : Prism(file_name) {}
+EditDistanceCorrector::EditDistanceCorrector(const string& file_name,
+                                             const KeyboardLayout& layout)
+    : Prism(file_name), layout_(layout) {}
 
 void NearSearchCorrector::ToleranceSearch(const Prism& prism,
                                           const string& key,
@@ -250,38 +365,36 @@ void NearSearchCorrector::ToleranceSearch(const Prism& prism,
   if (key.empty())
     return;
 
-  using record = struct {
+  // walks the trie along the key, where a key may be mistyped for one of
+  // its neighbors until the distance reaches the threshold
+  struct Step {
     size_t node_pos;
-    size_t idx;
+    size_t length;
     size_t distance;
-    char ch;
   };
-
-  std::queue<record> queue;
-  queue.push({0, 0, 0, key[0]});
-  for (auto subst : keyboard_map[key[0]]) {
-    queue.push({0, 0, 1, subst});
-  }
-  for (; !queue.empty(); queue.pop()) {
-    auto& rec = queue.front();
-    char ch = rec.ch;
-    char& exchange(const_cast<char*>(key.c_str())[rec.idx]);
-    std::swap(ch, exchange);
-    auto val =
-        prism.trie().traverse(key.c_str(), rec.node_pos, rec.idx, rec.idx + 1);
-    std::swap(ch, exchange);
-
+  vector<Step> steps = {{0, 0, 0}};
+  auto advance = [&](const Step& step, char ch, size_t distance) {
+    size_t node_pos = step.node_pos;
+    size_t key_pos = 0;
+    auto val = prism.trie().traverse(&ch, node_pos, key_pos, 1);
     if (val == -2)
-      continue;
+      return;
+    size_t length = step.length + 1;
     if (val >= 0) {
-      results->Alter(val, {rec.distance, val, rec.idx});
+      results->Alter(val, {distance, static_cast<SyllableId>(val), length});
     }
-    if (rec.idx < key.size()) {
-      queue.push({rec.node_pos, rec.idx, rec.distance, key[rec.idx]});
-      if (rec.distance < threshold) {
-        for (auto subst : keyboard_map[key[rec.idx]]) {
-          queue.push({rec.node_pos, rec.idx, rec.distance + 1, subst});
-        }
+    if (length < key.length()) {
+      steps.push_back({node_pos, length, distance});
+    }
+  };
+  while (!steps.empty()) {
+    Step step = steps.back();
+    steps.pop_back();
+    char typed = key[step.length];
+    advance(step, typed, step.distance);
+    if (step.distance < threshold) {
+      for (char ch : layout_.neighbors(typed)) {
+        advance(step, ch, step.distance + 1);
       }
     }
   }
@@ -299,10 +412,21 @@ CorrectorComponent::CorrectorComponent()
           {"corrector", "", ".correction.bin"})) {}
 
 Corrector* CorrectorComponent::Create(const Ticket& ticket) noexcept {
+  Config* config = ticket.schema ? ticket.schema->config() : nullptr;
+  // the keys likely mistyped for each other, to both kinds of correction
+  const KeyboardLayout* layout = &KeyboardLayout::Qwerty();
+  string layout_name;
+  if (config &&
+      config->GetString(ticket.name_space + "/keyboard_layout", &layout_name)) {
+    layout = KeyboardLayout::Find(layout_name);
+    if (!layout) {
+      LOG(WARNING) << "unknown keyboard layout: " << layout_name;
+      layout = &KeyboardLayout::Qwerty();
+    }
+  }
   // Don't use edit distance based correction for now.
 #if 0
-  if (!ticket.schema) return nullptr;
-  Config* config = ticket.schema->config();
+  if (!config) return nullptr;
   string prism_name;
   if (!config->GetString(ticket.name_space + "/prism", &prism_name)) {
     config->GetString(ticket.name_space + "/dictionary", &prism_name);
@@ -310,12 +434,12 @@ Corrector* CorrectorComponent::Create(const Ticket& ticket) noexcept {
 
   auto file_name = resolver_->ResolvePath(prism_name).string();
 
-  auto ed_corrector = New<EditDistanceCorrector>(file_name);
-  if (edCorrector->Load()) {
-    return Combine(New<NearSearchCorrector>(), ed_corrector);
+  auto ed_corrector = New<EditDistanceCorrector>(file_name, *layout);
+  if (ed_corrector->Load()) {
+    return Combine(New<NearSearchCorrector>(*layout), ed_corrector);
   } else {
-    return new NearSearchCorrector();
+    return new NearSearchCorrector(*layout);
   }
 #endif
-  return new NearSearchCorrector();
+  return new NearSearchCorrector(*layout);
 }
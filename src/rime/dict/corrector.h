@@ -8,6 +8,7 @@
 #ifndef RIME_CORRECTOR_H
 #define RIME_CORRECTOR_H
 
+#include <bitset>
 #include <rime/common.h>
 #include <rime/component.h>
 #include <rime/algo/algebra.h>
@@ -18,12 +19,35 @@
 namespace rime {
 struct Ticket;
 
+// the keys next to each key on a keyboard, likely to be mistyped for it
+class KeyboardLayout {
+ public:
+  // rows of keys from top to bottom, where a key of the top row also has
+  // neighbors in the row below it
+  KeyboardLayout(const char* const rows[], size_t num_rows);
+
+  RIME_API static const KeyboardLayout& Qwerty();
+  RIME_API static const KeyboardLayout& Dvorak();
+  // returns nullptr for an unknown layout
+  RIME_API static const KeyboardLayout* Find(const string& name);
+
+  const string& neighbors(char key) const {
+    return neighbors_[static_cast<unsigned char>(key)];
+  }
+  bool IsNeighbor(char key, char other) const {
+    return neighbors(key).find(other) != string::npos;
+  }
+
+ private:
+  string neighbors_[256];
+};
+
 class SymDeleteCollector {
  public:
   explicit SymDeleteCollector(const Syllabary& syllabary)
       : syllabary_(syllabary) {}
 
-  Script Collect(size_t edit_distance);
+  RIME_API Script Collect(size_t edit_distance);
 
  private:
   const Syllabary& syllabary_;
@@ -48,6 +72,49 @@ class Corrections : public hash_map<SyllableId, Correction> {
     }
   };
 };
+
+// Computes the weighted edit distances of spellings to an input of at most
+// kMaxLength characters, where a character is mistyped for a neighboring key
+// at cost 1, inserted or deleted at cost 2 (1 unless restricted), mistyped
+// otherwise at cost 4, and swapped with the next one at cost 2 if restricted.
+// For each distance up to the threshold, the bits of a word mark the input
+// prefixes within that distance of the spelling scanned so far, so a
+// character of the spelling takes a few word operations per distance.
+// The masks of characters are shared among spellings scored in a batch.
+class DistanceKernel {
+ public:
+  static const size_t kMaxLength = 63;
+
+  RIME_API DistanceKernel(
+      const string& input,
+      bool restricted,
+      const KeyboardLayout& layout = KeyboardLayout::Qwerty());
+
+  // returns a value greater than the threshold if the spelling is beyond it
+  Distance Score(const string& spelling, Distance threshold) {
+    return Score(spelling, threshold, input_.length());
+  }
+  // scores against the prefix of given length of the input
+  RIME_API Distance Score(const string& spelling,
+                          Distance threshold,
+                          size_t input_length);
+  RIME_API vector<Distance> Score(const vector<string>& spellings,
+                                  Distance threshold);
+
+  const string& input() const { return input_; }
+
+ private:
+  void ComputeMasks(unsigned char ch);
+
+  string input_;
+  bool restricted_;
+  const KeyboardLayout& layout_;
+  // input positions, counting from 1, of the same or a neighboring character
+  uint64_t same_[256];
+  uint64_t neighbor_[256];
+  std::bitset<256> computed_;
+  vector<uint64_t> levels_;
+};
 }  // namespace corrector
 
 /**
@@ -94,7 +161,9 @@ class CorrectorComponent : public Corrector::Component {
 class EditDistanceCorrector : public Corrector, public Prism {
  public:
   ~EditDistanceCorrector() override = default;
-  RIME_API explicit EditDistanceCorrector(const string& file_name);
+  RIME_API explicit EditDistanceCorrector(
+      const string& file_name,
+      const KeyboardLayout& layout = KeyboardLayout::Qwerty());
 
   RIME_API bool Build(const Syllabary& syllabary,
                       const Script* script = nullptr,
@@ -110,16 +179,24 @@ class EditDistanceCorrector : public Corrector, public Prism {
   corrector::Distance RestrictedDistance(const std::string& s1,
                                          const std::string& s2,
                                          corrector::Distance threshold);
+
+ private:
+  const KeyboardLayout& layout_;
 };
 
 class RIME_API NearSearchCorrector : public Corrector {
  public:
-  NearSearchCorrector() = default;
+  explicit NearSearchCorrector(
+      const KeyboardLayout& layout = KeyboardLayout::Qwerty())
+      : layout_(layout) {}
   ~NearSearchCorrector() override = default;
   void ToleranceSearch(const Prism& prism,
                        const string& key,
                        corrector::Corrections* results,
                        size_t tolerance) override;
+
+ private:
+  const KeyboardLayout& layout_;
 };
 
 template <class... Cs>
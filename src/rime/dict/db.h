@@ -56,6 +56,9 @@ class Db : public Class<Db, const string&> {
   virtual bool Update(const string& key, const string& value) = 0;
   virtual bool Erase(const string& key) = 0;
 
+  // implementation specific statistics, e.g. "leveldb.stats"
+  virtual bool GetProperty(const string& name, string* value) { return false; }
+
   const string& name() const { return name_; }
   const string& file_name() const { return file_name_; }
   bool loaded() const { return loaded_; }
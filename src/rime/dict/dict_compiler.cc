@@ -243,6 +243,10 @@ bool DictCompiler::BuildTable(int table_index,
     if (settings->sort_order() != "original") {
       vocabulary.SortHomophones();
     }
+    if (settings->completion_prefix_length() > 0) {
+      table->set_completion_index(settings->completion_prefix_length(),
+                                  settings->completion_max_entries());
+    }
     table->Remove();
     if (!table->Build(collector.syllabary, vocabulary, collector.num_entries,
                       dict_file_checksum) ||
@@ -10,6 +10,7 @@
 #include <rime/registry.h>
 #include <rime/dict/db.h>
 #include <rime/dict/level_db.h>
+#include <rime/dict/mapped_db.h>
 #include <rime/dict/table_db.h>
 #include <rime/dict/text_db.h>
 #include <rime/dict/user_db.h>
@@ -29,6 +30,7 @@ static void rime_dict_initialize() {
   r.Register("stabledb", new DbComponent<StableDb>);
   r.Register("plain_userdb", new UserDbComponent<TextDb>);
   r.Register("userdb", new UserDbComponent<LevelDb>);
+  r.Register("mapped_userdb", new UserDbComponent<MappedDb>);
   // NOTE: register a legacy_userdb component in your plugin if you wish to
   // upgrade userdbs from an old file format (eg. TreeDb) during maintenance.
   // r.Register("legacy_userdb", ...);
@@ -40,6 +42,7 @@ static void rime_dict_initialize() {
   r.Register("user_dictionary", new UserDictionaryComponent);
 
   r.Register("userdb_recovery_task", new UserDbRecoveryTaskComponent);
+  r.Register("user_dict_flush", new Component<UserDictFlushTask>);
 }
 
 static void rime_dict_finalize() {}
@@ -76,6 +76,20 @@ double DictSettings::min_phrase_weight() {
   return (*this)["min_phrase_weight"].ToDouble();
 }
 
+// completion_index:
+//   max_prefix_length: 2
+//   max_entries: 100
+int DictSettings::completion_prefix_length() {
+  return (*this)["completion_index"]["max_prefix_length"].ToInt();
+}
+
+static const int kDefaultCompletionMaxEntries = 100;
+
+int DictSettings::completion_max_entries() {
+  int value = (*this)["completion_index"]["max_entries"].ToInt();
+  return value > 0 ? value : kDefaultCompletionMaxEntries;
+}
+
 an<ConfigList> DictSettings::GetTables() {
   if (empty())
     return nullptr;
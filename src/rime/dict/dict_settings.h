@@ -26,6 +26,8 @@ class DictSettings : public Config {
   bool use_rule_based_encoder();
   int max_phrase_length();
   double min_phrase_weight();
+  int completion_prefix_length();
+  int completion_max_entries();
   an<ConfigList> GetTables();
   int GetColumnIndex(const string& column_label);
 };
@@ -4,6 +4,7 @@
 //
 // 2011-07-05 GONG Chen <chen.sst@gmail.com>
 //
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include <rime/algo/syllabifier.h>
 #include <rime/common.h>
@@ -44,6 +45,10 @@ struct Chunk {
 
 struct QueryResult {
   vector<Chunk> chunks;
+  // once sorted, indices of the chunks with remaining entries, kept in a
+  // binary heap with the chunk of the best head entry on top
+  vector<size_t> heap;
+  bool sorted = false;
 };
 
 bool compare_chunk_by_head_element(const Chunk& a, const Chunk& b) {
@@ -57,25 +62,37 @@ bool compare_chunk_by_head_element(const Chunk& a, const Chunk& b) {
          b.credibility + b.entries[b.cursor].weight;  // by weight desc
 }
 
+// orders chunks in the heap, where the chunk added first wins a tie
+struct ChunkHeapCompare {
+  const vector<Chunk>& chunks;
+
+  bool operator()(size_t a, size_t b) const {
+    // whether a goes below b in the heap
+    if (compare_chunk_by_head_element(chunks[b], chunks[a]))
+      return true;
+    if (compare_chunk_by_head_element(chunks[a], chunks[b]))
+      return false;
+    return a > b;
+  }
+};
+
 size_t match_extra_code(const table::Code* extra_code,
                         size_t depth,
-                        const SyllableGraph& syll_graph,
+                        const CompactSyllableGraph& syll_graph,
                         size_t current_pos) {
   if (!extra_code || depth >= extra_code->size)
     return current_pos;  // success
   if (current_pos >= syll_graph.interpreted_length)
     return 0;  // failure (possibly success for completion in the future)
-  auto index = syll_graph.indices.find(current_pos);
-  if (index == syll_graph.indices.end())
-    return 0;
   SyllableId current_syll_id = extra_code->at[depth];
-  auto spellings = index->second.find(current_syll_id);
-  if (spellings == index->second.end())
+  auto spellings = syll_graph.FindSyllable(current_pos, current_syll_id);
+  if (spellings.first == spellings.second)
     return 0;
   size_t best_match = 0;
-  for (const SpellingProperties* props : spellings->second) {
+  for (size_t i = spellings.first; i < spellings.second; ++i) {
+    const auto& props = syll_graph.edges[syll_graph.index[i]].properties;
     size_t match_end_pos =
-        match_extra_code(extra_code, depth + 1, syll_graph, props->end_pos);
+        match_extra_code(extra_code, depth + 1, syll_graph, props.end_pos);
     if (!match_end_pos)
       continue;
     if (match_end_pos > best_match)
@@ -90,39 +107,67 @@ DictEntryIterator::DictEntryIterator()
     : query_result_(New<dictionary::QueryResult>()) {}
 
 void DictEntryIterator::AddChunk(dictionary::Chunk&& chunk) {
-  query_result_->chunks.push_back(std::move(chunk));
   entry_count_ += chunk.size;
+  query_result_->chunks.push_back(std::move(chunk));
+  if (query_result_->sorted && query_result_->chunks.back().size > 0) {
+    query_result_->heap.push_back(query_result_->chunks.size() - 1);
+    Sort();
+  }
 }
 
 void DictEntryIterator::Sort() {
-  auto& chunks = query_result_->chunks;
-  // partial-sort remaining chunks, move best match to chunk_index_
-  std::partial_sort(chunks.begin() + chunk_index_,
-                    chunks.begin() + chunk_index_ + 1, chunks.end(),
-                    dictionary::compare_chunk_by_head_element);
+  // heap up the remaining chunks, with the best match on top
+  const auto& chunks = query_result_->chunks;
+  auto& heap = query_result_->heap;
+  if (!query_result_->sorted) {
+    for (size_t i = chunk_index_; i < chunks.size(); ++i) {
+      if (chunks[i].cursor < chunks[i].size)
+        heap.push_back(i);
+    }
+    query_result_->sorted = true;
+  }
+  std::make_heap(heap.begin(), heap.end(),
+                 dictionary::ChunkHeapCompare{chunks});
 }
 
 void DictEntryIterator::AddFilter(DictEntryFilter filter) {
   DictEntryFilterBinder::AddFilter(filter);
   // the introduced filter could invalidate the current or even all the
   // remaining entries
-  while (!exhausted() && !filter_(Peek())) {
+  while (!exhausted() && !filter_(PeekView())) {
     FindNextEntry();
   }
 }
 
+// the chunk of the entry at the cursor
+inline static const dictionary::Chunk& current_chunk(
+    const dictionary::QueryResult& query_result,
+    size_t chunk_index) {
+  return query_result.chunks[query_result.sorted ? query_result.heap.front()
+                                                 : chunk_index];
+}
+
+inline static double entry_weight(const dictionary::Chunk& chunk) {
+  const double kS = 18.420680743952367;  // log(1e8)
+  return chunk.entries[chunk.cursor].weight - kS + chunk.credibility;
+}
+
 an<DictEntry> DictEntryIterator::Peek() {
   if (!entry_ && !exhausted()) {
     // get next entry from current chunk
-    const auto& chunk = query_result_->chunks[chunk_index_];
-    const auto& e = chunk.entries[chunk.cursor];
-    DLOG(INFO) << "creating temporary dict entry '"
-               << chunk.table->GetEntryText(e) << "'.";
+    const auto& chunk = current_chunk(*query_result_, chunk_index_);
     entry_ = New<DictEntry>();
     entry_->code = chunk.code;
-    entry_->text = chunk.table->GetEntryText(e);
-    const double kS = 18.420680743952367;  // log(1e8)
-    entry_->weight = e.weight - kS + chunk.credibility;
+    const auto* e = &chunk.entries[chunk.cursor];
+    if (e == text_entry_) {
+      // reuse the text decoded by PeekView(), copied so that the views
+      // taken of it stay valid
+      entry_->text = text_;
+    } else {
+      entry_->text = chunk.table->GetEntryText(*e);
+    }
+    DLOG(INFO) << "creating temporary dict entry '" << entry_->text << "'.";
+    entry_->weight = entry_weight(chunk);
     if (!chunk.remaining_code.empty()) {
       entry_->comment = "~" + chunk.remaining_code;
       entry_->remaining_code_length = chunk.remaining_code.length();
@@ -131,20 +176,51 @@ an<DictEntry> DictEntryIterator::Peek() {
   return entry_;
 }
 
+DictEntryView DictEntryIterator::PeekView() {
+  if (entry_ || exhausted()) {
+    return entry_ ? DictEntryView(*entry_) : DictEntryView();
+  }
+  const auto& chunk = current_chunk(*query_result_, chunk_index_);
+  const auto* e = &chunk.entries[chunk.cursor];
+  if (e != text_entry_) {
+    text_ = chunk.table->GetEntryText(*e);
+    text_entry_ = e;
+  }
+  DictEntryView view;
+  view.text = text_;
+  view.code = &chunk.code;
+  view.weight = entry_weight(chunk);
+  view.remaining_code_length = chunk.remaining_code.length();
+  return view;
+}
+
 bool DictEntryIterator::FindNextEntry() {
   if (exhausted()) {
     return false;
   }
-  auto& chunk = query_result_->chunks[chunk_index_];
-  if (++chunk.cursor >= chunk.size) {
-    ++chunk_index_;
+  if (!query_result_->sorted) {
+    auto& chunk = query_result_->chunks[chunk_index_];
+    if (++chunk.cursor >= chunk.size) {
+      ++chunk_index_;
+    }
+    if (exhausted()) {
+      return false;
+    }
+    // heap up chunks to move the one with the best entry to head
+    Sort();
+    return true;
   }
-  if (exhausted()) {
-    return false;
+  // advance the chunk on top, and sift it down the heap
+  auto& heap = query_result_->heap;
+  auto& chunk = query_result_->chunks[heap.front()];
+  dictionary::ChunkHeapCompare compare{query_result_->chunks};
+  std::pop_heap(heap.begin(), heap.end(), compare);
+  if (++chunk.cursor >= chunk.size) {
+    heap.pop_back();
+  } else {
+    std::push_heap(heap.begin(), heap.end(), compare);
   }
-  // reorder chunks to move the one with the best entry to head
-  Sort();
-  return true;
+  return !exhausted();
 }
 
 bool DictEntryIterator::Next() {
@@ -152,7 +228,7 @@ bool DictEntryIterator::Next() {
   if (!FindNextEntry()) {
     return false;
   }
-  while (filter_ && !filter_(Peek())) {
+  while (filter_ && !filter_(PeekView())) {
     if (!FindNextEntry()) {
       return false;
     }
@@ -162,6 +238,15 @@ bool DictEntryIterator::Next() {
 
 // Note: does not apply filters
 bool DictEntryIterator::Skip(size_t num_entries) {
+  if (query_result_->sorted) {
+    // skips in the order of entries
+    for (; num_entries > 0; --num_entries) {
+      entry_.reset();
+      if (!FindNextEntry())
+        return false;
+    }
+    return true;
+  }
   while (num_entries > 0) {
     if (exhausted())
       return false;
@@ -177,7 +262,9 @@ bool DictEntryIterator::Skip(size_t num_entries) {
 }
 
 bool DictEntryIterator::exhausted() const {
-  return chunk_index_ >= query_result_->chunks.size();
+  return query_result_->sorted
+             ? query_result_->heap.empty()
+             : chunk_index_ >= query_result_->chunks.size();
 }
 
 // Dictionary members
@@ -192,35 +279,36 @@ Dictionary::Dictionary(string name,
       prism_(std::move(prism)) {}
 
 Dictionary::~Dictionary() {
+  // stop touching the tables before they may be released
+  CancelWarmup();
   // should not close shared table and prism objects
 }
 
 static void lookup_table(Table* table,
                          DictEntryCollector* collector,
-                         const SyllableGraph& syllable_graph,
+                         const CompactSyllableGraph& syllable_graph,
                          size_t start_pos,
-                         double initial_credibility) {
-  TableQueryResult result;
-  if (!table->Query(syllable_graph, start_pos, &result)) {
+                         double initial_credibility,
+                         TableQueryBuffer* buffer) {
+  if (!table->Query(syllable_graph, start_pos, buffer)) {
     return;
   }
   // copy result
-  for (auto& v : result) {
-    size_t end_pos = v.first;
-    for (TableAccessor& a : v.second) {
-      double cr = initial_credibility + a.credibility();
-      if (a.extra_code()) {
-        do {
-          size_t actual_end_pos = dictionary::match_extra_code(
-              a.extra_code(), 0, syllable_graph, end_pos);
-          if (actual_end_pos == 0)
-            continue;
-          (*collector)[actual_end_pos].AddChunk(
-              {table, a.code(), a.entry(), cr});
-        } while (a.Next());
-      } else {
-        (*collector)[end_pos].AddChunk({table, a, cr});
-      }
+  for (auto& match : buffer->matches) {
+    size_t end_pos = match.end_pos;
+    TableAccessor& a = match.accessor;
+    double cr = initial_credibility + a.credibility();
+    if (a.extra_code()) {
+      do {
+        size_t actual_end_pos = dictionary::match_extra_code(
+            a.extra_code(), 0, syllable_graph, end_pos);
+        if (actual_end_pos == 0)
+          continue;
+        (*collector)[actual_end_pos].AddChunk(
+            {table, a.code(), a.entry(), cr});
+      } while (a.Next());
+    } else {
+      (*collector)[end_pos].AddChunk({table, a, cr});
     }
   }
 }
@@ -228,6 +316,14 @@ static void lookup_table(Table* table,
 an<DictEntryCollector> Dictionary::Lookup(const SyllableGraph& syllable_graph,
                                           size_t start_pos,
                                           double initial_credibility) {
+  return Lookup(CompactSyllableGraph(syllable_graph), start_pos,
+                initial_credibility);
+}
+
+an<DictEntryCollector> Dictionary::Lookup(
+    const CompactSyllableGraph& syllable_graph,
+    size_t start_pos,
+    double initial_credibility) {
   if (!loaded())
     return nullptr;
   auto collector = New<DictEntryCollector>();
@@ -235,7 +331,7 @@ an<DictEntryCollector> Dictionary::Lookup(const SyllableGraph& syllable_graph,
     if (!table->IsOpen())
       continue;
     lookup_table(table.get(), collector.get(), syllable_graph, start_pos,
-                 initial_credibility);
+                 initial_credibility, &table_query_buffer_);
   }
   if (collector->empty())
     return nullptr;
@@ -263,8 +359,28 @@ size_t Dictionary::LookupWords(DictEntryIterator* result,
     }
   }
   DLOG(INFO) << "found " << keys.size() << " matching keys thru the prism.";
-  size_t code_length(str_code.length());
-  for (auto& match : keys) {
+  LookupKeys(result, keys, str_code.length());
+  return keys.size();
+}
+
+size_t Dictionary::LookupWords(DictEntryIterator* result,
+                               const string& str_code,
+                               ExpandSearchCursor* cursor,
+                               size_t limit) {
+  DLOG(INFO) << "lookup: " << str_code << ", resumed at " << cursor->count;
+  if (!loaded())
+    return 0;
+  vector<Prism::Match> keys;
+  prism_->ExpandSearch(str_code, cursor, &keys, limit);
+  DLOG(INFO) << "found " << keys.size() << " more keys thru the prism.";
+  LookupKeys(result, keys, str_code.length());
+  return cursor->count;
+}
+
+void Dictionary::LookupKeys(DictEntryIterator* result,
+                            const vector<Prism::Match>& keys,
+                            size_t code_length) {
+  for (const auto& match : keys) {
     SpellingAccessor accessor(prism_->QuerySpelling(match.value));
     while (!accessor.exhausted()) {
       SyllableId syllable_id = accessor.syllable_id();
@@ -289,7 +405,111 @@ size_t Dictionary::LookupWords(DictEntryIterator* result,
       }
     }
   }
-  return keys.size();
+}
+
+namespace dictionary {
+
+// by the order of chunks in a predictive lookup, where a chunk added earlier
+// wins a tie
+bool completion_less(const table::CompletionEntry& a,
+                     size_t a_table_index,
+                     const table::CompletionEntry& b,
+                     size_t b_table_index) {
+  if (a.code_length != b.code_length)
+    return a.code_length < b.code_length;
+  if (a.entry.weight != b.entry.weight)
+    return a.entry.weight > b.entry.weight;
+  if (a.syllable_id != b.syllable_id)
+    return a.syllable_id < b.syllable_id;
+  return a_table_index < b_table_index;
+}
+
+}  // namespace dictionary
+
+size_t Dictionary::LookupCompletions(DictEntryIterator* result,
+                                     const string& str_code,
+                                     size_t start,
+                                     size_t limit,
+                                     bool* complete) {
+  if (!loaded() || !IsPrismVerbatim())
+    return 0;
+  // the words of each table in order, to be merged
+  vector<pair<size_t, const table::CompletionNode*>> nodes;
+  size_t max_entries = 0;
+  size_t num_entries = 0;
+  for (size_t i = 0; i < tables_.size(); ++i) {
+    const auto& table = tables_[i];
+    if (!table->IsOpen())
+      continue;
+    // the index stands for a lookup only if that yields the best words first
+    if (!table->entries_sorted_by_weight())
+      return 0;
+    auto node = table->QueryCompletions(str_code);
+    if (!node)
+      return 0;
+    size_t table_max_entries = table->completion_index()->max_entries;
+    if (max_entries == 0 || table_max_entries < max_entries)
+      max_entries = table_max_entries;
+    nodes.push_back({i, node});
+    num_entries += node->entries.size;
+  }
+  // words beyond the least number indexed could rank below missing ones
+  if (complete)
+    *complete = num_entries < max_entries;
+  num_entries = (std::min)(num_entries, max_entries);
+  size_t end = limit ? (std::min)(start + limit, num_entries) : num_entries;
+  vector<size_t> cursors(nodes.size(), 0);
+  for (size_t k = 0; k < end; ++k) {
+    size_t best = 0;
+    const table::CompletionEntry* best_entry = nullptr;
+    for (size_t j = 0; j < nodes.size(); ++j) {
+      const auto& entries = nodes[j].second->entries;
+      if (cursors[j] >= entries.size)
+        continue;
+      const auto* head = &entries.at[cursors[j]];
+      if (!best_entry || dictionary::completion_less(*head, nodes[j].first,
+                                                     *best_entry,
+                                                     nodes[best].first)) {
+        best = j;
+        best_entry = head;
+      }
+    }
+    ++cursors[best];
+    if (k < start)
+      continue;
+    const auto& e = *best_entry;
+    Code code;
+    code.push_back(e.syllable_id);
+    dictionary::Chunk chunk(tables_[nodes[best].first].get(), code, &e.entry);
+    if (e.code_length > str_code.length()) {
+      chunk.remaining_code =
+          primary_table()->GetSyllableById(e.syllable_id).substr(
+              str_code.length());
+    }
+    result->AddChunk(std::move(chunk));
+  }
+  return num_entries;
+}
+
+bool Dictionary::IsPrismVerbatim() {
+  if (prism_verbatim_ < 0) {
+    const auto& table = primary_table();
+    auto num_syllables =
+        static_cast<SyllableId>(table->metadata()->num_syllables);
+    bool verbatim =
+        static_cast<SyllableId>(prism_->num_spellings()) == num_syllables;
+    for (SyllableId i = 0; verbatim && i < num_syllables; ++i) {
+      int spelling_id = -1;
+      SpellingAccessor accessor(prism_->QuerySpelling(i));
+      verbatim = prism_->GetValue(table->GetSyllableById(i), &spelling_id) &&
+                 spelling_id == i && accessor.syllable_id() == i &&
+                 accessor.properties().type == kNormalSpelling &&
+                 accessor.Next();
+    }
+    DLOG(INFO) << "prism verbatim: " << verbatim;
+    prism_verbatim_ = verbatim ? 1 : 0;
+  }
+  return prism_verbatim_ == 1;
 }
 
 bool Dictionary::Decode(const Code& code, vector<string>* result) {
@@ -313,6 +533,7 @@ bool Dictionary::Exists() const {
 bool Dictionary::Remove() {
   if (loaded())
     return false;
+  CancelWarmup();
   prism_->Remove();
   for (const auto& table : tables_) {
     table->Remove();
@@ -328,6 +549,12 @@ bool Dictionary::Load() {
     return false;
   }
   auto& primary_table = tables_[0];
+  for (const auto& table : tables_) {
+    if (table && !table->IsOpen())
+      table->set_load_policy(load_policy_);
+  }
+  if (prism_ && !prism_->IsOpen())
+    prism_->set_load_policy(load_policy_);
   if (!primary_table || (!primary_table->IsOpen() && !primary_table->Load())) {
     LOG(ERROR) << "Error loading table for dictionary '" << name_ << "'.";
     return false;
@@ -336,6 +563,7 @@ bool Dictionary::Load() {
     LOG(ERROR) << "Error loading prism for dictionary '" << name_ << "'.";
     return false;
   }
+  prism_verbatim_ = -1;
   // packs are optional
   for (int i = 1; i < tables_.size(); ++i) {
     const auto& table = tables_[i];
@@ -343,9 +571,51 @@ bool Dictionary::Load() {
       LOG(INFO) << "loaded pack: " << packs_[i - 1];
     }
   }
+  if (warmup_on_load_)
+    Warmup();
   return true;
 }
 
+void Dictionary::Warmup() {
+  if (!loaded() || warmup_.valid())
+    return;
+  auto name = name_;
+  auto tables = tables_;
+  auto prism = prism_;
+  // the flag outlives the task, which is joined on destruction
+  const std::atomic<bool>* cancel = &warmup_cancelled_;
+  warmup_cancelled_ = false;
+  auto task = [name, tables, prism, cancel] {
+    size_t num_pages = prism->Warmup(cancel);
+    for (const auto& table : tables) {
+      if (table->IsOpen())
+        num_pages += table->Warmup(cancel);
+    }
+    LOG(INFO) << "warmed up dictionary '" << name << "', " << num_pages
+              << " pages touched.";
+    return num_pages;
+  };
+#ifdef RIME_NO_THREADING
+  std::promise<size_t> result;
+  result.set_value(task());
+  warmup_ = result.get_future();
+#else
+  warmup_ = std::async(std::launch::async, task);
+#endif
+}
+
+size_t Dictionary::FinishWarmup() {
+  return warmup_.valid() ? warmup_.get() : 0;
+}
+
+void Dictionary::CancelWarmup() {
+  if (!warmup_.valid())
+    return;
+  warmup_cancelled_ = true;
+  warmup_.wait();
+  warmup_ = std::future<size_t>();
+}
+
 bool Dictionary::loaded() const {
   return !tables_.empty() && tables_[0]->IsOpen() && prism_ && prism_->IsOpen();
 }
@@ -391,7 +661,23 @@ Dictionary* DictionaryComponent::Create(const Ticket& ticket) {
       }
     }
   }
-  return Create(std::move(dict_name), std::move(prism_name), std::move(packs));
+  auto dictionary =
+      Create(std::move(dict_name), std::move(prism_name), std::move(packs));
+  string load_policy;
+  if (config->GetString(ticket.name_space + "/dictionary_load_policy",
+                        &load_policy)) {
+    MappedFileLoadPolicy policy;
+    if (ParseMappedFileLoadPolicy(load_policy, &policy)) {
+      dictionary->set_load_policy(policy);
+    } else {
+      LOG(WARNING) << "unknown dictionary load policy: " << load_policy;
+    }
+  }
+  bool warmup = false;
+  if (config->GetBool(ticket.name_space + "/dictionary_warmup", &warmup)) {
+    dictionary->set_warmup_on_load(warmup);
+  }
+  return dictionary;
 }
 
 Dictionary* DictionaryComponent::Create(string dict_name,
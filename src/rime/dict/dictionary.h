@@ -7,6 +7,8 @@
 #ifndef RIME_DICTIONARY_H_
 #define RIME_DICTIONARY_H_
 
+#include <atomic>
+#include <future>
 #include <rime_api.h>
 #include <rime/common.h>
 #include <rime/component.h>
@@ -34,8 +36,13 @@ class RIME_API DictEntryIterator : public DictEntryFilterBinder {
 
   void AddChunk(dictionary::Chunk&& chunk);
   void Sort();
+  using DictEntryFilterBinder::AddFilter;
   void AddFilter(DictEntryFilter filter) override;
   an<DictEntry> Peek();
+  // the entry at the cursor in place, without making a DictEntry of it.
+  // the text is decoded into a buffer of the iterator, so the view is valid
+  // until the iterator moves on or is peeked again.
+  DictEntryView PeekView();
   bool Next();
   bool Skip(size_t num_entries);
   bool exhausted() const;
@@ -49,6 +56,9 @@ class RIME_API DictEntryIterator : public DictEntryFilterBinder {
   size_t chunk_index_ = 0;
   an<DictEntry> entry_ = nullptr;
   size_t entry_count_ = 0;
+  // the text of the entry last viewed, decoded once for repeated views
+  string text_;
+  const table::Entry* text_entry_ = nullptr;
 };
 
 using DictEntryCollector = map<size_t, DictEntryIterator>;
@@ -56,6 +66,7 @@ using DictEntryCollector = map<size_t, DictEntryIterator>;
 class Config;
 class Schema;
 class EditDistanceCorrector;
+struct CompactSyllableGraph;
 struct SyllableGraph;
 struct Ticket;
 
@@ -70,7 +81,20 @@ class Dictionary : public Class<Dictionary, const Ticket&> {
   bool Exists() const;
   RIME_API bool Remove();
   RIME_API bool Load();
-
+  // faults in the pages of the prism and the table indices ahead of the first
+  // lookups, in the background unless threading is disabled
+  RIME_API void Warmup();
+  // waits for the warmup to finish.
+  // return num of pages touched.
+  RIME_API size_t FinishWarmup();
+  // stops the warmup in the background and waits for it to return.
+  RIME_API void CancelWarmup();
+
+  RIME_API an<DictEntryCollector> Lookup(
+      const CompactSyllableGraph& syllable_graph,
+      size_t start_pos,
+      double initial_credibility = 0.0);
+  // same as above, converting the graph from nested maps
   RIME_API an<DictEntryCollector> Lookup(const SyllableGraph& syllable_graph,
                                          size_t start_pos,
                                          double initial_credibility = 0.0);
@@ -81,6 +105,24 @@ class Dictionary : public Class<Dictionary, const Ticket&> {
                               const string& str_code,
                               bool predictive,
                               size_t limit = 0);
+  // continues a predictive lookup from where the cursor stopped, adding only
+  // the entries of newly found keys to result.
+  // return num of matching keys found in total.
+  RIME_API size_t LookupWords(DictEntryIterator* result,
+                              const string& str_code,
+                              ExpandSearchCursor* cursor,
+                              size_t limit);
+  // look up the best words completing the code from the completion indices
+  // of the tables, which a predictive lookup yields first, in the same order.
+  // add those ranked from start on to result, at most limit if non-zero.
+  // return num of words indexed for the code, 0 if not all tables index it
+  // or the entries of a table are not sorted by weight.
+  // *complete tells whether they are all the words completing the code.
+  RIME_API size_t LookupCompletions(DictEntryIterator* result,
+                                    const string& str_code,
+                                    size_t start = 0,
+                                    size_t limit = 0,
+                                    bool* complete = nullptr);
   // translate syllable id sequence to string code
   RIME_API bool Decode(const Code& code, vector<string>* result);
 
@@ -92,11 +134,31 @@ class Dictionary : public Class<Dictionary, const Ticket&> {
   const an<Table>& primary_table() const { return tables_[0]; }
   const an<Prism>& prism() const { return prism_; }
 
+  // applies to the files opened by the next Load()
+  void set_load_policy(MappedFileLoadPolicy policy) { load_policy_ = policy; }
+  // whether Load() starts a warmup
+  void set_warmup_on_load(bool warmup) { warmup_on_load_ = warmup; }
+
  private:
+  void LookupKeys(DictEntryIterator* result,
+                  const vector<Prism::Match>& keys,
+                  size_t code_length);
+  bool IsPrismVerbatim();
+
   string name_;
   vector<string> packs_;
   vector<of<Table>> tables_;
   an<Prism> prism_;
+  // reused by lookups in the tables
+  TableQueryBuffer table_query_buffer_;
+  // whether spellings in the prism are the syllables of the tables as is,
+  // -1 if not checked yet
+  int prism_verbatim_ = -1;
+  MappedFileLoadPolicy load_policy_ = MappedFileLoadPolicy::kDefault;
+  bool warmup_on_load_ = false;
+  std::future<size_t> warmup_;
+  // checked by the warmup at every page
+  std::atomic<bool> warmup_cancelled_{false};
 };
 
 class ResourceResolver;
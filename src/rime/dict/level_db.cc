@@ -5,10 +5,14 @@
 // 2014-12-04 Chen Gong <chen.sst@gmail.com>
 //
 
+#include <mutex>
 #include <boost/filesystem.hpp>
+#include <leveldb/cache.h>
 #include <leveldb/db.h>
+#include <leveldb/filter_policy.h>
 #include <leveldb/write_batch.h>
 #include <rime/common.h>
+#include <rime/config.h>
 #include <rime/service.h>
 #include <rime/dict/level_db.h>
 #include <rime/dict/user_db.h>
@@ -17,14 +21,20 @@ namespace rime {
 
 static const char* kMetaCharacter = "\x01";
 
+static const size_t kMaxIdleIterators = 8;
+
 struct LevelDbCursor {
+  // the db may be closed and reopened, with a new wrapper, while an accessor
+  // is held; closing deletes the iterator and leaves the cursor exhausted
+  weak<LevelDbWrapper> db;
   leveldb::Iterator* iterator = nullptr;
+  // generation of the snapshot the iterator reads from
+  size_t generation = 0;
 
-  LevelDbCursor(leveldb::DB* db) {
-    leveldb::ReadOptions options;
-    options.fill_cache = false;
-    iterator = db->NewIterator(options);
-  }
+  LevelDbCursor(const an<LevelDbWrapper>& db,
+                leveldb::Iterator* iterator,
+                size_t generation)
+      : db(db), iterator(iterator), generation(generation) {}
 
   bool IsValid() const { return iterator && iterator->Valid(); }
 
@@ -42,28 +52,132 @@ struct LevelDbCursor {
     return true;
   }
 
-  void Release() {
-    delete iterator;
-    iterator = nullptr;
-  }
+  // returns the iterator to the pool of the db
+  void Release();
 };
 
-struct LevelDbWrapper {
+struct LevelDbWrapper : std::enable_shared_from_this<LevelDbWrapper> {
   leveldb::DB* ptr = nullptr;
+  leveldb::Cache* block_cache = nullptr;
+  const leveldb::FilterPolicy* filter_policy = nullptr;
+  bool fill_cache = false;
   leveldb::WriteBatch batch;
-
-  leveldb::Status Open(const string& file_name, bool readonly) {
+  // queries share iterators over a snapshot, which is renewed only after
+  // the db has been written to.
+  // the db may be shared by sessions on different threads; the mutex guards
+  // the snapshot and the iterators in and out of the pool.
+  std::mutex mutex;
+  const leveldb::Snapshot* snapshot = nullptr;
+  size_t generation = 0;
+  bool modified = false;
+  vector<leveldb::Iterator*> idle_iterators;
+  // cursors holding an iterator, which must be deleted before the db
+  set<LevelDbCursor*> active_cursors;
+  size_t num_iterators_created = 0;
+
+  ~LevelDbWrapper() { Release(); }
+
+  leveldb::Status Open(const string& file_name,
+                       bool readonly,
+                       const LevelDbOptions& db_options) {
     leveldb::Options options;
     options.create_if_missing = !readonly;
+    if (db_options.block_cache_size > 0) {
+      block_cache = leveldb::NewLRUCache(db_options.block_cache_size);
+      options.block_cache = block_cache;
+    }
+    if (db_options.bloom_filter_bits > 0) {
+      filter_policy =
+          leveldb::NewBloomFilterPolicy(db_options.bloom_filter_bits);
+      options.filter_policy = filter_policy;
+    }
+    if (db_options.block_size > 0) {
+      options.block_size = db_options.block_size;
+    }
+    if (!db_options.compression) {
+      options.compression = leveldb::kNoCompression;
+    }
+    fill_cache = db_options.fill_cache;
     return leveldb::DB::Open(options, file_name, &ptr);
   }
 
   void Release() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto* cursor : active_cursors) {
+      delete cursor->iterator;
+      cursor->iterator = nullptr;
+    }
+    active_cursors.clear();
+    ClearIdleIterators();
+    if (snapshot) {
+      ptr->ReleaseSnapshot(snapshot);
+      snapshot = nullptr;
+    }
+    // the cache and the filter policy must outlive the db
     delete ptr;
     ptr = nullptr;
+    delete block_cache;
+    block_cache = nullptr;
+    delete filter_policy;
+    filter_policy = nullptr;
   }
 
-  LevelDbCursor* CreateCursor() { return new LevelDbCursor(ptr); }
+  void ClearIdleIterators() {
+    for (auto* iterator : idle_iterators) {
+      delete iterator;
+    }
+    idle_iterators.clear();
+  }
+
+  void RenewSnapshot() {
+    ClearIdleIterators();
+    if (snapshot) {
+      ptr->ReleaseSnapshot(snapshot);
+    }
+    snapshot = ptr->GetSnapshot();
+    ++generation;
+    modified = false;
+  }
+
+  LevelDbCursor* CreateCursor() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!snapshot || modified) {
+      RenewSnapshot();
+    }
+    leveldb::Iterator* iterator = nullptr;
+    if (!idle_iterators.empty()) {
+      iterator = idle_iterators.back();
+      idle_iterators.pop_back();
+    } else {
+      leveldb::ReadOptions options;
+      options.fill_cache = fill_cache;
+      options.snapshot = snapshot;
+      iterator = ptr->NewIterator(options);
+      ++num_iterators_created;
+    }
+    auto cursor = new LevelDbCursor(shared_from_this(), iterator, generation);
+    active_cursors.insert(cursor);
+    return cursor;
+  }
+
+  void Recycle(LevelDbCursor* cursor) {
+    std::lock_guard<std::mutex> lock(mutex);
+    active_cursors.erase(cursor);
+    if (!cursor->iterator)
+      return;
+    if (ptr && cursor->generation == generation && !modified &&
+        idle_iterators.size() < kMaxIdleIterators) {
+      idle_iterators.push_back(cursor->iterator);
+    } else {
+      delete cursor->iterator;
+    }
+    cursor->iterator = nullptr;
+  }
+
+  void SetModified() {
+    std::lock_guard<std::mutex> lock(mutex);
+    modified = true;
+  }
 
   bool Fetch(const string& key, string* value) {
     auto status = ptr->Get(leveldb::ReadOptions(), key, value);
@@ -76,6 +190,8 @@ struct LevelDbWrapper {
       return true;
     }
     auto status = ptr->Put(leveldb::WriteOptions(), key, value);
+    // after the write, so that no snapshot taken before it is reused
+    SetModified();
     return status.ok();
   }
 
@@ -85,6 +201,7 @@ struct LevelDbWrapper {
       return true;
     }
     auto status = ptr->Delete(leveldb::WriteOptions(), key);
+    SetModified();
     return status.ok();
   }
 
@@ -92,10 +209,36 @@ struct LevelDbWrapper {
 
   bool CommitBatch() {
     auto status = ptr->Write(leveldb::WriteOptions(), &batch);
+    SetModified();
     return status.ok();
   }
 };
 
+void LevelDbCursor::Release() {
+  // an iterator outliving its wrapper was deleted when the db was closed
+  if (auto wrapper = db.lock()) {
+    wrapper->Recycle(this);
+  }
+  iterator = nullptr;
+}
+
+// LevelDbOptions members
+
+void LevelDbOptions::Load(Config* config, const string& path) {
+  if (!config)
+    return;
+  int size = 0;
+  if (config->GetInt(path + "/block_cache_size", &size) && size >= 0) {
+    block_cache_size = size;
+  }
+  config->GetInt(path + "/bloom_filter_bits", &bloom_filter_bits);
+  if (config->GetInt(path + "/block_size", &size) && size >= 0) {
+    block_size = size;
+  }
+  config->GetBool(path + "/compression", &compression);
+  config->GetBool(path + "/fill_cache", &fill_cache);
+}
+
 // LevelDbAccessor members
 
 LevelDbAccessor::LevelDbAccessor() {}
@@ -108,7 +251,8 @@ LevelDbAccessor::LevelDbAccessor(LevelDbCursor* cursor, const string& prefix)
 }
 
 LevelDbAccessor::~LevelDbAccessor() {
-  cursor_->Release();
+  if (cursor_)
+    cursor_->Release();
 }
 
 bool LevelDbAccessor::Reset() {
@@ -151,7 +295,7 @@ LevelDb::~LevelDb() {
 }
 
 void LevelDb::Initialize() {
-  db_.reset(new LevelDbWrapper);
+  db_ = New<LevelDbWrapper>();
 }
 
 an<DbAccessor> LevelDb::QueryMetadata() {
@@ -191,6 +335,29 @@ bool LevelDb::Erase(const string& key) {
   return db_->Erase(key, in_transaction());
 }
 
+bool LevelDb::GetProperty(const string& name, string* value) {
+  if (!value || !loaded())
+    return false;
+  return db_->ptr->GetProperty(name, value);
+}
+
+size_t LevelDb::num_iterators_created() const {
+  if (!db_)
+    return 0;
+  std::lock_guard<std::mutex> lock(db_->mutex);
+  return db_->num_iterators_created;
+}
+
+uint64_t LevelDb::GetApproximateSize(const string& start,
+                                     const string& limit) {
+  if (!loaded())
+    return 0;
+  leveldb::Range range(start, limit);
+  uint64_t size = 0;
+  db_->ptr->GetApproximateSizes(&range, 1, &size);
+  return size;
+}
+
 bool LevelDb::Backup(const string& snapshot_file) {
   if (!loaded())
     return false;
@@ -218,7 +385,15 @@ bool LevelDb::Restore(const string& snapshot_file) {
 
 bool LevelDb::Recover() {
   LOG(INFO) << "trying to recover db '" << name() << "'.";
-  auto status = leveldb::RepairDB(file_name(), leveldb::Options());
+  leveldb::Options options;
+  // rebuilt tables get the same filter as the ones written normally
+  the<const leveldb::FilterPolicy> filter_policy;
+  if (options_.bloom_filter_bits > 0) {
+    filter_policy.reset(
+        leveldb::NewBloomFilterPolicy(options_.bloom_filter_bits));
+    options.filter_policy = filter_policy.get();
+  }
+  auto status = leveldb::RepairDB(file_name(), options);
   if (status.ok()) {
     LOG(INFO) << "repair finished.";
     return true;
@@ -245,7 +420,7 @@ bool LevelDb::Open() {
     return false;
   Initialize();
   readonly_ = false;
-  auto status = db_->Open(file_name(), readonly_);
+  auto status = db_->Open(file_name(), readonly_, options_);
   loaded_ = status.ok();
 
   if (loaded_) {
@@ -267,7 +442,7 @@ bool LevelDb::OpenReadOnly() {
     return false;
   Initialize();
   readonly_ = true;
-  auto status = db_->Open(file_name(), readonly_);
+  auto status = db_->Open(file_name(), readonly_, options_);
   loaded_ = status.ok();
 
   if (!loaded_) {
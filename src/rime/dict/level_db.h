@@ -14,8 +14,25 @@ namespace rime {
 struct LevelDbCursor;
 struct LevelDbWrapper;
 
+class Config;
 class LevelDb;
 
+// tuning of the storage and the read path; zero values keep LevelDB defaults
+struct LevelDbOptions {
+  // capacity of the LRU cache of uncompressed blocks, in bytes
+  size_t block_cache_size = 0;
+  // bits per key of the bloom filter; 0 disables the filter
+  int bloom_filter_bits = 0;
+  // approximate size of user data packed per block, in bytes
+  size_t block_size = 0;
+  bool compression = true;
+  // whether blocks read by prefix scans are kept in the block cache
+  bool fill_cache = false;
+
+  // overrides the options with settings found under the given config path
+  void Load(Config* config, const string& path);
+};
+
 class LevelDbAccessor : public DbAccessor {
  public:
   LevelDbAccessor();
@@ -58,6 +75,10 @@ class LevelDb : public Db, public Recoverable, public Transactional {
   virtual bool Update(const string& key, const string& value);
   virtual bool Erase(const string& key);
 
+  virtual bool GetProperty(const string& name, string* value);
+  // estimated size on disk of the records with keys in [start, limit)
+  uint64_t GetApproximateSize(const string& start, const string& limit);
+
   // Recoverable
   virtual bool Recover();
 
@@ -66,11 +87,19 @@ class LevelDb : public Db, public Recoverable, public Transactional {
   virtual bool AbortTransaction();
   virtual bool CommitTransaction();
 
+  const LevelDbOptions& options() const { return options_; }
+  // takes effect the next time the db is opened
+  void set_options(const LevelDbOptions& options) { options_ = options; }
+  // iterators created since the db was opened; idle ones are reused
+  size_t num_iterators_created() const;
+
  private:
   void Initialize();
 
-  the<LevelDbWrapper> db_;
+  // shared with the cursors of accessors in use
+  an<LevelDbWrapper> db_;
   string db_type_;
+  LevelDbOptions options_;
 };
 
 }  // namespace rime
@@ -0,0 +1,808 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <boost/filesystem.hpp>
+#include <rime/common.h>
+#include <rime/dict/mapped_db.h>
+#include <rime/dict/user_db.h>
+
+namespace rime {
+
+static const char* kMetaCharacter = "\x01";
+
+const char kSortedRunFormat[] = "Rime::SortedRun/1.0";
+
+const char kSortedRunFormatPrefix[] = "Rime::SortedRun/";
+const size_t kSortedRunFormatPrefixLen = sizeof(kSortedRunFormatPrefix) - 1;
+
+// the log is folded into a new run once it holds as many keys as this,
+// or a quarter of the run if that is more.
+static const size_t kCompactionThreshold = 1024;
+
+static inline int compare(const char* a,
+                          size_t a_size,
+                          const char* b,
+                          size_t b_size) {
+  size_t size = (std::min)(a_size, b_size);
+  int result = size ? std::memcmp(a, b, size) : 0;
+  if (result != 0)
+    return result;
+  return a_size < b_size ? -1 : a_size > b_size ? 1 : 0;
+}
+
+static inline const char* blob_data(const mapped_db::Blob& blob) {
+  return blob.data ? blob.data.get() : "";
+}
+
+// SortedRun members
+
+SortedRun::~SortedRun() {
+  if (remove_on_release_) {
+    // fails if the file is still mapped by another process, in which case
+    // it is cleaned up on next opening the db
+    Remove();
+  }
+}
+
+bool SortedRun::Load() {
+  LOG(INFO) << "loading sorted run: " << file_name();
+
+  if (IsOpen())
+    Close();
+
+  if (!OpenReadOnly()) {
+    LOG(ERROR) << "error opening sorted run '" << file_name() << "'.";
+    return false;
+  }
+
+  metadata_ = Find<mapped_db::Metadata>(0);
+  if (!metadata_ || file_size() < sizeof(mapped_db::Metadata)) {
+    LOG(ERROR) << "metadata not found.";
+    Close();
+    return false;
+  }
+  if (strncmp(metadata_->format, kSortedRunFormatPrefix,
+              kSortedRunFormatPrefixLen)) {
+    LOG(ERROR) << "invalid metadata.";
+    Close();
+    return false;
+  }
+  records_ = metadata_->records.get();
+  if (!records_ || records_->size != metadata_->num_records) {
+    LOG(ERROR) << "records not found.";
+    Close();
+    return false;
+  }
+  return true;
+}
+
+bool SortedRun::Build(const Records& records) {
+  size_t num_bytes = 0;
+  for (const auto& record : records) {
+    num_bytes += record.first.length() + record.second.length();
+  }
+  const size_t kReservedSize = 64;
+  size_t file_size = kReservedSize + sizeof(mapped_db::Metadata) +
+                     sizeof(Array<mapped_db::Record>) +
+                     sizeof(mapped_db::Record) * records.size() + num_bytes;
+  if (!Create(file_size)) {
+    LOG(ERROR) << "Error creating sorted run '" << file_name() << "'.";
+    return false;
+  }
+  // the capacity is enough for all allocations, which never move the mapping
+  metadata_ = Allocate<mapped_db::Metadata>();
+  records_ = CreateArray<mapped_db::Record>(records.size());
+  if (!metadata_ || !records_) {
+    LOG(ERROR) << "Error creating metadata in file '" << file_name() << "'.";
+    return false;
+  }
+  auto copy = [this](const string& src, mapped_db::Blob* dest) {
+    dest->size = static_cast<uint32_t>(src.length());
+    if (src.empty())
+      return true;
+    char* ptr = Allocate<char>(src.length());
+    if (!ptr)
+      return false;
+    std::memcpy(ptr, src.data(), src.length());
+    dest->data = ptr;
+    return true;
+  };
+  auto* dest = records_->begin();
+  for (const auto& record : records) {
+    if (!copy(record.first, &dest->key) || !copy(record.second, &dest->value)) {
+      LOG(ERROR) << "Error creating record in file '" << file_name() << "'.";
+      return false;
+    }
+    ++dest;
+  }
+  metadata_->num_records = static_cast<uint32_t>(records.size());
+  metadata_->records = records_;
+  std::strncpy(metadata_->format, kSortedRunFormat,
+               mapped_db::Metadata::kFormatMaxLength);
+  bool success = ShrinkToFit();
+  metadata_ = nullptr;
+  records_ = nullptr;
+  return success;
+}
+
+const mapped_db::Record* SortedRun::begin() const {
+  return records_ ? records_->begin() : nullptr;
+}
+
+const mapped_db::Record* SortedRun::end() const {
+  return records_ ? records_->end() : nullptr;
+}
+
+const mapped_db::Record* SortedRun::LowerBound(const string& key) const {
+  auto less = [](const mapped_db::Record& record, const string& key) {
+    return compare(blob_data(record.key), record.key.size, key.data(),
+                   key.length()) < 0;
+  };
+  return std::lower_bound(begin(), end(), key, less);
+}
+
+// MappedDbAccessor members
+
+MappedDbAccessor::MappedDbAccessor(const an<SortedRun>& run,
+                                   const vector<an<MappedDbUpdates>>& updates,
+                                   const string& prefix)
+    : DbAccessor(prefix),
+      run_(run),
+      updates_(updates),
+      update_iters_(updates.size()),
+      is_metadata_query_(prefix == kMetaCharacter) {
+  Reset();
+}
+
+MappedDbAccessor::~MappedDbAccessor() {}
+
+bool MappedDbAccessor::Reset() {
+  return Jump(prefix_);
+}
+
+bool MappedDbAccessor::Jump(const string& key) {
+  run_iter_ = run_->LowerBound(key);
+  for (size_t i = 0; i < updates_.size(); ++i) {
+    update_iters_[i] = updates_[i]->lower_bound(key);
+  }
+  FindNextRecord();
+  return key_ != nullptr;
+}
+
+// settles on the least key among the sources, where the newest source holding
+// the key has its value; erased keys are skipped.
+void MappedDbAccessor::FindNextRecord() {
+  while (true) {
+    key_ = nullptr;
+    if (run_iter_ != run_->end()) {
+      key_ = blob_data(run_iter_->key);
+      key_size_ = run_iter_->key.size;
+      source_ = -1;
+    }
+    for (size_t i = 0; i < updates_.size(); ++i) {
+      if (update_iters_[i] == updates_[i]->end())
+        continue;
+      const string& key = update_iters_[i]->first;
+      if (!key_ || compare(key.data(), key.length(), key_, key_size_) <= 0) {
+        key_ = key.data();
+        key_size_ = key.length();
+        source_ = static_cast<int>(i);
+      }
+    }
+    if (!key_ || source_ < 0 || !update_iters_[source_]->second.erased)
+      return;
+    Skip();
+  }
+}
+
+// moves every source past the key at the cursor
+void MappedDbAccessor::Skip() {
+  const char* key = key_;
+  size_t key_size = key_size_;
+  if (run_iter_ != run_->end() &&
+      compare(blob_data(run_iter_->key), run_iter_->key.size, key, key_size) ==
+          0) {
+    ++run_iter_;
+  }
+  for (size_t i = 0; i < updates_.size(); ++i) {
+    auto& it = update_iters_[i];
+    if (it != updates_[i]->end() &&
+        compare(it->first.data(), it->first.length(), key, key_size) == 0) {
+      ++it;
+    }
+  }
+}
+
+bool MappedDbAccessor::GetNextRecord(string* key, string* value) {
+  if (!key || !value || exhausted())
+    return false;
+  key->assign(key_, key_size_);
+  if (is_metadata_query_) {
+    key->erase(0, 1);  // remove meta character
+  }
+  if (source_ < 0) {
+    value->assign(blob_data(run_iter_->value), run_iter_->value.size);
+  } else {
+    *value = update_iters_[source_]->second.value;
+  }
+  Skip();
+  FindNextRecord();
+  return true;
+}
+
+bool MappedDbAccessor::exhausted() {
+  return !key_ || key_size_ < prefix_.length() ||
+         compare(key_, prefix_.length(), prefix_.data(), prefix_.length()) != 0;
+}
+
+// MappedDb members
+
+static bool BuildRun(const string& file_name,
+                     const an<SortedRun>& run,
+                     const an<MappedDbUpdates>& updates) {
+  try {
+    // left behind by a failed compaction
+    boost::system::error_code ec;
+    boost::filesystem::remove(file_name, ec);
+    SortedRun::Records records;
+    records.reserve(run->size() + updates->size());
+    MappedDbAccessor accessor(run, {updates}, "");
+    string key, value;
+    while (accessor.GetNextRecord(&key, &value)) {
+      records.emplace_back(key, value);
+    }
+    SortedRun compacted(file_name);
+    return compacted.Build(records);
+  } catch (std::exception& ex) {
+    LOG(ERROR) << "Error building sorted run '" << file_name
+               << "': " << ex.what();
+    return false;
+  }
+}
+
+MappedDb::MappedDb(const string& file_name,
+                   const string& db_name,
+                   const string& db_type)
+    : Db(file_name, db_name), db_type_(db_type) {}
+
+MappedDb::~MappedDb() {
+  if (loaded())
+    Close();
+}
+
+size_t MappedDb::num_records() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return run_ ? run_->size() : 0;
+}
+
+size_t MappedDb::num_updates() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return CountUpdates();
+}
+
+size_t MappedDb::CountUpdates() const {
+  return (updates_ ? updates_->size() : 0) +
+         (frozen_updates_ ? frozen_updates_->size() : 0);
+}
+
+an<DbAccessor> MappedDb::QueryMetadata() {
+  return Query(kMetaCharacter);
+}
+
+an<DbAccessor> MappedDb::QueryAll() {
+  an<DbAccessor> all = Query("");
+  if (all)
+    all->Jump(" ");  // skip metadata
+  return all;
+}
+
+an<DbAccessor> MappedDb::Query(const string& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!loaded())
+    return nullptr;
+  vector<an<MappedDbUpdates>> updates;
+  if (frozen_updates_)
+    updates.push_back(frozen_updates_);
+  updates.push_back(updates_);
+  return New<MappedDbAccessor>(run_, updates, key);
+}
+
+bool MappedDb::Fetch(const string& key, string* value) {
+  if (!value)
+    return false;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!loaded())
+    return false;
+  for (const auto* updates : {updates_.get(), frozen_updates_.get()}) {
+    if (!updates)
+      continue;
+    auto it = updates->find(key);
+    if (it != updates->end()) {
+      if (it->second.erased)
+        return false;
+      *value = it->second.value;
+      return true;
+    }
+  }
+  auto record = run_->LowerBound(key);
+  if (record == run_->end() ||
+      compare(blob_data(record->key), record->key.size, key.data(),
+              key.length()) != 0) {
+    return false;
+  }
+  value->assign(blob_data(record->value), record->value.size);
+  return true;
+}
+
+bool MappedDb::Update(const string& key, const string& value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!loaded() || readonly())
+    return false;
+  DLOG(INFO) << "update db entry: " << key << " => " << value;
+  MappedDbUpdate update;
+  update.value = value;
+  if (in_transaction()) {
+    batch_.emplace_back(key, update);
+    return true;
+  }
+  return Write({{key, update}});
+}
+
+bool MappedDb::Erase(const string& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!loaded() || readonly())
+    return false;
+  DLOG(INFO) << "erase db entry: " << key;
+  MappedDbUpdate update;
+  update.erased = true;
+  if (in_transaction()) {
+    batch_.emplace_back(key, update);
+    return true;
+  }
+  return Write({{key, update}});
+}
+
+// a log entry is laid out as:
+// op (1 byte) | key size (uint32) | value size (uint32) | key | value
+// where sizes are stored in little-endian byte order.
+static const char kLogPut = '+';
+static const char kLogErase = '-';
+static const size_t kLogHeaderSize = 1 + 4 + 4;
+
+static inline void put_uint32(string* buffer, uint32_t x) {
+  for (int i = 0; i < 4; ++i)
+    buffer->push_back(static_cast<char>(x >> (8 * i)));
+}
+
+static inline uint32_t get_uint32(const char* p) {
+  uint32_t x = 0;
+  for (int i = 3; i >= 0; --i)
+    x = (x << 8) | static_cast<unsigned char>(p[i]);
+  return x;
+}
+
+bool MappedDb::Write(const vector<pair<string, MappedDbUpdate>>& updates) {
+  string buffer;
+  for (const auto& x : updates) {
+    const string& value = x.second.erased ? string() : x.second.value;
+    buffer.push_back(x.second.erased ? kLogErase : kLogPut);
+    put_uint32(&buffer, static_cast<uint32_t>(x.first.length()));
+    put_uint32(&buffer, static_cast<uint32_t>(value.length()));
+    buffer += x.first;
+    buffer += value;
+  }
+  log_.write(buffer.data(), buffer.length());
+  log_.flush();
+  if (!log_) {
+    LOG(ERROR) << "Error writing log of db '" << name() << "'.";
+    log_.clear();
+    return false;
+  }
+  // accessors may be reading the updates, which are left to them
+  if (updates_.use_count() > 1)
+    updates_ = New<MappedDbUpdates>(*updates_);
+  for (const auto& x : updates) {
+    (*updates_)[x.first] = x.second;
+  }
+  FinishCompaction(false);
+  if (IsCompactionDue())
+    StartCompaction();
+  return true;
+}
+
+size_t MappedDb::ReplayLog(const string& file_name) {
+  std::ifstream fin(file_name, std::ios::in | std::ios::binary);
+  if (!fin)
+    return 0;
+  string log((std::istreambuf_iterator<char>(fin)),
+             std::istreambuf_iterator<char>());
+  const char* p = log.data();
+  const char* end = p + log.length();
+  size_t num_entries = 0;
+  while (p < end) {
+    if (end - p < static_cast<ptrdiff_t>(kLogHeaderSize) ||
+        (*p != kLogPut && *p != kLogErase)) {
+      break;
+    }
+    size_t key_size = get_uint32(p + 1);
+    size_t value_size = get_uint32(p + 5);
+    if (static_cast<size_t>(end - p) < kLogHeaderSize + key_size + value_size)
+      break;
+    MappedDbUpdate& update =
+        (*updates_)[string(p + kLogHeaderSize, key_size)];
+    update.erased = (*p == kLogErase);
+    update.value.assign(p + kLogHeaderSize + key_size, value_size);
+    p += kLogHeaderSize + key_size + value_size;
+    ++num_entries;
+  }
+  if (p < end) {
+    // an entry was being written when the program quit
+    LOG(WARNING) << "ignored " << (end - p) << " bytes at the end of log '"
+                 << file_name << "'.";
+  }
+  LOG(INFO) << "replayed " << num_entries << " entries from log '"
+            << file_name << "'.";
+  return p - log.data();
+}
+
+bool MappedDb::TruncateLog(size_t size) {
+  boost::system::error_code ec;
+  auto file_size = boost::filesystem::file_size(log_file_name(), ec);
+  if (ec || file_size <= size)
+    return true;
+  boost::filesystem::resize_file(log_file_name(), size, ec);
+  if (ec) {
+    LOG(ERROR) << "Error truncating log of db '" << name() << "': "
+               << ec.message();
+    return false;
+  }
+  return true;
+}
+
+bool MappedDb::IsCompactionDue() const {
+  return !compaction_.valid() && !in_transaction() &&
+         CountUpdates() >= (std::max)({kCompactionThreshold, run_->size() / 4,
+                                      retry_compaction_size_});
+}
+
+bool MappedDb::StartCompaction() {
+  if (readonly() || compaction_.valid())
+    return false;
+  // the updates of a failed compaction are folded again before newer ones
+  if (!frozen_updates_) {
+    if (updates_->empty())
+      return false;
+    // the updates to fold are kept in the frozen log until they are in the run
+    log_.close();
+    boost::system::error_code ec;
+    boost::filesystem::rename(log_file_name(), frozen_log_file_name(), ec);
+    if (ec) {
+      LOG(ERROR) << "Error freezing log of db '" << name() << "': "
+                 << ec.message();
+      log_.open(log_file_name(), std::ios::out | std::ios::binary |
+                                     std::ios::app);
+      return false;
+    }
+    log_.open(log_file_name(), std::ios::out | std::ios::binary |
+                                   std::ios::trunc);
+    frozen_updates_ = updates_;
+    updates_ = New<MappedDbUpdates>();
+  }
+  auto run = run_;
+  auto updates = frozen_updates_;
+  auto file_name = run_file_name(generation_ + 1);
+  auto task = [run, updates, file_name] {
+    return BuildRun(file_name, run, updates);
+  };
+  LOG(INFO) << "compacting db '" << name() << "'.";
+#ifdef RIME_NO_THREADING
+  std::promise<bool> result;
+  result.set_value(task());
+  compaction_ = result.get_future();
+#else
+  compaction_ = std::async(std::launch::async, task);
+#endif
+  return true;
+}
+
+bool MappedDb::FinishCompaction(bool wait) {
+  if (!compaction_.valid())
+    return false;
+  if (!wait && compaction_.wait_for(std::chrono::seconds(0)) !=
+                   std::future_status::ready) {
+    return false;
+  }
+  bool success = compaction_.get();
+  auto run = New<SortedRun>(run_file_name(generation_ + 1));
+  if (!success || !run->Load()) {
+    // the frozen updates are kept, and folded again by a later compaction,
+    // or on next open
+    LOG(ERROR) << "Error compacting db '" << name() << "'.";
+    run->RemoveOnRelease();
+    retry_compaction_size_ = CountUpdates() + kCompactionThreshold;
+    return false;
+  }
+  // readers of the previous run keep it mapped until they are done,
+  // while the db file is kept until replaced on closing the db
+  if (generation_ > 0)
+    run_->RemoveOnRelease();
+  run_ = run;
+  ++generation_;
+  frozen_updates_.reset();
+  retry_compaction_size_ = 0;
+  boost::system::error_code ec;
+  boost::filesystem::remove(frozen_log_file_name(), ec);
+  LOG(INFO) << "compacted db '" << name() << "' into " << run_->size()
+            << " records.";
+  return true;
+}
+
+bool MappedDb::Compact() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return FoldUpdates();
+}
+
+bool MappedDb::FoldUpdates() {
+  if (!loaded() || readonly())
+    return false;
+  FinishCompaction(true);
+  // folds the updates of a failed compaction, then the newer ones
+  for (int i = 0; i < 2 && StartCompaction(); ++i) {
+    if (!FinishCompaction(true))
+      return false;
+  }
+  return !frozen_updates_ && updates_->empty();
+}
+
+bool MappedDb::Backup(const string& snapshot_file) {
+  if (!loaded())
+    return false;
+  LOG(INFO) << "backing up db '" << name() << "' to " << snapshot_file;
+  // only registered as a user db, whose records are in the user db format
+  bool success = UserDbHelper(this).UniformBackup(snapshot_file);
+  if (!success) {
+    LOG(ERROR) << "failed to create snapshot file '" << snapshot_file
+               << "' for db '" << name() << "'.";
+  }
+  return success;
+}
+
+bool MappedDb::Restore(const string& snapshot_file) {
+  if (!loaded() || readonly())
+    return false;
+  bool success = UserDbHelper(this).UniformRestore(snapshot_file);
+  if (!success) {
+    LOG(ERROR) << "failed to restore db '" << name() << "' from '"
+               << snapshot_file << "'.";
+  }
+  return success;
+}
+
+bool MappedDb::Remove() {
+  if (loaded()) {
+    LOG(ERROR) << "attempt to remove opened db '" << name() << "'.";
+    return false;
+  }
+  boost::system::error_code ec;
+  boost::filesystem::remove(log_file_name(), ec);
+  boost::filesystem::remove(frozen_log_file_name(), ec);
+  for (size_t generation : FindRunGenerations()) {
+    boost::filesystem::remove(run_file_name(generation), ec);
+  }
+  return Db::Remove();
+}
+
+// generations of runs left next to the db file, the latest first
+vector<size_t> MappedDb::FindRunGenerations() const {
+  vector<size_t> generations;
+  boost::filesystem::path path(file_name());
+  string prefix = path.filename().string() + ".";
+  boost::system::error_code ec;
+  auto dir = path.has_parent_path() ? path.parent_path()
+                                    : boost::filesystem::path(".");
+  for (boost::filesystem::directory_iterator it(dir, ec), end;
+       !ec && it != end; it.increment(ec)) {
+    string name = it->path().filename().string();
+    if (name.length() <= prefix.length() ||
+        name.compare(0, prefix.length(), prefix) != 0)
+      continue;
+    string suffix = name.substr(prefix.length());
+    if (suffix.length() > 9 ||
+        suffix.find_first_not_of("0123456789") != string::npos)
+      continue;
+    size_t generation = std::stoul(suffix);
+    if (generation > 0)
+      generations.push_back(generation);
+  }
+  std::sort(generations.rbegin(), generations.rend());
+  return generations;
+}
+
+bool MappedDb::LoadLatestRun() {
+  auto generations = FindRunGenerations();
+  generations.push_back(0);
+  run_.reset();
+  for (size_t generation : generations) {
+    auto run = New<SortedRun>(run_file_name(generation));
+    if (run->Load()) {
+      run_ = run;
+      generation_ = generation;
+      break;
+    }
+  }
+  if (!run_)
+    return false;
+  if (!readonly()) {
+    // runs replaced by the latest, or unfinished
+    boost::system::error_code ec;
+    for (size_t generation : generations) {
+      if (generation != 0 && generation != generation_)
+        boost::filesystem::remove(run_file_name(generation), ec);
+    }
+  }
+  return true;
+}
+
+bool MappedDb::Load(bool readonly) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (loaded())
+    return false;
+  readonly_ = readonly;
+  generation_ = 0;
+  retry_compaction_size_ = 0;
+  try {
+    if (!readonly && !Exists() &&
+        !SortedRun(file_name()).Build(SortedRun::Records())) {
+      LOG(ERROR) << "Error creating db '" << name() << "'.";
+      return false;
+    }
+    if (!LoadLatestRun()) {
+      LOG(ERROR) << "Error opening db '" << name() << "'.";
+      return false;
+    }
+  } catch (std::exception& ex) {
+    LOG(ERROR) << "Error opening db '" << name() << "': " << ex.what();
+    return false;
+  }
+  updates_ = New<MappedDbUpdates>();
+  // an interrupted compaction leaves the frozen log behind
+  bool interrupted = boost::filesystem::exists(frozen_log_file_name());
+  if (interrupted) {
+    ReplayLog(frozen_log_file_name());
+  }
+  size_t log_size = ReplayLog(log_file_name());
+  if (!readonly) {
+    bool folded = false;
+    if (interrupted) {
+      // fold both logs as the interrupted compaction would have done
+      frozen_updates_ = updates_;
+      updates_ = New<MappedDbUpdates>();
+      compaction_ = std::async(std::launch::deferred, BuildRun,
+                               run_file_name(generation_ + 1), run_,
+                               frozen_updates_);
+      folded = FinishCompaction(true);
+    }
+    // drop a partly written entry at the end of the log, behind which
+    // appended entries would never be replayed
+    if (!folded && !TruncateLog(log_size))
+      return false;
+    log_.open(log_file_name(), std::ios::out | std::ios::binary |
+                                   (folded ? std::ios::trunc : std::ios::app));
+    if (!log_) {
+      LOG(ERROR) << "Error opening log of db '" << name() << "'.";
+      return false;
+    }
+  }
+  loaded_ = true;
+  return true;
+}
+
+bool MappedDb::Open() {
+  if (!Load(false)) {
+    Close();
+    return false;
+  }
+  string db_name;
+  if (!MetaFetch("/db_name", &db_name)) {
+    if (!CreateMetadata()) {
+      LOG(ERROR) << "error creating metadata.";
+      Close();
+    }
+  }
+  return loaded_;
+}
+
+bool MappedDb::OpenReadOnly() {
+  if (!Load(true)) {
+    LOG(ERROR) << "Error opening db '" << name() << "' read-only.";
+    Close();
+    return false;
+  }
+  return loaded_;
+}
+
+bool MappedDb::Close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  bool was_loaded = loaded();
+  if (was_loaded && !readonly()) {
+    // fold the log, so that the db opens without replaying it
+    FoldUpdates();
+  }
+  log_.close();
+  log_.clear();
+  if (was_loaded && !readonly() && generation_ > 0 && run_.use_count() == 1) {
+    // the latest run takes the place of the db file
+    run_.reset();
+    boost::system::error_code ec;
+    boost::filesystem::rename(run_file_name(generation_), file_name(), ec);
+  }
+  run_.reset();
+  updates_.reset();
+  frozen_updates_.reset();
+  batch_.clear();
+  readonly_ = false;
+  in_transaction_ = false;
+  if (!was_loaded)
+    return false;
+
+  LOG(INFO) << "closed db '" << name() << "'.";
+  loaded_ = false;
+  return true;
+}
+
+bool MappedDb::CreateMetadata() {
+  return Db::CreateMetadata() && MetaUpdate("/db_type", db_type_);
+}
+
+bool MappedDb::MetaFetch(const string& key, string* value) {
+  return Fetch(kMetaCharacter + key, value);
+}
+
+bool MappedDb::MetaUpdate(const string& key, const string& value) {
+  return Update(kMetaCharacter + key, value);
+}
+
+bool MappedDb::BeginTransaction() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!loaded())
+    return false;
+  batch_.clear();
+  in_transaction_ = true;
+  return true;
+}
+
+bool MappedDb::AbortTransaction() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!loaded() || !in_transaction())
+    return false;
+  batch_.clear();
+  in_transaction_ = false;
+  return true;
+}
+
+bool MappedDb::CommitTransaction() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!loaded() || !in_transaction())
+    return false;
+  in_transaction_ = false;
+  bool ok = Write(batch_);
+  batch_.clear();
+  return ok;
+}
+
+template <>
+RIME_API string UserDbComponent<MappedDb>::extension() const {
+  return ".userdb.bin";
+}
+
+template <>
+RIME_API UserDbWrapper<MappedDb>::UserDbWrapper(const string& file_name,
+                                                const string& db_name)
+    : MappedDb(file_name, db_name, "userdb") {}
+
+}  // namespace rime
@@ -0,0 +1,187 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef RIME_MAPPED_DB_H_
+#define RIME_MAPPED_DB_H_
+
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <rime/dict/db.h>
+#include <rime/dict/mapped_file.h>
+
+namespace rime {
+
+namespace mapped_db {
+
+// a key or a value of arbitrary bytes
+struct Blob {
+  OffsetPtr<char> data;
+  uint32_t size;
+};
+
+struct Record {
+  Blob key;
+  Blob value;
+};
+
+struct Metadata {
+  static const int kFormatMaxLength = 32;
+  char format[kFormatMaxLength];
+  uint32_t num_records;
+  OffsetPtr<Array<Record>> records;
+};
+
+}  // namespace mapped_db
+
+// an immutable run of records sorted by key, in a memory-mapped file
+class SortedRun : public MappedFile {
+ public:
+  using Records = vector<pair<string, string>>;
+
+  explicit SortedRun(const string& file_name) : MappedFile(file_name) {}
+  ~SortedRun();
+
+  bool Load();
+  // builds the run from records in ascending order of unique keys
+  bool Build(const Records& records);
+
+  size_t size() const { return records_ ? records_->size : 0; }
+  const mapped_db::Record* begin() const;
+  const mapped_db::Record* end() const;
+  // the first record whose key is not less than the given key
+  const mapped_db::Record* LowerBound(const string& key) const;
+
+  // the file is removed once the run is released by the last reader
+  void RemoveOnRelease() { remove_on_release_ = true; }
+
+ private:
+  bool remove_on_release_ = false;
+  mapped_db::Metadata* metadata_ = nullptr;
+  Array<mapped_db::Record>* records_ = nullptr;
+};
+
+// a value written since the run was built, or a deletion
+struct MappedDbUpdate {
+  string value;
+  bool erased = false;
+};
+
+using MappedDbUpdates = map<string, MappedDbUpdate>;
+
+class MappedDbAccessor : public DbAccessor {
+ public:
+  // merges the updates over the run, where newer updates come later
+  MappedDbAccessor(const an<SortedRun>& run,
+                   const vector<an<MappedDbUpdates>>& updates,
+                   const string& prefix);
+  virtual ~MappedDbAccessor();
+
+  virtual bool Reset();
+  virtual bool Jump(const string& key);
+  virtual bool GetNextRecord(string* key, string* value);
+  virtual bool exhausted();
+
+ private:
+  void FindNextRecord();
+  void Skip();
+
+  an<SortedRun> run_;
+  const mapped_db::Record* run_iter_ = nullptr;
+  vector<an<MappedDbUpdates>> updates_;
+  vector<MappedDbUpdates::const_iterator> update_iters_;
+  // the record at the cursor, found in the run if source_ is -1,
+  // or else in updates_[source_]
+  const char* key_ = nullptr;
+  size_t key_size_ = 0;
+  int source_ = -1;
+  bool is_metadata_query_ = false;
+};
+
+// a user db of an immutable memory-mapped sorted run, plus a log of updates
+// kept in memory and appended to a file. the log is folded into a new run,
+// in the background if threading is enabled, once it grows large, and on
+// closing the db. each new run is written to a file of the next generation,
+// as the file of the current run may still be mapped by readers; the latest
+// run takes the place of the db file on closing the db, if no longer mapped.
+// the db may be shared by sessions on different threads; accessors read the
+// run and the updates as of the query, as updates are copied on write while
+// being read.
+class MappedDb : public Db, public Transactional {
+ public:
+  MappedDb(const string& file_name,
+           const string& db_name,
+           const string& db_type = "");
+  virtual ~MappedDb();
+
+  virtual bool Remove();
+  virtual bool Open();
+  virtual bool OpenReadOnly();
+  virtual bool Close();
+
+  virtual bool Backup(const string& snapshot_file);
+  virtual bool Restore(const string& snapshot_file);
+
+  virtual bool CreateMetadata();
+  virtual bool MetaFetch(const string& key, string* value);
+  virtual bool MetaUpdate(const string& key, const string& value);
+
+  virtual an<DbAccessor> QueryMetadata();
+  virtual an<DbAccessor> QueryAll();
+  virtual an<DbAccessor> Query(const string& key);
+  virtual bool Fetch(const string& key, string* value);
+  virtual bool Update(const string& key, const string& value);
+  virtual bool Erase(const string& key);
+
+  // Transactional
+  virtual bool BeginTransaction();
+  virtual bool AbortTransaction();
+  virtual bool CommitTransaction();
+
+  // folds the log of updates into a new run, and waits for it to finish
+  bool Compact();
+
+  size_t num_records() const;
+  size_t num_updates() const;
+
+ private:
+  // the following are called with the mutex locked
+  bool Load(bool readonly);
+  bool LoadLatestRun();
+  vector<size_t> FindRunGenerations() const;
+  // returns the size of the complete entries in the log
+  size_t ReplayLog(const string& file_name);
+  bool TruncateLog(size_t size);
+  bool Write(const vector<pair<string, MappedDbUpdate>>& updates);
+  bool IsCompactionDue() const;
+  bool StartCompaction();
+  bool FinishCompaction(bool wait);
+  bool FoldUpdates();
+  size_t CountUpdates() const;
+
+  string log_file_name() const { return file_name() + ".log"; }
+  string frozen_log_file_name() const { return file_name() + ".log.1"; }
+  string run_file_name(size_t generation) const {
+    return generation ? file_name() + "." + std::to_string(generation)
+                      : file_name();
+  }
+
+  string db_type_;
+  // guards the run, the updates, the log and the transaction batch
+  mutable std::mutex mutex_;
+  an<SortedRun> run_;
+  size_t generation_ = 0;
+  an<MappedDbUpdates> updates_;
+  // updates being folded into a new run, or to be folded again if that failed
+  an<MappedDbUpdates> frozen_updates_;
+  // a failed compaction is retried once this many updates are pending
+  size_t retry_compaction_size_ = 0;
+  std::ofstream log_;
+  vector<pair<string, MappedDbUpdate>> batch_;
+  std::future<bool> compaction_;
+};
+
+}  // namespace rime
+
+#endif  // RIME_MAPPED_DB_H_
@@ -11,9 +11,48 @@
 #include <boost/interprocess/file_mapping.hpp>
 #include <boost/interprocess/mapped_region.hpp>
 #include <rime/dict/mapped_file.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif  // _WIN32
 
 namespace rime {
 
+bool ParseMappedFileLoadPolicy(const string& name,
+                               MappedFileLoadPolicy* policy) {
+  static const map<string, MappedFileLoadPolicy> kPolicies = {
+      {"default", MappedFileLoadPolicy::kDefault},
+      {"sequential", MappedFileLoadPolicy::kSequential},
+      {"random", MappedFileLoadPolicy::kRandom},
+      {"willneed", MappedFileLoadPolicy::kWillNeed},
+      {"populate", MappedFileLoadPolicy::kPopulate},
+      {"lock", MappedFileLoadPolicy::kLock},
+  };
+  auto found = kPolicies.find(name);
+  if (found == kPolicies.end())
+    return false;
+  *policy = found->second;
+  return true;
+}
+
+// reads a byte of every page in the range, to have them all mapped
+static size_t TouchPages(const char* begin,
+                         const char* end,
+                         const std::atomic<bool>* cancel = nullptr) {
+  const uintptr_t page_size =
+      boost::interprocess::mapped_region::get_page_size();
+  uintptr_t page = reinterpret_cast<uintptr_t>(begin) & ~(page_size - 1);
+  size_t num_pages = 0;
+  volatile char sink = 0;
+  for (; page < reinterpret_cast<uintptr_t>(end); page += page_size) {
+    if (cancel && cancel->load(std::memory_order_relaxed))
+      break;
+    sink = *reinterpret_cast<const char*>(page);
+    ++num_pages;
+  }
+  (void)sink;
+  return num_pages;
+}
+
 class MappedFileImpl {
  public:
   enum OpenMode {
@@ -35,6 +74,31 @@ class MappedFileImpl {
     file_.reset();
   }
   bool Flush() { return region_->flush(); }
+  bool Apply(MappedFileLoadPolicy policy) {
+    using boost::interprocess::mapped_region;
+    switch (policy) {
+      case MappedFileLoadPolicy::kDefault:
+        return true;
+      case MappedFileLoadPolicy::kSequential:
+        return region_->advise(mapped_region::advice_sequential);
+      case MappedFileLoadPolicy::kRandom:
+        return region_->advise(mapped_region::advice_random);
+      case MappedFileLoadPolicy::kWillNeed:
+        return region_->advise(mapped_region::advice_willneed);
+      case MappedFileLoadPolicy::kPopulate:
+        break;
+      case MappedFileLoadPolicy::kLock:
+#ifndef _WIN32
+        if (mlock(get_address(), get_size()) == 0)
+          return true;
+#endif  // _WIN32
+        LOG(WARNING) << "failed to lock pages in memory; populating instead.";
+        break;
+    }
+    const char* begin = reinterpret_cast<const char*>(get_address());
+    TouchPages(begin, begin + get_size());
+    return true;
+  }
   void* get_address() const { return region_->get_address(); }
   size_t get_size() const { return region_->get_size(); }
 
@@ -80,6 +144,10 @@ bool MappedFile::OpenReadOnly() {
   }
   file_.reset(new MappedFileImpl(file_name_, MappedFileImpl::kOpenReadOnly));
   size_ = file_->get_size();
+  if (!file_->Apply(load_policy_)) {
+    LOG(WARNING) << "unsupported load policy for file '" << file_name_
+                 << "'.";
+  }
   return bool(file_);
 }
 
@@ -165,4 +233,16 @@ char* MappedFile::address() const {
   return reinterpret_cast<char*>(file_->get_address());
 }
 
+size_t MappedFile::Prefetch(const void* ptr,
+                            size_t size,
+                            const std::atomic<bool>* cancel) {
+  if (!file_ || !ptr)
+    return 0;
+  const char* mapped = address();
+  const char* begin = (std::max)(static_cast<const char*>(ptr), mapped);
+  const char* end =
+      (std::min)(static_cast<const char*>(ptr) + size, mapped + capacity());
+  return begin < end ? TouchPages(begin, end, cancel) : 0;
+}
+
 }  // namespace rime
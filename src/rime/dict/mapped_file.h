@@ -8,6 +8,7 @@
 #define RIME_MAPPED_FILE_H_
 
 #include <stdint.h>
+#include <atomic>
 #include <cstring>
 #include <boost/utility.hpp>
 #include <rime_api.h>
@@ -79,6 +80,26 @@ struct List {
 
 // MappedFile class definition
 
+// how the pages of a file opened for read-only access are going to be used,
+// as a hint to the OS
+enum class MappedFileLoadPolicy {
+  kDefault,
+  kSequential,
+  // no read-ahead around the pages faulted in
+  kRandom,
+  // read ahead the whole file in the background
+  kWillNeed,
+  // fault in every page on opening
+  kPopulate,
+  // fault in every page and keep them in memory
+  kLock,
+};
+
+// parses one of "default", "sequential", "random", "willneed", "populate"
+// and "lock"
+RIME_API bool ParseMappedFileLoadPolicy(const string& name,
+                                        MappedFileLoadPolicy* policy);
+
 class MappedFileImpl;
 
 class MappedFile : boost::noncopyable {
@@ -104,6 +125,12 @@ class MappedFile : boost::noncopyable {
 
   size_t capacity() const;
   char* address() const;
+  // faults in the pages of a range in the file, stopping short once the
+  // cancel flag is set.
+  // return num of pages touched.
+  size_t Prefetch(const void* ptr,
+                  size_t size,
+                  const std::atomic<bool>* cancel = nullptr);
 
  public:
   bool Exists() const;
@@ -116,10 +143,14 @@ class MappedFile : boost::noncopyable {
 
   const string& file_name() const { return file_name_; }
   size_t file_size() const { return size_; }
+  // takes effect when the file is opened for read-only access
+  MappedFileLoadPolicy load_policy() const { return load_policy_; }
+  void set_load_policy(MappedFileLoadPolicy policy) { load_policy_ = policy; }
 
  private:
   string file_name_;
   size_t size_ = 0;
+  MappedFileLoadPolicy load_policy_ = MappedFileLoadPolicy::kDefault;
   the<MappedFileImpl> file_;
 };
 
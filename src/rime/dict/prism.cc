@@ -7,21 +7,11 @@
 //
 #include <cfloat>
 #include <cstring>
-#include <queue>
 #include <rime/algo/algebra.h>
 #include <rime/dict/prism.h>
 
 namespace rime {
 
-namespace {
-
-struct node_t {
-  string key;
-  size_t node_pos;
-};
-
-}  // namespace
-
 const char kPrismFormat[] = "Rime::Prism/3.0";
 
 const char kPrismFormatPrefix[] = "Rime::Prism/";
@@ -113,6 +103,19 @@ bool Prism::Load() {
   return true;
 }
 
+size_t Prism::Warmup(const std::atomic<bool>* cancel) {
+  if (!metadata_)
+    return 0;
+  size_t num_pages =
+      Prefetch(metadata_->double_array.get(), trie_->total_size(), cancel);
+  if (spelling_map_ && spelling_map_->size > 0) {
+    num_pages += Prefetch(spelling_map_->begin(),
+                          sizeof(prism::SpellingMapItem) * spelling_map_->size,
+                          cancel);
+  }
+  return num_pages;
+}
+
 bool Prism::Save() {
   LOG(INFO) << "saving prism file: " << file_name();
   if (!trie_->total_size()) {
@@ -265,41 +268,57 @@ void Prism::ExpandSearch(const string& key,
   if (!result)
     return;
   result->clear();
-  size_t count = 0;
-  size_t node_pos = 0;
-  size_t key_pos = 0;
-  int ret = trie_->traverse(key.c_str(), node_pos, key_pos);
-  // key is not a valid path
-  if (ret == -2)
+  ExpandSearchCursor cursor;
+  ExpandSearch(key, &cursor, result, limit);
+}
+
+void Prism::ExpandSearch(const string& key,
+                         ExpandSearchCursor* cursor,
+                         vector<Match>* result,
+                         size_t limit) {
+  if (!cursor || !result)
     return;
-  if (ret != -1) {
-    result->push_back(Match{ret, key_pos});
-    if (limit && ++count >= limit)
+  auto& queue = cursor->queue;
+  if (!cursor->started) {
+    cursor->started = true;
+    size_t node_pos = 0;
+    size_t key_pos = 0;
+    int ret = trie_->traverse(key.c_str(), node_pos, key_pos);
+    // key is not a valid path
+    if (ret == -2)
       return;
+    queue.push_back({node_pos, key_pos});
+    if (ret != -1) {
+      result->push_back(Match{ret, key_pos});
+      ++cursor->count;
+    }
   }
-  std::queue<node_t> q;
-  q.push({key, node_pos});
-  while (!q.empty()) {
-    node_t node = q.front();
-    q.pop();
-    const char* c =
-        (format_ > 1.0 - DBL_EPSILON) ? metadata_->alphabet : kDefaultAlphabet;
-    for (; *c; ++c) {
-      string k = node.key + *c;
-      size_t k_pos = node.key.length();
-      size_t n_pos = node.node_pos;
-      ret = trie_->traverse(k.c_str(), n_pos, k_pos);
-      if (ret <= -2) {
-        // ignore
-      } else if (ret == -1) {
-        q.push({k, n_pos});
-      } else {
-        q.push({k, n_pos});
-        result->push_back(Match{ret, k_pos});
-        if (limit && ++count >= limit)
-          return;
+  const char* alphabet =
+      (format_ > 1.0 - DBL_EPSILON) ? metadata_->alphabet : kDefaultAlphabet;
+  // visits child nodes by one letter transitions from the parent node
+  while (cursor->front < queue.size()) {
+    const auto node = queue[cursor->front];
+    for (; alphabet[cursor->letter]; ++cursor->letter) {
+      if (limit && cursor->count >= limit)
+        return;
+      size_t node_pos = node.node_pos;
+      size_t key_pos = 0;
+      int ret = trie_->traverse(&alphabet[cursor->letter], node_pos, key_pos,
+                                1);
+      if (ret <= -2)
+        continue;
+      queue.push_back({node_pos, node.length + 1});
+      if (ret != -1) {
+        result->push_back(Match{ret, node.length + 1});
+        ++cursor->count;
       }
     }
+    cursor->letter = 0;
+    // drop expanded nodes once they take up half of the queue
+    if (++cursor->front * 2 > queue.size()) {
+      queue.erase(queue.begin(), queue.begin() + cursor->front);
+      cursor->front = 0;
+    }
   }
 }
 
@@ -319,4 +338,8 @@ uint32_t Prism::schema_file_checksum() const {
   return metadata_ ? metadata_->schema_file_checksum : 0;
 }
 
+uint32_t Prism::num_spellings() const {
+  return metadata_ ? metadata_->num_spellings : 0;
+}
+
 }  // namespace rime
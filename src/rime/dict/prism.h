@@ -61,6 +61,24 @@ class SpellingAccessor {
   prism::SpellingDescriptor* end_;
 };
 
+// where a breadth-first expand search stopped, to be resumed for more keys
+struct ExpandSearchCursor {
+  struct Node {
+    size_t node_pos;
+    size_t length;
+  };
+  // nodes of the trie to expand, from the front on
+  vector<Node> queue;
+  size_t front = 0;
+  // the letter in the alphabet to try next at the front node
+  size_t letter = 0;
+  // number of keys found so far
+  size_t count = 0;
+  bool started = false;
+
+  bool exhausted() const { return started && front >= queue.size(); }
+};
+
 class Script;
 
 class Prism : public MappedFile {
@@ -71,6 +89,9 @@ class Prism : public MappedFile {
 
   RIME_API bool Load();
   RIME_API bool Save();
+  // faults in the double array and the spelling map, until cancelled.
+  // return num of pages touched.
+  RIME_API size_t Warmup(const std::atomic<bool>* cancel = nullptr);
   RIME_API bool Build(const Syllabary& syllabary,
                       const Script* script = nullptr,
                       uint32_t dict_file_checksum = 0,
@@ -82,12 +103,19 @@ class Prism : public MappedFile {
   RIME_API void ExpandSearch(const string& key,
                              vector<Match>* result,
                              size_t limit);
+  // continues the search from where the cursor stopped, until the number of
+  // keys found in total reaches the limit. appends new keys to result.
+  RIME_API void ExpandSearch(const string& key,
+                             ExpandSearchCursor* cursor,
+                             vector<Match>* result,
+                             size_t limit);
   SpellingAccessor QuerySpelling(SyllableId spelling_id);
 
   RIME_API size_t array_size() const;
 
   uint32_t dict_file_checksum() const;
   uint32_t schema_file_checksum() const;
+  uint32_t num_spellings() const;
   Darts::DoubleArray& trie() const { return *trie_; }
 
  protected:
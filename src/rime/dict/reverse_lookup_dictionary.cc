@@ -209,6 +209,11 @@ bool ReverseLookupDictionary::Load() {
   return db_ && (db_->IsOpen() || db_->Load());
 }
 
+void ReverseLookupDictionary::set_load_policy(MappedFileLoadPolicy policy) {
+  if (db_ && !db_->IsOpen())
+    db_->set_load_policy(policy);
+}
+
 bool ReverseLookupDictionary::ReverseLookup(const string& text,
                                             string* result) {
   return db_->Lookup(text, result);
@@ -260,7 +265,18 @@ ReverseLookupDictionary* ReverseLookupDictionaryComponent::Create(
     // missing!
     return NULL;
   }
-  return Create(dict_name);
+  auto dictionary = Create(dict_name);
+  string load_policy;
+  if (config->GetString(ticket.name_space + "/dictionary_load_policy",
+                        &load_policy)) {
+    MappedFileLoadPolicy policy;
+    if (ParseMappedFileLoadPolicy(load_policy, &policy)) {
+      dictionary->set_load_policy(policy);
+    } else {
+      LOG(WARNING) << "unknown dictionary load policy: " << load_policy;
+    }
+  }
+  return dictionary;
 }
 
 }  // namespace rime
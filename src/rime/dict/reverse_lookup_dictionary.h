@@ -64,6 +64,8 @@ class ReverseLookupDictionary
  public:
   explicit ReverseLookupDictionary(an<ReverseDb> db);
   bool Load();
+  // applies to the db if opened by the next Load()
+  void set_load_policy(MappedFileLoadPolicy policy);
   bool ReverseLookup(const string& text, string* result);
   bool LookupStems(const string& text, string* result);
   an<DictSettings> GetDictSettings();
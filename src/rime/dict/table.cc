@@ -7,8 +7,8 @@
 #include <cfloat>
 #include <cstring>
 #include <algorithm>
-#include <queue>
 #include <utility>
+#include <boost/algorithm/string.hpp>
 #include <rime/common.h>
 #include <rime/algo/syllabifier.h>
 #include <rime/dict/table.h>
@@ -21,29 +21,42 @@ const int kTableFormatLowestCompatible = 4.0;
 const char kTableFormatPrefix[] = "Rime::Table/";
 const size_t kTableFormatPrefixLen = sizeof(kTableFormatPrefix) - 1;
 
-TableAccessor::TableAccessor(const Code& index_code,
+// an unreleased format 5.0 laid out the index differently; tables built in
+// it are rejected, to be rebuilt
+const double kTableFormatIncompatible = 5.0;
+
+TableAccessor::TableAccessor(const SyllableId* index_code,
+                             size_t index_code_length,
                              const List<table::Entry>* list,
                              double credibility)
-    : index_code_(index_code),
+    : index_code_length_(index_code_length),
       entries_(list->at.get()),
       size_(list->size),
-      credibility_(credibility) {}
+      credibility_(credibility) {
+  std::copy(index_code, index_code + index_code_length, index_code_);
+}
 
-TableAccessor::TableAccessor(const Code& index_code,
+TableAccessor::TableAccessor(const SyllableId* index_code,
+                             size_t index_code_length,
                              const Array<table::Entry>* array,
                              double credibility)
-    : index_code_(index_code),
+    : index_code_length_(index_code_length),
       entries_(array->at),
       size_(array->size),
-      credibility_(credibility) {}
+      credibility_(credibility) {
+  std::copy(index_code, index_code + index_code_length, index_code_);
+}
 
-TableAccessor::TableAccessor(const Code& index_code,
+TableAccessor::TableAccessor(const SyllableId* index_code,
+                             size_t index_code_length,
                              const table::TailIndex* code_map,
                              double credibility)
-    : index_code_(index_code),
+    : index_code_length_(index_code_length),
       long_entries_(code_map->at),
       size_(code_map->size),
-      credibility_(credibility) {}
+      credibility_(credibility) {
+  std::copy(index_code, index_code + index_code_length, index_code_);
+}
 
 bool TableAccessor::exhausted() const {
   if (entries_ || long_entries_) {
@@ -74,6 +87,12 @@ const table::Code* TableAccessor::extra_code() const {
   return &long_entries_[cursor_].extra_code;
 }
 
+Code TableAccessor::index_code() const {
+  Code code;
+  code.assign(index_code_, index_code_ + index_code_length_);
+  return code;
+}
+
 Code TableAccessor::code() const {
   auto extra = extra_code();
   if (!extra) {
@@ -97,9 +116,9 @@ bool TableQuery::Advance(SyllableId syllable_id, double credibility) {
   if (!Walk(syllable_id)) {
     return false;
   }
+  index_code_[level_] = syllable_id;
+  credibility_[level_ + 1] = credibility_[level_] + credibility;
   ++level_;
-  index_code_.push_back(syllable_id);
-  credibility_.push_back(credibility_.back() + credibility);
   return true;
 }
 
@@ -107,18 +126,12 @@ bool TableQuery::Backdate() {
   if (level_ == 0)
     return false;
   --level_;
-  if (index_code_.size() > level_) {
-    index_code_.pop_back();
-    credibility_.pop_back();
-  }
   return true;
 }
 
 void TableQuery::Reset() {
   level_ = 0;
-  index_code_.clear();
-  credibility_.clear();
-  credibility_.push_back(0.0);
+  credibility_[0] = 0.0;
 }
 
 inline static bool node_less(const table::TrunkIndexNode& a,
@@ -135,6 +148,37 @@ static table::TrunkIndexNode* find_node(table::TrunkIndexNode* first,
   return it == last || key < it->key ? last : it;
 }
 
+// finds the node of the key in the trunk index by the search of its keys if
+// there is one, storing the position of the node in *position
+static table::TrunkIndexNode* find_node(table::TrunkIndex* index,
+                                        const table::TrunkSearch* search,
+                                        SyllableId key,
+                                        size_t* position) {
+  if (!search) {
+    auto node = find_node(index->begin(), index->end(), key);
+    if (node == index->end())
+      return nullptr;
+    *position = node - index->begin();
+    return node;
+  }
+  const size_t size = search->size;
+  const SyllableId* keys = search->keys.get();
+  // descends without branching on the comparisons
+  size_t k = 1;
+  while (k <= size) {
+    k = 2 * k + (keys[k - 1] < key);
+  }
+  // undo the right turns after the last left turn, at the lower bound
+  while (k & 1) {
+    k >>= 1;
+  }
+  k >>= 1;
+  if (!k || keys[k - 1] != key)
+    return nullptr;
+  *position = search->positions.get()[k - 1];
+  return &index->at[*position];
+}
+
 bool TableQuery::Walk(SyllableId syllable_id) {
   if (level_ == 0) {
     if (!lv1_index_ || syllable_id < 0 ||
@@ -144,22 +188,27 @@ bool TableQuery::Walk(SyllableId syllable_id) {
     if (!node->next_level)
       return false;
     lv2_index_ = &node->next_level->trunk();
+    lv2_search_ = search_index_ && syllable_id < static_cast<SyllableId>(
+                                                     search_index_->size)
+                      ? search_index_->at[syllable_id].get()
+                      : nullptr;
   } else if (level_ == 1) {
     if (!lv2_index_)
       return false;
-    auto node = find_node(lv2_index_->begin(), lv2_index_->end(), syllable_id);
-    if (node == lv2_index_->end())
-      return false;
-    if (!node->next_level)
+    size_t position = 0;
+    auto node = find_node(lv2_index_, lv2_search_, syllable_id, &position);
+    if (!node || !node->next_level)
       return false;
     lv3_index_ = &node->next_level->trunk();
+    lv3_search_ = lv2_search_ && lv2_search_->next_level
+                      ? lv2_search_->next_level.get()[position].get()
+                      : nullptr;
   } else if (level_ == 2) {
     if (!lv3_index_)
       return false;
-    auto node = find_node(lv3_index_->begin(), lv3_index_->end(), syllable_id);
-    if (node == lv3_index_->end())
-      return false;
-    if (!node->next_level)
+    size_t position = 0;
+    auto node = find_node(lv3_index_, lv3_search_, syllable_id, &position);
+    if (!node || !node->next_level)
       return false;
     lv4_index_ = &node->next_level->tail();
   } else {
@@ -168,34 +217,32 @@ bool TableQuery::Walk(SyllableId syllable_id) {
   return true;
 }
 
-inline static Code add_syllable(Code code, SyllableId syllable_id) {
-  code.push_back(syllable_id);
-  return code;
-}
-
 TableAccessor TableQuery::Access(SyllableId syllable_id,
                                  double credibility) const {
-  credibility += credibility_.back();
+  credibility += credibility_[level_];
   if (level_ == 0) {
     if (!lv1_index_ || syllable_id < 0 ||
         syllable_id >= static_cast<SyllableId>(lv1_index_->size))
       return TableAccessor();
     auto node = &lv1_index_->at[syllable_id];
-    return TableAccessor(add_syllable(index_code_, syllable_id), &node->entries,
-                         credibility);
+    return TableAccessor(&syllable_id, 1, &node->entries, credibility);
   } else if (level_ == 1 || level_ == 2) {
     auto index = (level_ == 1) ? lv2_index_ : lv3_index_;
     if (!index)
       return TableAccessor();
-    auto node = find_node(index->begin(), index->end(), syllable_id);
-    if (node == index->end())
+    size_t position = 0;
+    auto node = find_node(index, (level_ == 1) ? lv2_search_ : lv3_search_,
+                          syllable_id, &position);
+    if (!node)
       return TableAccessor();
-    return TableAccessor(add_syllable(index_code_, syllable_id), &node->entries,
-                         credibility);
+    SyllableId code[Code::kIndexCodeMaxLength];
+    std::copy(index_code_, index_code_ + level_, code);
+    code[level_] = syllable_id;
+    return TableAccessor(code, level_ + 1, &node->entries, credibility);
   } else if (level_ == 3) {
     if (!lv4_index_)
       return TableAccessor();
-    return TableAccessor(index_code_, lv4_index_, credibility);
+    return TableAccessor(index_code_, level_, lv4_index_, credibility);
   }
   return TableAccessor();
 }
@@ -279,6 +326,13 @@ bool Table::Load() {
                << kTableFormatLatest;
     return false;
   }
+  if (format_version >= kTableFormatIncompatible - DBL_EPSILON) {
+    LOG(ERROR) << "table format version " << format_version
+               << " is not supported. please rebuild the table in version "
+               << kTableFormatLatest;
+    Close();
+    return false;
+  }
 
   syllabary_ = metadata_->syllabary.get();
   if (!syllabary_) {
@@ -292,10 +346,74 @@ bool Table::Load() {
     Close();
     return false;
   }
+  completion_index_ = metadata_->completion_index.get();
+  search_index_ = (metadata_->flags & table::Metadata::kHasSearchIndex)
+                      ? metadata_->search_index.get()
+                      : nullptr;
 
   return OnLoad();
 }
 
+template <class T>
+inline static size_t array_bytes(const Array<T>* array) {
+  return sizeof(Array<T>) + sizeof(T) * (array->size ? array->size - 1 : 0);
+}
+
+size_t Table::Warmup(const std::atomic<bool>* cancel) {
+  if (!index_)
+    return 0;
+  // stops walking the index, which is in the mapped file, as well
+  auto cancelled = [cancel] {
+    return cancel && cancel->load(std::memory_order_relaxed);
+  };
+  size_t num_pages = Prefetch(syllabary_, array_bytes(syllabary_), cancel);
+  num_pages += Prefetch(metadata_->string_table.get(),
+                        metadata_->string_table_size, cancel);
+  num_pages += Prefetch(index_, array_bytes(index_), cancel);
+  for (const auto& x : *index_) {
+    if (cancelled())
+      return num_pages;
+    if (!x.next_level)
+      continue;
+    auto lv2 = &x.next_level->trunk();
+    num_pages += Prefetch(lv2, array_bytes(lv2), cancel);
+    for (const auto& y : *lv2) {
+      if (cancelled())
+        break;
+      if (!y.next_level)
+        continue;
+      auto lv3 = &y.next_level->trunk();
+      num_pages += Prefetch(lv3, array_bytes(lv3), cancel);
+    }
+  }
+  if (search_index_ && !cancelled()) {
+    num_pages += Prefetch(search_index_, array_bytes(search_index_), cancel);
+    for (const auto& x : *search_index_) {
+      if (cancelled())
+        return num_pages;
+      auto lv2 = x.get();
+      if (!lv2)
+        continue;
+      num_pages += Prefetch(lv2->keys.get(), lv2->size * sizeof(SyllableId),
+                            cancel);
+      if (!lv2->next_level)
+        continue;
+      for (size_t i = 0; i < lv2->size && !cancelled(); ++i) {
+        auto lv3 = lv2->next_level.get()[i].get();
+        if (lv3) {
+          num_pages += Prefetch(lv3->keys.get(),
+                                lv3->size * sizeof(SyllableId), cancel);
+        }
+      }
+    }
+  }
+  if (completion_index_ && completion_index_->nodes && !cancelled()) {
+    auto nodes = completion_index_->nodes.get();
+    num_pages += Prefetch(nodes, array_bytes(nodes), cancel);
+  }
+  return num_pages;
+}
+
 bool Table::Save() {
   LOG(INFO) << "saving table file: " << file_name();
 
@@ -311,6 +429,23 @@ uint32_t Table::dict_file_checksum() const {
   return metadata_ ? metadata_->dict_file_checksum : 0;
 }
 
+inline static bool weight_greater(const of<ShortDictEntry>& a,
+                                  const of<ShortDictEntry>& b) {
+  return a->weight > b->weight;
+}
+
+// whether the entries of each code are in descending order of weight
+static bool is_sorted_by_weight(const Vocabulary& vocabulary) {
+  for (const auto& v : vocabulary) {
+    const auto& entries = v.second.entries;
+    if (!std::is_sorted(entries.begin(), entries.end(), weight_greater))
+      return false;
+    if (v.second.next_level && !is_sorted_by_weight(*v.second.next_level))
+      return false;
+  }
+  return true;
+}
+
 bool Table::Build(const Syllabary& syllabary,
                   const Vocabulary& vocabulary,
                   size_t num_entries,
@@ -319,6 +454,18 @@ bool Table::Build(const Syllabary& syllabary,
   size_t num_syllables = syllabary.size();
   size_t estimated_file_size =
       kReservedSize + 32 * num_syllables + 64 * num_entries;
+  if (search_index_enabled_) {
+    // each word adds at most two trunk nodes and their searches
+    estimated_file_size +=
+        sizeof(int32_t) * num_syllables +
+        2 * (sizeof(table::TrunkSearch) + 3 * sizeof(int32_t)) * num_entries;
+  }
+  if (completion_prefix_length_ > 0) {
+    // each syllable or word appears under at most as many prefixes
+    estimated_file_size +=
+        completion_prefix_length_ *
+        (32 * num_syllables + sizeof(table::CompletionEntry) * num_entries);
+  }
   LOG(INFO) << "building table.";
   LOG(INFO) << "num syllables: " << num_syllables;
   LOG(INFO) << "num entries: " << num_entries;
@@ -362,6 +509,37 @@ bool Table::Build(const Syllabary& syllabary,
     return false;
   }
   metadata_->index = index_;
+  if (is_sorted_by_weight(vocabulary)) {
+    metadata_->flags |= table::Metadata::kEntriesSortedByWeight;
+  }
+
+  search_index_ = nullptr;
+  if (search_index_enabled_) {
+    LOG(INFO) << "creating search index.";
+    search_index_ = BuildSearchIndex(vocabulary, num_syllables);
+    if (!search_index_) {
+      LOG(ERROR) << "Error creating search index.";
+      return false;
+    }
+    metadata_->search_index = search_index_;
+    metadata_->flags |= table::Metadata::kHasSearchIndex;
+  }
+
+  completion_index_ = nullptr;
+  if (completion_prefix_length_ > 0 && completion_max_entries_ > 0) {
+    if (!entries_sorted_by_weight()) {
+      LOG(WARNING) << "completion index skipped; "
+                      "words are not sorted by weight.";
+    } else {
+      LOG(INFO) << "creating completion index.";
+      completion_index_ = BuildCompletionIndex(syllabary, vocabulary);
+      if (!completion_index_) {
+        LOG(ERROR) << "Error creating completion index.";
+        return false;
+      }
+      metadata_->completion_index = completion_index_;
+    }
+  }
 
   if (!OnBuildFinish()) {
     return false;
@@ -373,10 +551,14 @@ bool Table::Build(const Syllabary& syllabary,
   return true;
 }
 
+bool Table::entries_sorted_by_weight() const {
+  return metadata_ &&
+         (metadata_->flags & table::Metadata::kEntriesSortedByWeight);
+}
+
 table::Index* Table::BuildIndex(const Vocabulary& vocabulary,
                                 size_t num_syllables) {
-  return reinterpret_cast<table::Index*>(
-      BuildHeadIndex(vocabulary, num_syllables));
+  return BuildHeadIndex(vocabulary, num_syllables);
 }
 
 table::HeadIndex* Table::BuildHeadIndex(const Vocabulary& vocabulary,
@@ -516,6 +698,194 @@ bool Table::BuildEntry(const ShortDictEntry& dict_entry, table::Entry* entry) {
   return true;
 }
 
+table::SearchIndex* Table::BuildSearchIndex(const Vocabulary& vocabulary,
+                                            size_t num_syllables) {
+  auto index = CreateArray<OffsetPtr<table::TrunkSearch>>(num_syllables);
+  if (!index) {
+    return NULL;
+  }
+  for (const auto& v : vocabulary) {
+    if (!v.second.next_level)
+      continue;
+    Code code;
+    code.push_back(v.first);
+    auto search = BuildTrunkSearch(code, *v.second.next_level);
+    if (!search) {
+      return NULL;
+    }
+    index->at[v.first] = search;
+  }
+  return index;
+}
+
+// assigns ranks in ascending order to the keys in the subtree of the k-th key
+// in Eytzinger order. returns the next rank to assign.
+static size_t eytzinger_order(vector<size_t>* order, size_t rank, size_t k) {
+  if (k <= order->size()) {
+    rank = eytzinger_order(order, rank, 2 * k);
+    (*order)[k - 1] = rank++;
+    rank = eytzinger_order(order, rank, 2 * k + 1);
+  }
+  return rank;
+}
+
+// the vocabulary is of the trunk index built for the prefix, whose nodes are
+// in ascending order of keys
+table::TrunkSearch* Table::BuildTrunkSearch(const Code& prefix,
+                                            const Vocabulary& vocabulary) {
+  auto search = Allocate<table::TrunkSearch>();
+  auto keys = Allocate<SyllableId>(vocabulary.size());
+  auto positions = Allocate<uint32_t>(vocabulary.size());
+  if (!search || !keys || !positions) {
+    return NULL;
+  }
+  search->size = vocabulary.size();
+  search->keys = keys;
+  search->positions = positions;
+  vector<Vocabulary::const_iterator> sorted;
+  for (auto it = vocabulary.begin(); it != vocabulary.end(); ++it) {
+    sorted.push_back(it);
+  }
+  vector<size_t> order(sorted.size());
+  eytzinger_order(&order, 0, 1);
+  for (size_t i = 0; i < order.size(); ++i) {
+    keys[i] = sorted[order[i]]->first;
+    positions[i] = order[i];
+  }
+  if (prefix.size() + 1 >= Code::kIndexCodeMaxLength) {
+    // the next level is the tail index
+    return search;
+  }
+  auto next_level = Allocate<OffsetPtr<table::TrunkSearch>>(sorted.size());
+  if (!next_level) {
+    return NULL;
+  }
+  search->next_level = next_level;
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    const auto& v = *sorted[i];
+    if (!v.second.next_level)
+      continue;
+    Code code(prefix);
+    code.push_back(v.first);
+    auto next_level_search = BuildTrunkSearch(code, *v.second.next_level);
+    if (!next_level_search) {
+      return NULL;
+    }
+    next_level[i] = next_level_search;
+  }
+  return search;
+}
+
+namespace {
+
+struct CompletionCandidate {
+  size_t code_length;
+  table::Weight weight;
+  SyllableId syllable_id;
+  size_t position;
+  const ShortDictEntry* dict_entry;
+};
+
+// the order in which a predictive lookup yields the words, where syllable ids
+// are in the lexicographical order of syllables
+bool operator<(const CompletionCandidate& a, const CompletionCandidate& b) {
+  if (a.code_length != b.code_length)
+    return a.code_length < b.code_length;
+  if (a.weight != b.weight)
+    return a.weight > b.weight;
+  if (a.syllable_id != b.syllable_id)
+    return a.syllable_id < b.syllable_id;
+  return a.position < b.position;
+}
+
+struct CompletionPrefix {
+  string prefix;
+  // range of syllable ids starting with the prefix
+  SyllableId begin;
+  SyllableId end;
+
+  bool operator<(const CompletionPrefix& other) const {
+    return prefix < other.prefix;
+  }
+};
+
+}  // namespace
+
+table::CompletionIndex* Table::BuildCompletionIndex(
+    const Syllabary& syllabary,
+    const Vocabulary& vocabulary) {
+  vector<const string*> syllables;
+  for (const string& syllable : syllabary) {
+    syllables.push_back(&syllable);
+  }
+  // syllables with a common prefix are adjacent in a sorted syllabary
+  vector<CompletionPrefix> prefixes;
+  for (size_t length = 1; length <= completion_prefix_length_; ++length) {
+    for (SyllableId i = 0; i < static_cast<SyllableId>(syllables.size());) {
+      if (syllables[i]->length() < length) {
+        ++i;
+        continue;
+      }
+      string prefix = syllables[i]->substr(0, length);
+      SyllableId j = i + 1;
+      while (j < static_cast<SyllableId>(syllables.size()) &&
+             boost::starts_with(*syllables[j], prefix)) {
+        ++j;
+      }
+      prefixes.push_back({prefix, i, j});
+      i = j;
+    }
+  }
+  std::sort(prefixes.begin(), prefixes.end());
+  auto index = Allocate<table::CompletionIndex>();
+  auto nodes = CreateArray<table::CompletionNode>(prefixes.size());
+  if (!index || !nodes) {
+    return NULL;
+  }
+  index->max_prefix_length = completion_prefix_length_;
+  index->max_entries = completion_max_entries_;
+  index->nodes = nodes;
+  vector<CompletionCandidate> candidates;
+  for (size_t k = 0; k < prefixes.size(); ++k) {
+    const auto& prefix = prefixes[k];
+    candidates.clear();
+    for (SyllableId id = prefix.begin; id < prefix.end; ++id) {
+      auto page = vocabulary.find(id);
+      if (page == vocabulary.end())
+        continue;
+      // words of a syllable as stored in the table; in order of weight
+      const auto& entries = page->second.entries;
+      size_t num_entries = (std::min)(entries.size(), completion_max_entries_);
+      for (size_t i = 0; i < num_entries; ++i) {
+        candidates.push_back({syllables[id]->length(),
+                              static_cast<table::Weight>(entries[i]->weight),
+                              id, i, entries[i].get()});
+      }
+    }
+    size_t num_entries = (std::min)(candidates.size(), completion_max_entries_);
+    std::partial_sort(candidates.begin(), candidates.begin() + num_entries,
+                      candidates.end());
+    auto& node = nodes->at[k];
+    if (!CopyString(prefix.prefix, &node.prefix)) {
+      return NULL;
+    }
+    node.entries.size = num_entries;
+    node.entries.at = Allocate<table::CompletionEntry>(num_entries);
+    if (num_entries > 0 && !node.entries.at) {
+      return NULL;
+    }
+    for (size_t i = 0; i < num_entries; ++i) {
+      auto& entry = node.entries.at[i];
+      entry.syllable_id = candidates[i].syllable_id;
+      entry.code_length = candidates[i].code_length;
+      if (!BuildEntry(*candidates[i].dict_entry, &entry.entry)) {
+        return NULL;
+      }
+    }
+  }
+  return index;
+}
+
 bool Table::GetSyllabary(Syllabary* result) {
   if (!result || !syllabary_)
     return false;
@@ -532,14 +902,14 @@ string Table::GetSyllableById(SyllableId syllable_id) {
 }
 
 TableAccessor Table::QueryWords(SyllableId syllable_id) {
-  TableQuery query(index_);
+  TableQuery query(index_, search_index_);
   return query.Access(syllable_id);
 }
 
 TableAccessor Table::QueryPhrases(const Code& code) {
   if (code.empty())
     return TableAccessor();
-  TableQuery query(index_);
+  TableQuery query(index_, search_index_);
   for (size_t i = 0; i < Code::kIndexCodeMaxLength; ++i) {
     if (code.size() == i + 1)
       return query.Access(code[i]);
@@ -552,48 +922,107 @@ TableAccessor Table::QueryPhrases(const Code& code) {
 bool Table::Query(const SyllableGraph& syll_graph,
                   size_t start_pos,
                   TableQueryResult* result) {
+  return Query(CompactSyllableGraph(syll_graph), start_pos, result);
+}
+
+bool Table::Query(const SyllableGraph& syll_graph,
+                  size_t start_pos,
+                  TableQueryBuffer* buffer) {
+  return Query(CompactSyllableGraph(syll_graph), start_pos, buffer);
+}
+
+bool Table::Query(const CompactSyllableGraph& syll_graph,
+                  size_t start_pos,
+                  TableQueryResult* result) {
   if (!result || !index_ || start_pos >= syll_graph.interpreted_length)
     return false;
   result->clear();
-  std::queue<pair<size_t, TableQuery>> q;
-  TableQuery initial_state(index_);
-  q.push({start_pos, initial_state});
-  while (!q.empty()) {
-    size_t current_pos = q.front().first;
-    TableQuery query(q.front().second);
-    q.pop();
-    auto index = syll_graph.indices.find(current_pos);
-    if (index == syll_graph.indices.end()) {
+  TableQueryBuffer buffer;
+  Query(syll_graph, start_pos, &buffer);
+  for (const auto& match : buffer.matches) {
+    (*result)[match.end_pos].push_back(match.accessor);
+  }
+  return !result->empty();
+}
+
+inline static bool end_pos_less(const TableQueryMatch& a,
+                                const TableQueryMatch& b) {
+  return a.end_pos < b.end_pos;
+}
+
+bool Table::Query(const CompactSyllableGraph& syll_graph,
+                  size_t start_pos,
+                  TableQueryBuffer* buffer) {
+  if (!buffer || !index_ || start_pos >= syll_graph.interpreted_length)
+    return false;
+  auto& matches = buffer->matches;
+  auto& frames = buffer->frames;
+  matches.clear();
+  frames.clear();
+  // frames are visited in the order they are pushed, as in a queue
+  frames.push_back({start_pos, TableQuery(index_, search_index_)});
+  for (size_t front = 0; front < frames.size(); ++front) {
+    size_t current_pos = frames[front].first;
+    // copied, for frames may be reallocated by pushing new ones
+    TableQuery query(frames[front].second);
+    if (!syll_graph.has_edges(current_pos)) {
       continue;
     }
     if (query.level() == Code::kIndexCodeMaxLength) {
       TableAccessor accessor(query.Access(-1));
       if (!accessor.exhausted()) {
-        (*result)[current_pos].push_back(accessor);
+        matches.push_back({current_pos, accessor});
       }
       continue;
     }
-    for (const auto& spellings : index->second) {
-      SyllableId syll_id = spellings.first;
+    // spellings of each syllable are listed together in the index
+    const auto& edges = syll_graph.edges;
+    const auto& index = syll_graph.index;
+    size_t last = syll_graph.end_of(current_pos);
+    for (size_t i = syll_graph.begin_of(current_pos); i < last;) {
+      SyllableId syll_id = edges[index[i]].syllable_id;
       TableAccessor accessor(query.Access(syll_id));
-      for (auto props : spellings.second) {
-        size_t end_pos = props->end_pos;
+      for (; i < last && edges[index[i]].syllable_id == syll_id; ++i) {
+        const auto& props = edges[index[i]].properties;
+        size_t end_pos = props.end_pos;
         if (!accessor.exhausted()) {
-          (*result)[end_pos].push_back(accessor);
+          matches.push_back({end_pos, accessor});
         }
         if (end_pos < syll_graph.interpreted_length &&
-            query.Advance(syll_id, props->credibility)) {
-          q.push({end_pos, query});
+            query.Advance(syll_id, props.credibility)) {
+          frames.push_back({end_pos, query});
           query.Backdate();
         }
       }
     }
   }
-  return !result->empty();
+  // stable insertion sort by end position, in place. the matches found
+  // breadth first are mostly in order already.
+  for (auto it = matches.begin(); it != matches.end(); ++it) {
+    auto pos = std::upper_bound(matches.begin(), it, *it, end_pos_less);
+    std::rotate(pos, it, it + 1);
+  }
+  return !matches.empty();
 }
 
 string Table::GetEntryText(const table::Entry& entry) {
   return GetString(entry.text);
 }
 
+inline static bool completion_prefix_less(const table::CompletionNode& node,
+                                          const string& prefix) {
+  return std::strcmp(node.prefix.c_str(), prefix.c_str()) < 0;
+}
+
+const table::CompletionNode* Table::QueryCompletions(const string& prefix) {
+  if (!completion_index_ || !completion_index_->nodes)
+    return nullptr;
+  const auto* nodes = completion_index_->nodes.get();
+  auto found = std::lower_bound(nodes->begin(), nodes->end(), prefix,
+                                completion_prefix_less);
+  if (found == nodes->end() || prefix != found->prefix.c_str())
+    return nullptr;
+  return found;
+}
+
 }  // namespace rime
@@ -76,8 +76,51 @@ RIME_TABLE_UNION(PhraseIndex, Array<char>, TrunkIndex, trunk, TailIndex, tail);
 
 using Index = HeadIndex;
 
+// the keys of a trunk index in Eytzinger order, i.e. a complete binary search
+// tree laid out level by level, where the children of the k-th key (1-based)
+// are the 2k-th and the (2k+1)-th. searched in place of the trunk nodes, so
+// that a lookup reads only the keys.
+struct TrunkSearch {
+  uint32_t size;
+  OffsetPtr<SyllableId> keys;
+  // positions of the keys in the trunk index
+  OffsetPtr<uint32_t> positions;
+  // searches of the next level trunk indices by position, if any
+  OffsetPtr<OffsetPtr<TrunkSearch>> next_level;
+};
+
+// searches of the level 2 trunk indices, by syllable id
+using SearchIndex = Array<OffsetPtr<TrunkSearch>>;
+
+// a word of one syllable completing a code prefix
+struct CompletionEntry {
+  SyllableId syllable_id;
+  // length of the syllable, by which the words are ordered
+  uint32_t code_length;
+  Entry entry;
+};
+
+// the best words completing the prefix, in the order of predictive lookups:
+// by length of the remaining code, then by weight descending
+struct CompletionNode {
+  String prefix;
+  List<CompletionEntry> entries;
+};
+
+struct CompletionIndex {
+  uint32_t max_prefix_length;
+  // a prefix of more words has only the best of them indexed
+  uint32_t max_entries;
+  // in ascending order of prefixes
+  OffsetPtr<Array<CompletionNode>> nodes;
+};
+
 struct Metadata {
   static const int kFormatMaxLength = 32;
+  // the entries of each code are in descending order of weight
+  static const uint32_t kEntriesSortedByWeight = 1;
+  // the search index follows string_table_size
+  static const uint32_t kHasSearchIndex = 2;
   char format[kFormatMaxLength];
   uint32_t dict_file_checksum;
   uint32_t num_syllables;
@@ -85,10 +128,15 @@ struct Metadata {
   OffsetPtr<Syllabary> syllabary;
   OffsetPtr<Index> index;
   // v2
-  int32_t reserved_1;
-  int32_t reserved_2;
+  // optional, in place of a reserved field that is zero in older tables
+  OffsetPtr<CompletionIndex> completion_index;
+  // optional, a combination of the flags below; zero in older tables
+  uint32_t flags;
   OffsetPtr<char> string_table;
   uint32_t string_table_size;
+  // optional, read only with kHasSearchIndex, as older tables have other
+  // data here; older versions ignore it
+  OffsetPtr<SearchIndex> search_index;
 };
 
 }  // namespace table
@@ -96,13 +144,16 @@ struct Metadata {
 class TableAccessor {
  public:
   TableAccessor() = default;
-  TableAccessor(const Code& index_code,
+  TableAccessor(const SyllableId* index_code,
+                size_t index_code_length,
                 const List<table::Entry>* entries,
                 double credibility = 0.0);
-  TableAccessor(const Code& index_code,
+  TableAccessor(const SyllableId* index_code,
+                size_t index_code_length,
                 const Array<table::Entry>* entries,
                 double credibility = 0.0);
-  TableAccessor(const Code& index_code,
+  TableAccessor(const SyllableId* index_code,
+                size_t index_code_length,
                 const table::TailIndex* code_map,
                 double credibility = 0.0);
 
@@ -112,12 +163,14 @@ class TableAccessor {
   RIME_API size_t remaining() const;
   RIME_API const table::Entry* entry() const;
   RIME_API const table::Code* extra_code() const;
-  const Code& index_code() const { return index_code_; }
+  Code index_code() const;
   Code code() const;
   double credibility() const { return credibility_; }
 
  private:
-  Code index_code_;
+  // fixed size, so that accessors are copied without allocation
+  SyllableId index_code_[Code::kIndexCodeMaxLength] = {};
+  size_t index_code_length_ = 0;
   const table::Entry* entries_ = nullptr;
   const table::LongEntry* long_entries_ = nullptr;
   size_t size_ = 0;
@@ -127,11 +180,15 @@ class TableAccessor {
 
 using TableQueryResult = map<int, vector<TableAccessor>>;
 
+struct CompactSyllableGraph;
 struct SyllableGraph;
 
 class TableQuery {
  public:
-  TableQuery(table::Index* index) : lv1_index_(index) { Reset(); }
+  TableQuery(table::Index* index, table::SearchIndex* search_index = nullptr)
+      : lv1_index_(index), search_index_(search_index) {
+    Reset();
+  }
 
   TableAccessor Access(SyllableId syllable_id, double credibility = 0.0) const;
 
@@ -147,9 +204,11 @@ class TableQuery {
   size_t level() const { return level_; }
 
  protected:
+  // the depth of the index is bounded, so is the state of the query,
+  // which is kept in place and copied without allocation.
   size_t level_ = 0;
-  Code index_code_;
-  vector<double> credibility_;
+  SyllableId index_code_[Code::kIndexCodeMaxLength] = {};
+  double credibility_[Code::kIndexCodeMaxLength + 1] = {};
 
  private:
   bool Walk(SyllableId syllable_id);
@@ -158,6 +217,23 @@ class TableQuery {
   table::TrunkIndex* lv2_index_ = nullptr;
   table::TrunkIndex* lv3_index_ = nullptr;
   table::TailIndex* lv4_index_ = nullptr;
+  table::SearchIndex* search_index_ = nullptr;
+  table::TrunkSearch* lv2_search_ = nullptr;
+  table::TrunkSearch* lv3_search_ = nullptr;
+};
+
+struct TableQueryMatch {
+  size_t end_pos;
+  TableAccessor accessor;
+};
+
+// storage for Table::Query, to be reused across queries without allocation
+// once it has grown to fit
+struct TableQueryBuffer {
+  // accessors found, in ascending order of end position
+  vector<TableQueryMatch> matches;
+  // pending states of the breadth-first search
+  vector<pair<size_t, TableQuery>> frames;
 };
 
 class Table : public MappedFile {
@@ -167,6 +243,10 @@ class Table : public MappedFile {
 
   RIME_API bool Load();
   RIME_API bool Save();
+  // faults in the syllabary, the string table and the index levels above the
+  // tail index, leaving out the entries, until cancelled.
+  // return num of pages touched.
+  RIME_API size_t Warmup(const std::atomic<bool>* cancel = nullptr);
   RIME_API bool Build(const Syllabary& syllabary,
                       const Vocabulary& vocabulary,
                       size_t num_entries,
@@ -176,13 +256,44 @@ class Table : public MappedFile {
   RIME_API string GetSyllableById(int syllable_id);
   RIME_API TableAccessor QueryWords(int syllable_id);
   RIME_API TableAccessor QueryPhrases(const Code& code);
+  RIME_API bool Query(const CompactSyllableGraph& syll_graph,
+                      size_t start_pos,
+                      TableQueryResult* result);
+  // same as above, with the results in buffer->matches
+  RIME_API bool Query(const CompactSyllableGraph& syll_graph,
+                      size_t start_pos,
+                      TableQueryBuffer* buffer);
+  // same as above, converting the graph from nested maps
   RIME_API bool Query(const SyllableGraph& syll_graph,
                       size_t start_pos,
                       TableQueryResult* result);
+  RIME_API bool Query(const SyllableGraph& syll_graph,
+                      size_t start_pos,
+                      TableQueryBuffer* buffer);
   RIME_API string GetEntryText(const table::Entry& entry);
+  // the best words completing a code prefix, or nullptr if the prefix is not
+  // in the completion index
+  RIME_API const table::CompletionNode* QueryCompletions(const string& prefix);
 
   uint32_t dict_file_checksum() const;
   table::Metadata* metadata() const { return metadata_; }
+  // whether the entries of each code are in descending order of weight, so
+  // that the best of them come first. entries are stored in the order of the
+  // vocabulary, which is kept as is with `sort: original`.
+  bool entries_sorted_by_weight() const;
+  // set before building to index the best max_entries words completing each
+  // code prefix of up to max_prefix_length letters
+  void set_completion_index(size_t max_prefix_length, size_t max_entries) {
+    completion_prefix_length_ = max_prefix_length;
+    completion_max_entries_ = max_entries;
+  }
+  table::CompletionIndex* completion_index() const {
+    return completion_index_;
+  }
+  // set before building whether to add a search index for the trunk indices,
+  // which is built by default
+  void set_search_index(bool enabled) { search_index_enabled_ = enabled; }
+  table::SearchIndex* search_index() const { return search_index_; }
 
  private:
   table::Index* BuildIndex(const Vocabulary& vocabulary, size_t num_syllables);
@@ -198,6 +309,12 @@ class Table : public MappedFile {
   Array<table::Entry>* BuildEntryArray(const ShortDictEntryList& entries);
   bool BuildEntryList(const ShortDictEntryList& src, List<table::Entry>* dest);
   bool BuildEntry(const ShortDictEntry& dict_entry, table::Entry* entry);
+  table::CompletionIndex* BuildCompletionIndex(const Syllabary& syllabary,
+                                               const Vocabulary& vocabulary);
+  table::SearchIndex* BuildSearchIndex(const Vocabulary& vocabulary,
+                                       size_t num_syllables);
+  table::TrunkSearch* BuildTrunkSearch(const Code& prefix,
+                                       const Vocabulary& vocabulary);
 
   string GetString(const table::StringType& x);
   bool AddString(const string& src, table::StringType* dest, double weight);
@@ -209,6 +326,11 @@ class Table : public MappedFile {
   table::Metadata* metadata_ = nullptr;
   table::Syllabary* syllabary_ = nullptr;
   table::Index* index_ = nullptr;
+  table::CompletionIndex* completion_index_ = nullptr;
+  table::SearchIndex* search_index_ = nullptr;
+  bool search_index_enabled_ = true;
+  size_t completion_prefix_length_ = 0;
+  size_t completion_max_entries_ = 0;
 
   the<StringTable> string_table_;
   the<StringTableBuilder> string_table_builder_;
@@ -4,41 +4,164 @@
 //
 // 2013-04-14 GONG Chen <chen.sst@gmail.com>
 //
+#include <algorithm>
+#include <cstring>
+#include <boost/filesystem.hpp>
 #include <rime/dict/db_utils.h>
 #include <rime/dict/text_db.h>
 
 namespace rime {
 
+// TextDbData members
+
+void TextDbData::clear() {
+  buffer_.clear();
+  records_.clear();
+}
+
+void TextDbData::reserve(size_t num_records, size_t num_bytes) {
+  records_.reserve(num_records);
+  buffer_.reserve(num_bytes);
+}
+
+void TextDbData::Append(const string& key, const string& value) {
+  records_.push_back({buffer_.size(), static_cast<uint32_t>(key.length()),
+                      static_cast<uint32_t>(value.length())});
+  buffer_.append(key).append(value);
+}
+
+static int CompareBytes(const char* a,
+                        size_t a_size,
+                        const char* b,
+                        size_t b_size) {
+  int result = std::memcmp(a, b, (std::min)(a_size, b_size));
+  if (result != 0)
+    return result;
+  return a_size < b_size ? -1 : a_size > b_size ? 1 : 0;
+}
+
+int TextDbData::Compare(const Record& record, const string& key) const {
+  return CompareBytes(key_data(record), record.key_size, key.data(),
+                      key.length());
+}
+
+void TextDbData::Sort() {
+  auto less = [this](const Record& a, const Record& b) {
+    return CompareBytes(key_data(a), a.key_size, key_data(b), b.key_size) < 0;
+  };
+  auto not_less = [&less](const Record& a, const Record& b) {
+    return !less(a, b);
+  };
+  // a saved file is already in order
+  if (std::adjacent_find(records_.begin(), records_.end(), not_less) ==
+      records_.end()) {
+    return;
+  }
+  std::stable_sort(records_.begin(), records_.end(), less);
+  // of records with the same key, the last one wins
+  auto last = records_.begin();
+  for (auto it = records_.begin(); it != records_.end(); ++it) {
+    auto next = it + 1;
+    if (next == records_.end() || less(*it, *next)) {
+      *last++ = *it;
+    }
+  }
+  records_.erase(last, records_.end());
+}
+
+TextDbData::const_iterator TextDbData::lower_bound(const string& key) const {
+  return std::lower_bound(records_.begin(), records_.end(), key,
+                          [this](const Record& record, const string& target) {
+                            return Compare(record, target) < 0;
+                          });
+}
+
+TextDbData::const_iterator TextDbData::find(const string& key) const {
+  auto it = lower_bound(key);
+  return it != records_.end() && Compare(*it, key) == 0 ? it : records_.end();
+}
+
+// appends records in bulk, to be sorted once the file is read
+class TextDbLoader : public Sink {
+ public:
+  TextDbLoader(TextDbData* data, TextDbUpdates* metadata)
+      : data_(data), metadata_(metadata) {}
+
+  virtual bool MetaPut(const string& key, const string& value) {
+    (*metadata_)[key].value = value;
+    return true;
+  }
+  virtual bool Put(const string& key, const string& value) {
+    data_->Append(key, value);
+    return true;
+  }
+
+ private:
+  TextDbData* data_;
+  TextDbUpdates* metadata_;
+};
+
 // TextDbAccessor members
 
-TextDbAccessor::TextDbAccessor(const TextDbData& data, const string& prefix)
-    : DbAccessor(prefix), data_(data) {
+TextDbAccessor::TextDbAccessor(an<const TextDbData> data,
+                               an<const TextDbUpdates> updates,
+                               const string& prefix)
+    : DbAccessor(prefix), data_(std::move(data)), updates_(std::move(updates)) {
   Reset();
 }
 
 TextDbAccessor::~TextDbAccessor() {}
 
 bool TextDbAccessor::Reset() {
-  iter_ = prefix_.empty() ? data_.begin() : data_.lower_bound(prefix_);
-  return iter_ != data_.end();
+  return Jump(prefix_);
 }
 
 bool TextDbAccessor::Jump(const string& key) {
-  iter_ = data_.lower_bound(key);
-  return iter_ != data_.end();
+  data_iter_ = key.empty() ? data_->begin() : data_->lower_bound(key);
+  update_iter_ = key.empty() ? updates_->begin() : updates_->lower_bound(key);
+  Skip();
+  return !at_end();
+}
+
+void TextDbAccessor::Skip() {
+  while (update_iter_ != updates_->end()) {
+    int order = data_iter_ == data_->end()
+                    ? 1
+                    : data_->Compare(*data_iter_, update_iter_->first);
+    if (order < 0)
+      return;
+    if (order == 0)
+      ++data_iter_;  // replaced
+    if (!update_iter_->second.erased)
+      return;
+    ++update_iter_;
+  }
 }
 
 bool TextDbAccessor::GetNextRecord(string* key, string* value) {
   if (!key || !value || exhausted())
     return false;
-  *key = iter_->first;
-  *value = iter_->second;
-  ++iter_;
+  if (at_update()) {
+    *key = update_iter_->first;
+    *value = update_iter_->second.value;
+    ++update_iter_;
+  } else {
+    key->assign(data_->key_data(*data_iter_), data_iter_->key_size);
+    value->assign(data_->value_data(*data_iter_), data_iter_->value_size);
+    ++data_iter_;
+  }
+  Skip();
   return true;
 }
 
 bool TextDbAccessor::exhausted() {
-  return iter_ == data_.end() || !MatchesPrefix(iter_->first);
+  if (at_end())
+    return true;
+  if (at_update())
+    return !MatchesPrefix(update_iter_->first);
+  return data_iter_->key_size < prefix_.length() ||
+         std::memcmp(data_->key_data(*data_iter_), prefix_.data(),
+                     prefix_.length()) != 0;
 }
 
 // TextDb members
@@ -57,7 +180,8 @@ TextDb::~TextDb() {
 an<DbAccessor> TextDb::QueryMetadata() {
   if (!loaded())
     return nullptr;
-  return New<TextDbAccessor>(metadata_, "");
+  return New<TextDbAccessor>(New<TextDbData>(), New<TextDbUpdates>(metadata_),
+                             "");
 }
 
 an<DbAccessor> TextDb::QueryAll() {
@@ -67,16 +191,23 @@ an<DbAccessor> TextDb::QueryAll() {
 an<DbAccessor> TextDb::Query(const string& key) {
   if (!loaded())
     return nullptr;
-  return New<TextDbAccessor>(data_, key);
+  return New<TextDbAccessor>(data_, updates_, key);
 }
 
 bool TextDb::Fetch(const string& key, string* value) {
   if (!value || !loaded())
     return false;
-  TextDbData::const_iterator it = data_.find(key);
-  if (it == data_.end())
+  auto update = updates_->find(key);
+  if (update != updates_->end()) {
+    if (update->second.erased)
+      return false;
+    *value = update->second.value;
+    return true;
+  }
+  auto it = data_->find(key);
+  if (it == data_->end())
     return false;
-  *value = it->second;
+  *value = data_->value(*it);
   return true;
 }
 
@@ -84,7 +215,9 @@ bool TextDb::Update(const string& key, const string& value) {
   if (!loaded() || readonly())
     return false;
   DLOG(INFO) << "update db entry: " << key << " => " << value;
-  data_[key] = value;
+  auto& update = (*updates_)[key];
+  update.value = value;
+  update.erased = false;
   modified_ = true;
   return true;
 }
@@ -93,8 +226,17 @@ bool TextDb::Erase(const string& key) {
   if (!loaded() || readonly())
     return false;
   DLOG(INFO) << "erase db entry: " << key;
-  if (data_.erase(key) == 0)
-    return false;
+  auto update = updates_->find(key);
+  if (update != updates_->end()) {
+    if (update->second.erased)
+      return false;
+  } else {
+    if (data_->find(key) == data_->end())
+      return false;
+    update = updates_->emplace(key, TextDbUpdate()).first;
+  }
+  update->second.value.clear();
+  update->second.erased = true;
   modified_ = true;
   return true;
 }
@@ -150,7 +292,9 @@ bool TextDb::Close() {
 
 void TextDb::Clear() {
   metadata_.clear();
-  data_.clear();
+  // left to accessors still reading them
+  data_ = New<TextDbData>();
+  updates_ = New<TextDbUpdates>();
 }
 
 bool TextDb::Backup(const string& snapshot_file) {
@@ -184,10 +328,10 @@ bool TextDb::CreateMetadata() {
 bool TextDb::MetaFetch(const string& key, string* value) {
   if (!value || !loaded())
     return false;
-  TextDbData::const_iterator it = metadata_.find(key);
+  auto it = metadata_.find(key);
   if (it == metadata_.end())
     return false;
-  *value = it->second;
+  *value = it->second.value;
   return true;
 }
 
@@ -195,7 +339,7 @@ bool TextDb::MetaUpdate(const string& key, const string& value) {
   if (!loaded() || readonly())
     return false;
   DLOG(INFO) << "update db metadata: " << key << " => " << value;
-  metadata_[key] = value;
+  metadata_[key].value = value;
   modified_ = true;
   return true;
 }
@@ -203,14 +347,22 @@ bool TextDb::MetaUpdate(const string& key, const string& value) {
 bool TextDb::LoadFromFile(const string& file) {
   Clear();
   TsvReader reader(file, format_.parser);
-  DbSink sink(this);
+  TextDbLoader sink(data_.get(), &metadata_);
   int entries = 0;
+  boost::system::error_code ec;
+  auto file_size = boost::filesystem::file_size(file, ec);
+  if (!ec) {
+    // roughly a record per 30 bytes of text
+    data_->reserve(file_size / 30, file_size);
+  }
   try {
     entries = reader >> sink;
   } catch (std::exception& ex) {
     LOG(ERROR) << ex.what();
+    Clear();
     return false;
   }
+  data_->Sort();
   DLOG(INFO) << entries << " entries loaded.";
   return true;
 }
@@ -227,7 +379,24 @@ bool TextDb::SaveToFile(const string& file) {
     return false;
   }
   DLOG(INFO) << entries << " entries saved.";
+  MergeUpdates();
   return true;
 }
 
+void TextDb::MergeUpdates() {
+  if (updates_->empty())
+    return;
+  auto merged = New<TextDbData>();
+  merged->reserve(data_->size() + updates_->size(), 0);
+  TextDbAccessor accessor(data_, updates_, "");
+  string key, value;
+  while (accessor.GetNextRecord(&key, &value)) {
+    merged->Append(key, value);
+  }
+  // already in order
+  merged->Sort();
+  data_ = merged;
+  updates_ = New<TextDbUpdates>();
+}
+
 }  // namespace rime
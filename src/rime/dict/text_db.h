@@ -14,11 +14,65 @@ namespace rime {
 
 class TextDb;
 
-using TextDbData = map<string, string>;
+// records sorted by key, with keys and values packed in a single buffer
+class TextDbData {
+ public:
+  struct Record {
+    size_t offset;
+    uint32_t key_size;
+    uint32_t value_size;
+  };
+  using const_iterator = vector<Record>::const_iterator;
+
+  void clear();
+  void reserve(size_t num_records, size_t num_bytes);
+  // appends a record in any order; call Sort() after the last one
+  void Append(const string& key, const string& value);
+  // sorts records by key, keeping the last appended of duplicate keys
+  void Sort();
+
+  bool empty() const { return records_.empty(); }
+  size_t size() const { return records_.size(); }
+  const_iterator begin() const { return records_.begin(); }
+  const_iterator end() const { return records_.end(); }
+  const_iterator lower_bound(const string& key) const;
+  const_iterator find(const string& key) const;
+
+  const char* key_data(const Record& record) const {
+    return &buffer_[record.offset];
+  }
+  const char* value_data(const Record& record) const {
+    return &buffer_[record.offset + record.key_size];
+  }
+  string key(const Record& record) const {
+    return string(key_data(record), record.key_size);
+  }
+  string value(const Record& record) const {
+    return string(value_data(record), record.value_size);
+  }
+  // compares the key of the record with the given key, as strcmp does
+  int Compare(const Record& record, const string& key) const;
+
+ private:
+  string buffer_;
+  vector<Record> records_;
+};
+
+// a record written since the data was loaded, or a deletion
+struct TextDbUpdate {
+  string value;
+  bool erased = false;
+};
+
+using TextDbUpdates = map<string, TextDbUpdate>;
 
 class TextDbAccessor : public DbAccessor {
  public:
-  TextDbAccessor(const TextDbData& data, const string& prefix);
+  // merges the updates over the loaded data, which the accessor keeps
+  // after the db has merged them on saving
+  TextDbAccessor(an<const TextDbData> data,
+                 an<const TextDbUpdates> updates,
+                 const string& prefix);
   virtual ~TextDbAccessor();
 
   virtual bool Reset();
@@ -27,8 +81,22 @@ class TextDbAccessor : public DbAccessor {
   virtual bool exhausted();
 
  private:
-  const TextDbData& data_;
-  TextDbData::const_iterator iter_;
+  // skips deleted records, and loaded records replaced by updates
+  void Skip();
+  bool at_end() const {
+    return data_iter_ == data_->end() && update_iter_ == updates_->end();
+  }
+  // whether the record at the cursor comes from the updates
+  bool at_update() const {
+    return update_iter_ != updates_->end() &&
+           (data_iter_ == data_->end() ||
+            data_->Compare(*data_iter_, update_iter_->first) > 0);
+  }
+
+  an<const TextDbData> data_;
+  an<const TextDbUpdates> updates_;
+  TextDbData::const_iterator data_iter_;
+  TextDbUpdates::const_iterator update_iter_;
 };
 
 struct TextFormat {
@@ -63,15 +131,24 @@ class TextDb : public Db {
   RIME_API virtual bool Update(const string& key, const string& value);
   RIME_API virtual bool Erase(const string& key);
 
+  size_t num_updates() const { return updates_->size(); }
+
  protected:
   void Clear();
   bool LoadFromFile(const string& file);
   bool SaveToFile(const string& file);
+  // folds the updates into the loaded records
+  void MergeUpdates();
 
   string db_type_;
   TextFormat format_;
-  TextDbData metadata_;
-  TextDbData data_;
+  // metadata are few, and kept with the updates only
+  TextDbUpdates metadata_;
+  // records loaded from the file in bulk
+  an<TextDbData> data_ = New<TextDbData>();
+  // written since loading or saving, and merged with the loaded records
+  // once saved
+  an<TextDbUpdates> updates_ = New<TextDbUpdates>();
   bool modified_ = false;
 };
 
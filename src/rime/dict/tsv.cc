@@ -4,53 +4,95 @@
 //
 // 2013-04-14 GONG Chen <chen.sst@gmail.com>
 //
+#include <cctype>
+#include <cstring>
 #include <fstream>
-#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <rime/common.h>
 #include <rime/dict/db_utils.h>
 #include <rime/dict/tsv.h>
 
 namespace rime {
 
+// splits a line into tab separated fields, reusing the strings in the row
+static void SplitRow(const char* begin, const char* end, Tsv* row) {
+  size_t num_fields = 0;
+  for (const char* p = begin;; ++p) {
+    auto tab = static_cast<const char*>(std::memchr(p, '\t', end - p));
+    if (!tab)
+      tab = end;
+    if (row->size() == num_fields)
+      row->emplace_back();
+    (*row)[num_fields++].assign(p, tab);
+    if (tab == end)
+      break;
+    p = tab;
+  }
+  row->resize(num_fields);
+}
+
 int TsvReader::operator()(Sink* sink) {
   if (!sink)
     return 0;
   LOG(INFO) << "reading tsv file: " << path_;
-  std::ifstream fin(path_.c_str());
-  string line, key, value;
+  boost::system::error_code ec;
+  auto file_size = boost::filesystem::file_size(path_, ec);
+  if (ec || file_size == 0)
+    return 0;
+  // the whole file is mapped into memory and parsed in place
+  using namespace boost::interprocess;
+  mapped_region region;
+  try {
+    file_mapping file(path_.c_str(), read_only);
+    mapped_region(file, read_only).swap(region);
+  } catch (interprocess_exception& ex) {
+    LOG(ERROR) << "error mapping tsv file '" << path_ << "': " << ex.what();
+    return 0;
+  }
+  const char* p = static_cast<const char*>(region.get_address());
+  const char* const file_end = p + region.get_size();
+  string key, value;
   Tsv row;
   int line_no = 0;
   int num_entries = 0;
   bool enable_comment = true;
-  while (getline(fin, line)) {
+  for (const char* next = p; p < file_end; p = next) {
+    auto line_end =
+        static_cast<const char*>(std::memchr(p, '\n', file_end - p));
+    if (!line_end)
+      line_end = file_end;
+    next = line_end + 1;
     ++line_no;
-    boost::algorithm::trim_right(line);
+    // trim right
+    while (line_end > p &&
+           std::isspace(static_cast<unsigned char>(line_end[-1])))
+      --line_end;
     // skip empty lines and comments
-    if (line.empty())
+    if (line_end == p)
       continue;
-    if (enable_comment && line[0] == '#') {
-      if (boost::starts_with(line, "#@")) {
+    if (enable_comment && *p == '#') {
+      if (line_end - p >= 2 && p[1] == '@') {
         // metadata
-        line.erase(0, 2);
-        boost::algorithm::split(row, line, boost::algorithm::is_any_of("\t"));
+        SplitRow(p + 2, line_end, &row);
         if (row.size() != 2 || !sink->MetaPut(row[0], row[1])) {
           LOG(WARNING) << "invalid metadata at line " << line_no << ".";
         }
-      } else if (line == "# no comment") {
+      } else if (string(p, line_end) == "# no comment") {
         // a "# no comment" line disables further comments
         enable_comment = false;
       }
       continue;
     }
     // read a tsv entry
-    boost::algorithm::split(row, line, boost::algorithm::is_any_of("\t"));
+    SplitRow(p, line_end, &row);
     if (!parser_(row, &key, &value) || !sink->Put(key, value)) {
       LOG(WARNING) << "invalid entry at line " << line_no << ".";
       continue;
     }
     ++num_entries;
   }
-  fin.close();
   return num_entries;
 }
 
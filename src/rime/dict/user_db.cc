@@ -4,7 +4,12 @@
 //
 // 2011-11-02 GONG Chen <chen.sst@gmail.com>
 //
-#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <locale>
+#include <sstream>
+#include <type_traits>
 #include <boost/algorithm/string.hpp>
 #include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
@@ -19,32 +24,188 @@ UserDbValue::UserDbValue(const string& value) {
   Unpack(value);
 }
 
+// binary encoding of a user db value:
+// tag (1 byte) | commits (int32) | dee (float64) | tick (uint64)
+// where multi-byte fields are stored in little-endian byte order.
+// the tag also serves as the version of the encoding; it never begins a
+// value in the legacy text form.
+static const char kBinaryValueTag = '\x01';
+static const size_t kBinaryValueSize = 1 + 4 + 8 + 8;
+
+const char UserDbValue::kBinaryFormat[] = "binary/1";
+
+static inline void put_uint32(char* p, uint32_t x) {
+  for (int i = 0; i < 4; ++i)
+    p[i] = static_cast<char>(x >> (8 * i));
+}
+
+static inline void put_uint64(char* p, uint64_t x) {
+  for (int i = 0; i < 8; ++i)
+    p[i] = static_cast<char>(x >> (8 * i));
+}
+
+static inline uint32_t get_uint32(const char* p) {
+  uint32_t x = 0;
+  for (int i = 3; i >= 0; --i)
+    x = (x << 8) | static_cast<unsigned char>(p[i]);
+  return x;
+}
+
+static inline uint64_t get_uint64(const char* p) {
+  uint64_t x = 0;
+  for (int i = 7; i >= 0; --i)
+    x = (x << 8) | static_cast<unsigned char>(p[i]);
+  return x;
+}
+
 string UserDbValue::Pack() const {
-  return boost::str(boost::format("c=%1% d=%2% t=%3%") % commits % dee % tick);
+  string value(kBinaryValueSize, kBinaryValueTag);
+  uint64_t dee_bits;
+  std::memcpy(&dee_bits, &dee, sizeof(dee_bits));
+  put_uint32(&value[1], static_cast<uint32_t>(commits));
+  put_uint64(&value[5], dee_bits);
+  put_uint64(&value[13], tick);
+  return value;
+}
+
+string UserDbValue::PackText() const {
+  return boost::str(boost::format("c=%1% d=%2% t=%3%", std::locale::classic()) %
+                    commits % dee % tick);
+}
+
+bool UserDbValue::IsBinary(const string& value) {
+  return !value.empty() && value[0] == kBinaryValueTag;
+}
+
+static inline bool is_digit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// parses an integer of up to 18 digits in place
+template <class T>
+static bool parse_plain_number(const char* begin, const char* end, T* x) {
+  const char* p = begin;
+  bool negative = p < end && *p == '-';
+  if (negative && !std::is_signed<T>::value)
+    return false;
+  if (negative || (p < end && *p == '+'))
+    ++p;
+  if (p == end || end - p > 18)
+    return false;
+  uint64_t n = 0;
+  for (; p < end; ++p) {
+    if (!is_digit(*p))
+      return false;
+    n = n * 10 + (*p - '0');
+  }
+  if (n > static_cast<uint64_t>((std::numeric_limits<T>::max)()))
+    return false;
+  *x = negative ? -static_cast<T>(n) : static_cast<T>(n);
+  return true;
+}
+
+// parses a decimal of up to 15 significant digits, times a power of 10 up to
+// 22, in place. such numbers, which include those written with the default
+// precision, are exact in double, so the result is rounded only once.
+static bool parse_plain_number(const char* begin,
+                               const char* end,
+                               double* x) {
+  static const double kPowersOf10[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+  };
+  const int kMaxPower = 22;
+  const char* p = begin;
+  bool negative = p < end && *p == '-';
+  if (negative || (p < end && *p == '+'))
+    ++p;
+  uint64_t mantissa = 0;
+  int num_digits = 0;
+  int exponent = 0;
+  for (; p < end && is_digit(*p); ++p, ++num_digits) {
+    mantissa = mantissa * 10 + (*p - '0');
+  }
+  if (p < end && *p == '.') {
+    for (++p; p < end && is_digit(*p); ++p, ++num_digits, --exponent) {
+      mantissa = mantissa * 10 + (*p - '0');
+    }
+  }
+  if (num_digits == 0 || num_digits > 15)
+    return false;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    int power = 0;
+    if (!parse_plain_number(p + 1, end, &power) || std::abs(power) > 99)
+      return false;
+    exponent += power;
+    p = end;
+  }
+  if (p != end || std::abs(exponent) > kMaxPower)
+    return false;
+  double value = static_cast<double>(mantissa);
+  value = exponent < 0 ? value / kPowersOf10[-exponent]
+                       : value * kPowersOf10[exponent];
+  *x = negative ? -value : value;
+  return true;
+}
+
+// values are written in the classic locale, whatever the user's locale says
+// about decimal points
+template <class T>
+static bool parse_number(const char* begin, const char* end, T* x) {
+  if (begin == end)
+    return false;
+  if (parse_plain_number(begin, end, x))
+    return true;
+  // of more digits than librime writes
+  std::istringstream stream(string(begin, end));
+  stream.imbue(std::locale::classic());
+  stream >> *x;
+  return !stream.fail() && stream.peek() == std::char_traits<char>::eof();
 }
 
 bool UserDbValue::Unpack(const string& value) {
-  vector<string> kv;
-  boost::split(kv, value, boost::is_any_of(" "));
-  for (const string& k_eq_v : kv) {
-    size_t eq = k_eq_v.find('=');
-    if (eq == string::npos)
-      continue;
-    string k(k_eq_v.substr(0, eq));
-    string v(k_eq_v.substr(eq + 1));
-    try {
-      if (k == "c") {
-        commits = boost::lexical_cast<int>(v);
-      } else if (k == "d") {
-        dee = (std::min)(10000.0, boost::lexical_cast<double>(v));
-      } else if (k == "t") {
-        tick = boost::lexical_cast<TickCount>(v);
-      }
-    } catch (...) {
-      LOG(ERROR) << "failed in parsing key-value from userdb entry '" << k_eq_v
-                 << "'.";
+  if (IsBinary(value)) {
+    if (value.length() != kBinaryValueSize) {
+      LOG(ERROR) << "invalid binary userdb value of " << value.length()
+                 << " bytes.";
       return false;
     }
+    const char* p = value.data();
+    uint64_t dee_bits = get_uint64(p + 5);
+    double d;
+    std::memcpy(&d, &dee_bits, sizeof(d));
+    commits = static_cast<int32_t>(get_uint32(p + 1));
+    dee = (std::min)(10000.0, d);
+    tick = get_uint64(p + 13);
+    return true;
+  }
+  // legacy text form: space separated key=value pairs
+  const char* end = value.c_str() + value.length();
+  for (const char* p = value.c_str(); p < end;) {
+    const char* token_end = std::find(p, end, ' ');
+    const char* eq = std::find(p, token_end, '=');
+    if (eq - p == 1 && eq != token_end) {
+      const char* v = eq + 1;
+      bool parsed = true;
+      switch (*p) {
+        case 'c':
+          parsed = parse_number(v, token_end, &commits);
+          break;
+        case 'd':
+          parsed = parse_number(v, token_end, &dee);
+          dee = (std::min)(10000.0, dee);
+          break;
+        case 't':
+          parsed = parse_number(v, token_end, &tick);
+          break;
+      }
+      if (!parsed) {
+        LOG(ERROR) << "failed in parsing key-value from userdb entry '"
+                   << string(p, token_end) << "'.";
+        return false;
+      }
+    }
+    p = token_end + 1;
   }
   return true;
 }
@@ -85,7 +246,9 @@ static bool userdb_entry_formatter(const string& key,
   boost::algorithm::split(row, key, boost::algorithm::is_any_of("\t"));
   if (row.size() != 2 || row[0].empty() || row[1].empty())
     return false;
-  row.push_back(value);
+  // keep text snapshots portable
+  row.push_back(UserDbValue::IsBinary(value) ? UserDbValue(value).PackText()
+                                             : value);
   return true;
 }
 
@@ -105,6 +268,17 @@ bool UserDbHelper::UpdateUserInfo() {
   return db_->MetaUpdate("/user_id", deployer.user_id);
 }
 
+bool UserDbHelper::UpdateValueFormat() {
+  // saved in the text form
+  if (dynamic_cast<TextDb*>(db_))
+    return true;
+  string format;
+  if (db_->MetaFetch("/value_format", &format) &&
+      format == UserDbValue::kBinaryFormat)
+    return true;
+  return db_->MetaUpdate("/value_format", UserDbValue::kBinaryFormat);
+}
+
 bool UserDbHelper::IsUniformFormat(const string& file_name) {
   return boost::ends_with(file_name, plain_userdb_extension);
 }
@@ -181,6 +355,9 @@ UserDbMerger::UserDbMerger(Db* db) : db_(db) {
   our_tick_ = get_tick_count(db);
   their_tick_ = 0;
   max_tick_ = our_tick_;
+  // merged values are written in the binary encoding
+  if (db_)
+    UserDbHelper(db_).UpdateValueFormat();
 }
 
 UserDbMerger::~UserDbMerger() {
@@ -236,7 +413,11 @@ void UserDbMerger::CloseMerge() {
   merged_entries_ = 0;
 }
 
-UserDbImporter::UserDbImporter(Db* db) : db_(db) {}
+UserDbImporter::UserDbImporter(Db* db) : db_(db) {
+  // imported values are written in the binary encoding
+  if (db_)
+    UserDbHelper(db_).UpdateValueFormat();
+}
 
 bool UserDbImporter::MetaPut(const string& key, const string& value) {
   return true;
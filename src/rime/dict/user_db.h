@@ -17,7 +17,19 @@ namespace rime {
 using TickCount = uint64_t;
 
 /// Properties of a user db entry value.
+///
+/// Values are stored in a compact fixed-width binary encoding, tagged with
+/// a version byte. Values in the legacy text form "c=%1% d=%2% t=%3%" can
+/// still be unpacked; they are rewritten in binary as they get updated.
+///
+/// The upgrade is one-way: earlier versions of librime, and plugins parsing
+/// raw values in the text form, misread binary values. A db that may hold
+/// them is marked with the encoding under "/value_format" in its metadata.
+/// Text dbs and snapshots keep values in the text form.
 struct UserDbValue {
+  /// The encoding recorded in the metadata of a db holding binary values.
+  static const char kBinaryFormat[];
+
   int commits = 0;
   double dee = 0.0;
   TickCount tick = 0;
@@ -25,8 +37,15 @@ struct UserDbValue {
   UserDbValue() = default;
   UserDbValue(const string& value);
 
+  /// Packs in the binary encoding.
   string Pack() const;
+  /// Packs in the legacy text form, used in portable text snapshots.
+  string PackText() const;
+  /// Unpacks a value in either encoding. Neither allocates memory, unless
+  /// a number in the text form is written otherwise than librime does.
   bool Unpack(const string& value);
+
+  static bool IsBinary(const string& value);
 };
 
 /**
@@ -62,6 +81,9 @@ class UserDbHelper {
   UserDbHelper(const an<Db>& db) : db_(db.get()) {}
 
   RIME_API bool UpdateUserInfo();
+  /// Marks the db as holding values in the binary encoding, unless it is
+  /// saved in the text form.
+  RIME_API bool UpdateValueFormat();
   RIME_API static bool IsUniformFormat(const string& name);
   RIME_API bool UniformBackup(const string& snapshot_file);
   RIME_API bool UniformRestore(const string& snapshot_file);
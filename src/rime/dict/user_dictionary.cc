@@ -5,12 +5,15 @@
 // 2011-10-30 GONG Chen <chen.sst@gmail.com>
 //
 #include <algorithm>
+#include <atomic>
 #include <cfloat>
+#include <climits>
 #include <cmath>
+#include <cstring>
+#include <mutex>
 #include <utf8.h>
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/scope_exit.hpp>
 #include <rime/common.h>
 #include <rime/language.h>
 #include <rime/schema.h>
@@ -19,65 +22,568 @@
 #include <rime/algo/dynamics.h>
 #include <rime/algo/syllabifier.h>
 #include <rime/dict/db.h>
+#include <rime/dict/level_db.h>
 #include <rime/dict/table.h>
 #include <rime/dict/user_dictionary.h>
 #include <rime/gear/unity_table_encoder.h>
 
 namespace rime {
 
+static const char kConsonants[] = "qwrtsdfgzxcvbyphjklnm";
+static const char kCapitalConsonants[] = "QWRTSDFGZXCVBYPHJKLNM";
+static const char kVowels[] = "aeuio";
+static const char kVowelDigits[] = "23789";
+// length of the "\x7f" "enc\x1f" prefix of encoded phrases
+static const size_t kEncodedPrefixLength = 5;
+
+static inline bool is_one_of(char c, const char* chars) {
+  return c != '\0' && std::strchr(chars, c) != nullptr;
+}
+
+static inline bool is_consonant(char c) {
+  return is_one_of(c, kConsonants);
+}
+
+static inline bool is_capital_consonant(char c) {
+  return is_one_of(c, kCapitalConsonants);
+}
+
+static inline bool is_vowel(char c) {
+  return is_one_of(c, kVowels);
+}
+
+static inline bool is_vowel_digit(char c) {
+  return is_one_of(c, kVowelDigits);
+}
+
+// equivalent to matching key.substr(pos, count) against [consonants]{count}
+static bool all_consonants(const string& key, size_t pos, size_t count) {
+  if (pos + count > key.length())
+    return false;
+  for (size_t i = pos; i < pos + count; ++i) {
+    if (!is_consonant(key[i]))
+      return false;
+  }
+  return true;
+}
+
+UserDictProfile UserDictProfile::Resolve(const string& dict_name) {
+  UserDictProfile profile;
+  if (dict_name == "sbjm") {
+    profile.scheme = kSbjm;
+    profile.seek_length = 3;
+  } else if (dict_name == "sbfx") {
+    profile.scheme = kSbfx;
+    profile.seek_length = 3;
+  } else if (dict_name == "sbzr" || dict_name == "sbxh" ||
+             dict_name == "sbfm" || dict_name == "sbfd") {
+    profile.scheme = kSbzr;
+    profile.seek_length = 4;
+  }
+  return profile;
+}
+
+using DbRecords = vector<pair<string, string>>;
+
+static DbRecords::const_iterator seek_record(const DbRecords& records,
+                                             const string& key) {
+  return std::lower_bound(
+      records.begin(), records.end(), key,
+      [](const pair<string, string>& record, const string& key) {
+        return record.first < key;
+      });
+}
+
+// merges entries in the write-behind buffer of a user dictionary with those
+// read from the db; a pending update takes precedence over the stored value.
+class PendingUpdatesAccessor : public DbAccessor {
+ public:
+  PendingUpdatesAccessor(an<DbAccessor> db_accessor,
+                         an<const DbRecords> pending_updates,
+                         const string& prefix)
+      : DbAccessor(prefix),
+        db_accessor_(db_accessor),
+        pending_updates_(pending_updates) {
+    iter_ = seek_record(*pending_updates_, prefix_);
+    FetchStoredRecord();
+  }
+
+  bool Reset() override {
+    db_accessor_->Reset();
+    iter_ = seek_record(*pending_updates_, prefix_);
+    FetchStoredRecord();
+    return !exhausted();
+  }
+
+  bool Jump(const string& key) override {
+    bool success = db_accessor_->Jump(key);
+    iter_ = seek_record(*pending_updates_, key);
+    FetchStoredRecord();
+    return success || iter_ != pending_updates_->end();
+  }
+
+  bool GetNextRecord(string* key, string* value) override {
+    if (!key || !value)
+      return false;
+    bool has_pending = HasPendingRecord();
+    if (!has_pending && !has_stored_) {
+      return false;
+    }
+    if (has_pending && (!has_stored_ || iter_->first <= stored_key_)) {
+      if (has_stored_ && iter_->first == stored_key_) {
+        FetchStoredRecord();  // overridden by the pending update
+      }
+      *key = iter_->first;
+      *value = iter_->second;
+      ++iter_;
+    } else {
+      key->swap(stored_key_);
+      value->swap(stored_value_);
+      FetchStoredRecord();
+    }
+    return true;
+  }
+
+  bool exhausted() override { return !has_stored_ && !HasPendingRecord(); }
+
+ private:
+  bool HasPendingRecord() {
+    return iter_ != pending_updates_->end() && MatchesPrefix(iter_->first);
+  }
+
+  void FetchStoredRecord() {
+    has_stored_ = db_accessor_->GetNextRecord(&stored_key_, &stored_value_);
+  }
+
+  an<DbAccessor> db_accessor_;
+  // a copy of the pending updates under the prefix when the query is made
+  an<const DbRecords> pending_updates_;
+  DbRecords::const_iterator iter_;
+  bool has_stored_ = false;
+  string stored_key_;
+  string stored_value_;
+};
+
+// records of a query to the user db, cached in memory
+class DbRecordsAccessor : public DbAccessor {
+ public:
+  DbRecordsAccessor(an<const DbRecords> records, const string& prefix)
+      : DbAccessor(prefix), records_(records) {
+    Reset();
+  }
+
+  bool Reset() override {
+    iter_ = records_->begin();
+    return iter_ != records_->end();
+  }
+
+  bool Jump(const string& key) override {
+    iter_ = seek_record(*records_, key);
+    return iter_ != records_->end();
+  }
+
+  bool GetNextRecord(string* key, string* value) override {
+    if (!key || !value || exhausted())
+      return false;
+    *key = iter_->first;
+    *value = iter_->second;
+    ++iter_;
+    return true;
+  }
+
+  bool exhausted() override { return iter_ == records_->end(); }
+
+ private:
+  an<const DbRecords> records_;
+  DbRecords::const_iterator iter_;
+};
+
+// queries with more records than this are not cached
+static const size_t kMaxCachedRecords = 500;
+
+// a bounded LRU cache of the records by query prefix. the db values are
+// cached rather than the entries made of them, since the weight of an entry
+// decays with the tick count, and its code and credibility come from the
+// lookup recruiting it; the values are parsed without allocation anyway.
+// the write buffer of the db drops the queries that an update to it may
+// change, for all the dictionaries on it. lookups may be made on different
+// threads.
+class UserDictQueryCache {
+ public:
+  explicit UserDictQueryCache(size_t capacity) : capacity_(capacity) {}
+
+  // on a miss, *generation receives the token to insert the query with
+  an<const DbRecords> Find(const string& prefix, size_t* generation) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = index_.find(prefix);
+    if (found == index_.end()) {
+      ++misses_;
+      *generation = generation_;
+      return nullptr;
+    }
+    auto entry = found->second;
+    entries_.splice(entries_.begin(), entries_, entry);
+    ++hits_;
+    return entry->records;
+  }
+
+  // the records are dropped if the db has changed since Find()
+  void Insert(const string& prefix,
+              an<const DbRecords> records,
+              size_t generation) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation != generation_ || index_.find(prefix) != index_.end())
+      return;
+    entries_.push_front({prefix, records});
+    index_[prefix] = entries_.begin();
+    if (entries_.size() > capacity_) {
+      index_.erase(entries_.back().prefix);
+      entries_.pop_back();
+    }
+  }
+
+  // drops the cached queries whose results may contain the key
+  void Invalidate(const string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++generation_;
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      if (boost::starts_with(key, it->prefix)) {
+        index_.erase(it->prefix);
+        it = entries_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  // keeps the queries in progress from being cached, which may have read
+  // the db and the pending updates on either side of a flush
+  void Renew() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++generation_;
+  }
+
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+ private:
+  struct Entry {
+    string prefix;
+    an<const DbRecords> records;
+  };
+  size_t capacity_;
+  std::mutex mutex_;
+  list<Entry> entries_;
+  hash_map<string, list<Entry>::iterator> index_;
+  size_t generation_ = 0;
+  std::atomic<size_t> hits_{0};
+  std::atomic<size_t> misses_{0};
+};
+
+// updates to a user db kept in memory to be written in a batch, where
+// repeated updates to the same key are coalesced. the user dictionaries
+// opened on the same db share one buffer and the tick count in it, so that
+// none of them overwrites the updates of another with older values, or the
+// stored tick count with a smaller one. UserDictionaryComponent pools the
+// buffers by dict name.
+class UserDictWriteBuffer {
+ public:
+  explicit UserDictWriteBuffer(an<Db> db) : db_(db) {}
+
+  const an<Db>& db() const { return db_; }
+
+  // the cached queries are invalidated by the updates to the db
+  void AttachQueryCache(const an<UserDictQueryCache>& query_cache) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    query_caches_.erase(
+        std::remove_if(query_caches_.begin(), query_caches_.end(),
+                       [](const weak<UserDictQueryCache>& query_cache) {
+                         return query_cache.expired();
+                       }),
+        query_caches_.end());
+    query_caches_.push_back(query_cache);
+  }
+
+  // the buffer is due by the shortest interval of the dictionaries on it
+  void LimitFlushInterval(int flush_interval) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    flush_interval_ = (std::min)(flush_interval_, flush_interval);
+  }
+
+  bool Fetch(const string& key, string* value) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = pending_.find(key);
+      if (it != pending_.end()) {
+        *value = it->second;
+        return true;
+      }
+    }
+    return db_->Fetch(key, value);
+  }
+
+  // the pending value replaced is copied to *previous, or cleared if none
+  void Store(const string& key, const string& value, string* previous) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MarkPending();
+    auto it = pending_.find(key);
+    if (it != pending_.end()) {
+      *previous = it->second;
+      it->second = value;
+    } else {
+      previous->clear();
+      pending_.emplace(key, value);
+    }
+    InvalidateQueries(key);
+  }
+
+  // puts back a value replaced by Store(); an empty value removes the key
+  void Restore(const string& key, const string& previous) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (previous.empty())
+      pending_.erase(key);
+    else
+      pending_[key] = previous;
+    InvalidateQueries(key);
+  }
+
+  // the pending updates under the prefix, or nullptr if there are none
+  an<const DbRecords> Snapshot(const string& prefix) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = pending_.lower_bound(prefix);
+    if (it == pending_.end() || !boost::starts_with(it->first, prefix))
+      return nullptr;
+    auto records = New<DbRecords>();
+    for (; it != pending_.end() && boost::starts_with(it->first, prefix);
+         ++it) {
+      records->emplace_back(it->first, it->second);
+    }
+    return records;
+  }
+
+  TickCount tick() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tick_;
+  }
+
+  TickCount AddTick(TickCount increment) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MarkPending();
+    tick_ += increment;
+    tick_modified_ = true;  // to be saved with the next flush
+    return tick_;
+  }
+
+  bool FetchTick() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // the in-memory tick count is newer while pending a flush
+    if (tick_modified_)
+      return true;
+    string value;
+    try {
+      // an earlier version mistakenly wrote tick count into an empty key
+      if (!db_->MetaFetch("/tick", &value) && !db_->Fetch("", &value))
+        return false;
+      tick_ = boost::lexical_cast<TickCount>(value);
+      return true;
+    } catch (...) {
+      return false;
+    }
+  }
+
+  // writes the pending updates to the db; they are kept to be written again
+  // if any of the writes fails
+  bool Flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_.empty() && !tick_modified_)
+      return true;
+    if (!db_ || !db_->loaded() || db_->readonly())
+      return false;
+    DLOG(INFO) << "flushing " << pending_.size()
+               << " pending updates to user db '" << db_->name() << "'.";
+    // write all pending updates in one batch if the db supports it
+    auto db = As<Transactional>(db_);
+    bool batch = db && !db->in_transaction() && db->BeginTransaction();
+    bool success = true;
+    if (!pending_.empty() && !value_format_updated_) {
+      success = value_format_updated_ = UserDbHelper(db_).UpdateValueFormat();
+    }
+    for (const auto& update : pending_) {
+      success = db_->Update(update.first, update.second) && success;
+    }
+    if (tick_modified_) {
+      success = db_->MetaUpdate("/tick", std::to_string(tick_)) && success;
+    }
+    if (batch) {
+      if (success)
+        success = db->CommitTransaction();
+      else
+        db->AbortTransaction();
+    }
+    for (const auto& query_cache : query_caches_) {
+      if (auto cache = query_cache.lock())
+        cache->Renew();
+    }
+    if (!success) {
+      LOG(ERROR) << "error flushing " << pending_.size()
+                 << " updates to user db '" << db_->name()
+                 << "'; to try again later.";
+      return false;
+    }
+    pending_.clear();
+    tick_modified_ = false;
+    ++flushes_;
+    return true;
+  }
+
+  bool IsFlushDue(int flush_interval, int flush_size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_.empty() && !tick_modified_)
+      return false;
+    return flush_interval <= 0 ||
+           pending_.size() >= static_cast<size_t>(flush_size) ||
+           time(NULL) - pending_since_ >= flush_interval;
+  }
+
+  // whether the pending updates have waited out the flush interval by now
+  bool IsFlushDue(time_t now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_.empty() && !tick_modified_)
+      return false;
+    return now - pending_since_ >= flush_interval_;
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size();
+  }
+
+  // the number of successful flushes, by which a transaction tells if its
+  // updates have been written
+  size_t flushes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return flushes_;
+  }
+
+ private:
+  void MarkPending() {
+    if (pending_.empty() && !tick_modified_)
+      pending_since_ = time(NULL);
+  }
+
+  // after the pending value is changed, for a query that has missed the
+  // cache to see the new value or not be cached
+  void InvalidateQueries(const string& key) {
+    for (const auto& query_cache : query_caches_) {
+      if (auto cache = query_cache.lock())
+        cache->Invalidate(key);
+    }
+  }
+
+  an<Db> db_;
+  std::mutex mutex_;
+  map<string, string> pending_;
+  TickCount tick_ = 0;
+  bool tick_modified_ = false;
+  time_t pending_since_ = 0;  // time of the earliest pending update
+  int flush_interval_ = INT_MAX;
+  size_t flushes_ = 0;
+  // whether the db is marked as holding binary values
+  bool value_format_updated_ = false;
+  vector<weak<UserDictQueryCache>> query_caches_;
+};
+
+// a path through the syllable graph that spells out the code being looked up
+struct DfsPath {
+  size_t start_pos;
+  size_t end_pos;
+  double credibility;
+};
+
+// a syllable to extend one of the paths with
+struct DfsBranch {
+  SyllableId syllable_id;
+  size_t path_index;
+  size_t spelling_index;
+  const EdgeProperties* props;
+
+  bool operator<(const DfsBranch& other) const {
+    if (syllable_id != other.syllable_id)
+      return syllable_id < other.syllable_id;
+    if (path_index != other.path_index)
+      return path_index < other.path_index;
+    return spelling_index < other.spelling_index;
+  }
+};
+
 struct DfsState {
   size_t depth_limit;
   TickCount present_tick;
   Code code;
-  vector<double> credibility;
-  map<int, DictEntryList> query_result;
+  // spelling of the code, each syllable followed by a space
+  string prefix;
+  // buffers reused across keystrokes, indexed by the depth of the code
+  vector<vector<DfsPath>> paths;
+  vector<vector<DfsBranch>> branches;
+  map<size_t, map<int, DictEntryList>> query_result;
   an<DbAccessor> accessor;
   string key;
   string value;
+  bool exhausted = false;
+  size_t seeks = 0;
 
-  bool IsExactMatch(const string& prefix) {
-    return boost::starts_with(key, prefix + '\t');
+  bool IsExactMatch(size_t prefix_length) const {
+    return key.length() > prefix_length && key[prefix_length] == '\t' &&
+           key.compare(0, prefix_length, prefix, 0, prefix_length) == 0;
   }
 
-  bool IsPrefixMatch(const string& prefix) {
-    return boost::starts_with(key, prefix);
+  bool IsPrefixMatch(size_t prefix_length) const {
+    return key.length() >= prefix_length &&
+           key.compare(0, prefix_length, prefix, 0, prefix_length) == 0;
   }
 
-  void RecruitEntry(size_t pos);
+  void RecruitEntries(const vector<DfsPath>& paths);
 
   bool NextEntry() {
     if (!accessor->GetNextRecord(&key, &value)) {
       key.clear();
       value.clear();
+      exhausted = true;
       return false;  // reached the end
     }
     return true;
   }
 
-  bool ForwardScan(const string& prefix) {
-    if (!accessor->Jump(prefix)) {
+  // moves the cursor forward to the first record not less than the prefix;
+  // all records before the cursor have been visited
+  bool ForwardScan() {
+    if (exhausted)
       return false;
-    }
-    return NextEntry();
-  }
-
-  bool Backdate(const string& prefix) {
-    DLOG(INFO) << "backdate; prefix: " << prefix;
-    if (!accessor->Reset()) {
-      LOG(WARNING) << "backdating failed for '" << prefix << "'.";
+    if (key.compare(prefix) >= 0)
+      return true;
+    DLOG(INFO) << "forward scanning for '" << prefix << "'.";
+    ++seeks;
+    if (!accessor->Jump(prefix)) {
+      exhausted = true;
       return false;
     }
     return NextEntry();
   }
 };
 
-void DfsState::RecruitEntry(size_t pos) {
-  auto e = UserDictionary::CreateDictEntry(key, value, present_tick,
-                                           credibility.back());
-  if (e) {
-    e->code = code;
-    DLOG(INFO) << "add entry at pos " << pos;
-    query_result[pos].push_back(e);
+void DfsState::RecruitEntries(const vector<DfsPath>& paths) {
+  auto e = UserDictionary::CreateDictEntry(key, value, present_tick);
+  if (!e)
+    return;
+  e->code = code;
+  double weight = e->weight;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    const auto& path = paths[i];
+    auto entry = i + 1 < paths.size() ? New<DictEntry>(*e) : e;
+    entry->weight = weight + path.credibility;
+    DLOG(INFO) << "add entry at [" << path.start_pos << ", " << path.end_pos
+               << ")";
+    query_result[path.start_pos][path.end_pos].push_back(entry);
   }
 }
 
@@ -106,7 +612,7 @@ void UserDictEntryIterator::AddFilter(DictEntryFilter filter) {
   DictEntryFilterBinder::AddFilter(filter);
   // the introduced filter could invalidate the current or even all the
   // remaining entries
-  while (!exhausted() && !filter_(Peek())) {
+  while (!exhausted() && !filter_(DictEntryView(*Peek()))) {
     FindNextEntry();
   }
 }
@@ -130,7 +636,7 @@ bool UserDictEntryIterator::Next() {
   if (!FindNextEntry()) {
     return false;
   }
-  while (filter_ && !filter_(Peek())) {
+  while (filter_ && !filter_(DictEntryView(*Peek()))) {
     if (!FindNextEntry()) {
       return false;
     }
@@ -142,8 +648,16 @@ bool UserDictEntryIterator::Next() {
 
 UserDictionary::UserDictionary(const string& name,
                                an<Db> db,
-                               const string& schema)
-    : name_(name), db_(db), schema_(schema) {}
+                               const string& schema,
+                               an<UserDictWriteBuffer> write_buffer)
+    : name_(name),
+      db_(db),
+      schema_(schema),
+      profile_(UserDictProfile::Resolve(name)),
+      write_buffer_(write_buffer ? write_buffer
+                                 : New<UserDictWriteBuffer>(db)) {
+  write_buffer_->LimitFlushInterval(flush_interval_);
+}
 
 UserDictionary::UserDictionary(const string& name,
                                an<Db> db,
@@ -152,25 +666,42 @@ UserDictionary::UserDictionary(const string& name,
                                const bool& enable_filtering,
                                const bool& forced_selection,
                                const bool& single_selection,
-                               const bool& lower_case)
+                               const bool& lower_case,
+                               const int& flush_interval,
+                               const int& flush_size,
+                               const int& cache_size,
+                               an<UserDictWriteBuffer> write_buffer)
     : name_(name),
       db_(db),
       schema_(schema),
+      profile_(UserDictProfile::Resolve(name)),
+      write_buffer_(write_buffer ? write_buffer
+                                 : New<UserDictWriteBuffer>(db)),
       delete_threshold_(delete_threshold),
       enable_filtering_(enable_filtering),
       forced_selection_(forced_selection),
       single_selection_(single_selection),
-      lower_case_(lower_case) {}
+      lower_case_(lower_case),
+      flush_interval_(flush_interval),
+      flush_size_(flush_size) {
+  write_buffer_->LimitFlushInterval(flush_interval_);
+  if (cache_size > 0) {
+    query_cache_ = New<UserDictQueryCache>(cache_size);
+    write_buffer_->AttachQueryCache(query_cache_);
+  }
+}
 
 UserDictionary::~UserDictionary() {
   if (loaded()) {
     CommitPendingTransaction();
+    Flush();
   }
 }
 
 void UserDictionary::Attach(const an<Table>& table, const an<Prism>& prism) {
   table_ = table;
   prism_ = prism;
+  syllable_spellings_.clear();
 }
 
 bool UserDictionary::Load() {
@@ -201,78 +732,100 @@ bool UserDictionary::readonly() const {
 
 // this is a one-pass scan for the user db which supports sequential access
 // in alphabetical order (of syllables).
-// each call to DfsLookup() searches for matching phrases at a given
-// start position: current_pos.
-// there may be multiple edges that start at current_pos, and ends at different
-// positions after current_pos. on each edge, there can be multiple syllables
+// each call to DfsLookup() extends the paths of the syllable graph spelling
+// out the current code, by one syllable at a time.
+// there may be multiple edges that start at the end of a path, and end at
+// different positions after it. on each edge, there can be multiple syllables
 // the spelling on the edge maps to.
 // in order to enable forward scaning and to avoid backdating, our strategy is:
-// sort all those syllables from edges that starts at current_pos, so that
-// the syllables are in the same alphabetical order as the user db's.
-// this having been done by transposing the syllable graph into
-// SyllableGraph::index.
-// however, in the case of 'shsh' which could be the abbreviation of either
-// 'sh(a) sh(i)' or 'sh(a) s(hi) h(ou)',
-// we now have to give up the latter path in order to avoid backdating.
+// gather the syllables from the edges that follow all those paths, and sort
+// them so that the syllables are in the same alphabetical order as the user
+// db's. syllable ids are assigned in alphabetical order of the syllables.
+// all paths extended with the same syllable share one scan of the db records
+// with the code, be they from different start positions or of different
+// spellings of the syllable.
 
 // update: 2013-06-25
-// to fix the following issue, we have to reintroduce backdating in db scan:
 // given aaa=A, b=B, ab=C, derive/^(aa)a$/$1/,
 // the input 'aaab' can be either aaa'b=AB or aa'ab=AC.
-// note that backdating works only for normal or fuzzy spellings, but not for
-// abbreviations such as 'shsh' in the previous example.
+// note that the paths through 'aa' are extended with both 'aaa' and 'aa',
+// but not with abbreviations such as 'sh' in 'shsh', which could be
+// the abbreviation of either 'sh(a) sh(i)' or 'sh(a) s(hi) h(ou)'.
 
-void UserDictionary::DfsLookup(const SyllableGraph& syll_graph,
-                               size_t current_pos,
-                               const string& current_prefix,
+void UserDictionary::DfsLookup(const CompactSyllableGraph& syll_graph,
                                DfsState* state) {
-  auto index = syll_graph.indices.find(current_pos);
-  if (index == syll_graph.indices.end()) {
+  FetchTickCount();
+  state->present_tick = tick() + 1;
+  // a code spells at most one syllable per input character
+  size_t max_depth = syll_graph.interpreted_length + 1;
+  state->paths.resize(max_depth + 1);
+  state->branches.resize(max_depth);
+  state->accessor = QueryEntries("");
+  if (!state->accessor)
     return;
+  state->accessor->Jump(" ");  // skip metadata
+  state->NextEntry();
+  DfsLookup(syll_graph, 0, state);
+  seek_count_ += state->seeks;
+  DLOG(INFO) << "dfs lookup made " << state->seeks << " seeks.";
+}
+
+void UserDictionary::DfsLookup(const CompactSyllableGraph& syll_graph,
+                               size_t depth,
+                               DfsState* state) {
+  if (depth + 1 >= state->paths.size())
+    return;
+  const auto& paths = state->paths[depth];
+  auto& branches = state->branches[depth];
+  branches.clear();
+  const auto& edges = syll_graph.edges;
+  const auto& index = syll_graph.index;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    size_t first = syll_graph.begin_of(paths[i].end_pos);
+    size_t last = syll_graph.end_of(paths[i].end_pos);
+    // j counts the spellings of the same syllable, longer ones first
+    for (size_t k = first, j = 0; k < last; ++k, ++j) {
+      const auto& edge = edges[index[k]];
+      if (k > first && edges[index[k - 1]].syllable_id != edge.syllable_id)
+        j = 0;
+      if (j > 0 && edge.properties.type >= kAbbreviation)
+        continue;
+      branches.push_back({edge.syllable_id, i, j, &edge.properties});
+    }
   }
-  DLOG(INFO) << "dfs lookup starts from " << current_pos;
-  string prefix;
-  for (const auto& spelling : index->second) {
-    DLOG(INFO) << "prefix: '" << current_prefix << "'"
-               << ", syll_id: " << spelling.first
-               << ", num_spellings: " << spelling.second.size();
-    state->code.push_back(spelling.first);
-    BOOST_SCOPE_EXIT((&state)) {
-      state->code.pop_back();
+  std::sort(branches.begin(), branches.end());
+  auto& next_paths = state->paths[depth + 1];
+  size_t prefix_length = state->prefix.length();
+  for (auto it = branches.begin(); it != branches.end();) {
+    SyllableId syllable_id = it->syllable_id;
+    next_paths.clear();
+    for (; it != branches.end() && it->syllable_id == syllable_id; ++it) {
+      const auto& path = paths[it->path_index];
+      next_paths.push_back({path.start_pos, it->props->end_pos,
+                            path.credibility + it->props->credibility});
     }
-    BOOST_SCOPE_EXIT_END
-    if (!TranslateCodeToString(state->code, &prefix))
+    if (!AppendSpelling(syllable_id, &state->prefix))
       continue;
-    for (size_t i = 0; i < spelling.second.size(); ++i) {
-      auto props = spelling.second[i];
-      if (i > 0 && props->type >= kAbbreviation)
-        continue;
-      state->credibility.push_back(state->credibility.back() +
-                                   props->credibility);
-      BOOST_SCOPE_EXIT((&state)) {
-        state->credibility.pop_back();
-      }
-      BOOST_SCOPE_EXIT_END
-      size_t end_pos = props->end_pos;
-      DLOG(INFO) << "edge: [" << current_pos << ", " << end_pos << ")";
-      if (prefix != state->key) {  // 'a b c |d ' > 'a b c \tabracadabra'
-        DLOG(INFO) << "forward scanning for '" << prefix << "'.";
-        if (!state->ForwardScan(prefix))  // reached the end of db
-          continue;
-      }
-      while (state->IsExactMatch(prefix)) {  // 'b |e ' vs. 'b e \tBe'
-        DLOG(INFO) << "match found for '" << prefix << "'.";
-        state->RecruitEntry(end_pos);
+    state->code.push_back(syllable_id);
+    size_t length = state->prefix.length();
+    // 'a b c |d ' > 'a b c \tabracadabra'
+    if (state->ForwardScan()) {
+      while (state->IsExactMatch(length)) {  // 'b |e ' vs. 'b e \tBe'
+        DLOG(INFO) << "match found for '" << state->prefix << "'.";
+        state->RecruitEntries(next_paths);
         if (!state->NextEntry())  // reached the end of db
           break;
       }
       // the caller can limit the number of syllables to look up
       if ((!state->depth_limit || state->code.size() < state->depth_limit) &&
-          state->IsPrefixMatch(prefix)) {  // 'b |e ' vs. 'b e f \tBefore'
-        DfsLookup(syll_graph, end_pos, prefix, state);
+          state->IsPrefixMatch(length)) {  // 'b |e ' vs. 'b e f \tBefore'
+        DfsLookup(syll_graph, depth + 1, state);
       }
     }
-    if (!state->IsPrefixMatch(current_prefix))  // 'b |' vs. 'g o \tGo'
+    state->code.pop_back();
+    state->prefix.resize(prefix_length);
+    // 'b |' vs. 'g o \tGo'
+    if (state->exhausted || !state->IsPrefixMatch(prefix_length))
       return;
     // 'b |e ' vs. 'b y \tBy'
   }
@@ -281,44 +834,98 @@ void UserDictionary::DfsLookup(const SyllableGraph& syll_graph,
 static an<UserDictEntryCollector> collect(map<int, DictEntryList>* source) {
   auto result = New<UserDictEntryCollector>();
   for (auto& x : *source) {
+    // sort each group of homophones by weight
+    x.second.Sort();
     (*result)[x.first].SetEntries(std::move(x.second));
   }
   return result;
 }
 
-an<UserDictEntryCollector>
+an<UserDictEntryCollector> UserDictionary::Lookup(
+    const SyllableGraph& syll_graph,
+    size_t start_pos,
+    size_t depth_limit,
+    double initial_credibility) {
+  return Lookup(CompactSyllableGraph(syll_graph), start_pos, depth_limit,
+                initial_credibility);
+}
+
+map<size_t, an<UserDictEntryCollector>> UserDictionary::LookupAll(
+    const SyllableGraph& syll_graph,
+    size_t depth_limit,
+    double initial_credibility) {
+  return LookupAll(CompactSyllableGraph(syll_graph), depth_limit,
+                   initial_credibility);
+}
 
-UserDictionary::Lookup(const SyllableGraph& syll_graph,
-                       size_t start_pos,
-                       size_t depth_limit,
-                       double initial_credibility) {
+an<UserDictEntryCollector> UserDictionary::Lookup(
+    const CompactSyllableGraph& syll_graph,
+    size_t start_pos,
+    size_t depth_limit,
+    double initial_credibility) {
   if (!table_ || !prism_ || !loaded() ||
       start_pos >= syll_graph.interpreted_length)
     return nullptr;
   DfsState state;
   state.depth_limit = depth_limit;
-  FetchTickCount();
-  state.present_tick = tick_ + 1;
-  state.credibility.push_back(initial_credibility);
-  state.accessor = db_->Query("");
-  state.accessor->Jump(" ");  // skip metadata
-  string prefix;
-  DfsLookup(syll_graph, start_pos, prefix, &state);
+  state.paths.resize(1);
+  state.paths[0].push_back({start_pos, start_pos, initial_credibility});
+  DfsLookup(syll_graph, &state);
   if (state.query_result.empty())
     return nullptr;
-  // sort each group of homophones by weight
-  for (auto& v : state.query_result) {
-    v.second.Sort();
+  return collect(&state.query_result.begin()->second);
+}
+
+map<size_t, an<UserDictEntryCollector>> UserDictionary::LookupAll(
+    const CompactSyllableGraph& syll_graph,
+    size_t depth_limit,
+    double initial_credibility) {
+  map<size_t, an<UserDictEntryCollector>> result;
+  if (!table_ || !prism_ || !loaded())
+    return result;
+  DfsState state;
+  state.depth_limit = depth_limit;
+  state.paths.resize(1);
+  for (size_t start_pos = 0; start_pos < syll_graph.interpreted_length;
+       ++start_pos) {
+    if (syll_graph.has_edges(start_pos)) {
+      state.paths[0].push_back({start_pos, start_pos, initial_credibility});
+    }
   }
-  return collect(&state.query_result);
+  DfsLookup(syll_graph, &state);
+  for (auto& x : state.query_result) {
+    result[x.first] = collect(&x.second);
+  }
+  return result;
 }
 
 size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
                                    const string& input,
                                    bool predictive,
                                    size_t limit,
-                                   string* resume_key) {
-  TickCount present_tick = tick_ + 1;
+                                   string* resume_key,
+                                   UserDictLookupState* state) {
+  return ScanWords(result, input, predictive, limit, resume_key, state,
+                   nullptr);
+}
+
+size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
+                                   const string& input,
+                                   UserDictLookupCursor* cursor,
+                                   size_t limit,
+                                   UserDictLookupState* state) {
+  return ScanWords(result, input, true, limit, &cursor->resume_key, state,
+                   cursor);
+}
+
+size_t UserDictionary::ScanWords(UserDictEntryIterator* result,
+                                 const string& input,
+                                 bool predictive,
+                                 size_t limit,
+                                 string* resume_key,
+                                 UserDictLookupState* state,
+                                 UserDictLookupCursor* cursor) {
+  TickCount present_tick = tick() + 1;
   size_t len = input.length();
   size_t start = result->cache_size();
   size_t count = 0;
@@ -328,72 +935,56 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
   string value;
   string full_code;
   an<DbAccessor> accessor;
-  static char words[7][256];
+  UserDictLookupState scratch_state;
+  if (!state)
+    state = &scratch_state;
+  auto& words = state->words;
+  const int kMaxWords = UserDictLookupState::kMaxWords;
 
-  if (input.length() == 1 &&
-      boost::regex_match(name_, boost::regex("^sbf[mxd]|sbjm|sbzr|sbxh$"))) {
-    for (int i = 0; i < 7; i++)
-      std::strcpy(words[i], "");
+  if (input.length() == 1 && profile_.is_sbxlm()) {
+    state->Clear();
   }
 
   const bool prefixed = boost::starts_with(input,
                                            "\x7f"
                                            "enc\x1f");
 
-  if (boost::regex_match(name_, boost::regex("^sbjm|sbfx$"))) {
-    if (len < 3) {
-      accessor = db_->Query(input);
-    } else if (prefixed) {
-      if (boost::regex_match(name_, boost::regex("^sbfx$")) && len >= 8 &&
-          string("qwrtsdfgzxcvbyphjklnm").find(input[7]) != string::npos) {
-        if (len == 8)
-          return 0;
-        else if (len == 9 &&
-                 boost::regex_match(name_, boost::regex("^sbfx$")) &&
-                 string("qwrtsdfgzxcvbyphjklnm").find(input[7]) !=
-                     string::npos &&
-                 string("aeuio").find(input[8]) != string::npos)
-          return 0;
-      }
-      accessor = db_->Query(input.substr(0, 8));
-    } else {
-      if (boost::regex_match(name_, boost::regex("^sbfx$")) && len >= 3 &&
-          string("qwrtsdfgzxcvbyphjklnm").find(input[2]) != string::npos) {
-        if (len == 3)
-          return 0;
-        else if (len == 4 &&
-                 boost::regex_match(name_, boost::regex("^sbfx$")) &&
-                 string("qwrtsdfgzxcvbyphjklnm").find(input[2]) !=
-                     string::npos &&
-                 string("aeuio").find(input[3]) != string::npos)
-          return 0;
-      }
-      accessor = db_->Query(input.substr(0, 3));
+  if (profile_.is_sbfx()) {
+    size_t l = prefixed ? 7 : 2;
+    if (len > l && is_consonant(input[l])) {
+      if (len == l + 1)
+        return 0;
+      else if (len == l + 2 && is_vowel(input[l + 1]))
+        return 0;
     }
-  } else if (boost::regex_match(name_, boost::regex("^sbzr|sbxh|sbf[md]$"))) {
-    if (len < 4) {
-      accessor = db_->Query(input);
-    } else if (prefixed) {
-      accessor = db_->Query(input.substr(0, 9));
+  }
+  if (cursor && cursor->accessor) {
+    // the scan goes on from the record next to the last one read
+    accessor = cursor->accessor;
+  } else {
+    if (profile_.seek_length && len >= profile_.seek_length) {
+      // only the leading code letters select the range to scan
+      size_t seek_length =
+          profile_.seek_length + (prefixed ? kEncodedPrefixLength : 0);
+      accessor = QueryCachedEntries(input.substr(0, seek_length));
     } else {
-      accessor = db_->Query(input.substr(0, 4));
+      accessor = QueryCachedEntries(input);
     }
-  } else {
-    accessor = db_->Query(input);
-  }
-
-  if (!accessor || accessor->exhausted()) {
-    if (resume_key)
-      *resume_key = kEnd;
-    return 0;
-  }
-  if (resume_key && !resume_key->empty()) {
-    if (!accessor->Jump(*resume_key) ||
-        !accessor->GetNextRecord(&key, &value)) {
-      *resume_key = kEnd;
+    if (cursor)
+      cursor->accessor = accessor;
+    if (!accessor || accessor->exhausted()) {
+      if (resume_key)
+        *resume_key = kEnd;
       return 0;
     }
-    DLOG(INFO) << "resume lookup after: " << key;
+    if (resume_key && !resume_key->empty()) {
+      if (!accessor->Jump(*resume_key) ||
+          !accessor->GetNextRecord(&key, &value)) {
+        *resume_key = kEnd;
+        return 0;
+      }
+      DLOG(INFO) << "resume lookup after: " << key;
+    }
   }
 
   string last_key(key);
@@ -402,14 +993,12 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
     DLOG(INFO) << "key : " << key << ", value: " << value;
     bool is_exact_match = (len < key.length() && key[len] == ' ');
 
-    if (boost::regex_match(name_, boost::regex("^sbjm$")) &&
+    if (profile_.is_sbjm() &&
         (!prefixed && len >= 3 || prefixed && len >= 8) && enable_filtering_) {
       int l = prefixed ? 8 : 3;
       if ((!prefixed && len == 3 || prefixed && len == 8) &&
-          string("qwrtsdfgzxcvbyphjklnm").find(key.substr(l + 2, 1)) !=
-              string::npos &&
-          boost::regex_match(key.substr(l - 3, 3),
-                             boost::regex("^[qwrtsdfgzxcvbyphjklnm]{3}$"))) {
+          (key.length() <= l + 2 || is_consonant(key[l + 2])) &&
+          all_consonants(key, l - 3, 3)) {
         continue;
       }
       // else if ((!prefixed && len >= 4 || prefixed && len >= 9)
@@ -420,30 +1009,25 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
       //}
     }
 
-    if (boost::regex_match(name_, boost::regex("^sbfx$")) &&
+    if (profile_.is_sbfx() &&
         (!prefixed && len >= 4 || prefixed && len >= 9) && enable_filtering_) {
       int l = prefixed ? 8 : 3;
-      if (string("23789").find(input[l]) != string::npos &&
-          string("QWRTSDFGZXCVBYPHJKLNM").find(key[l + 6]) != string::npos) {
+      if (is_vowel_digit(input[l]) && is_capital_consonant(key[l + 6])) {
         continue;
       } else if ((!prefixed && len >= 5 || prefixed && len >= 10) &&
-                 string("23789").find(input[l]) == string::npos &&
-                 string("QWRTSDFGZXCVBYPHJKLNM").find(key[l + 6]) !=
-                     string::npos) {
+                 !is_vowel_digit(input[l]) &&
+                 is_capital_consonant(key[l + 6])) {
         continue;
       }
     }
 
-    if (!is_exact_match && prefixed && len > 8 &&
-        boost::regex_match(name_, boost::regex("^sbjm|sbfx$"))) {
+    if (!is_exact_match && prefixed && len > 8 && profile_.is_sbjm_or_sbfx()) {
       string key_holder = key;
-      if (boost::regex_match(name_, boost::regex("^sbfx$")) &&
-          string("QWRTSDFGZXCVBYPHJKLNM").find(key[14]) != string::npos &&
-          (string("QWRTSDFGZXCVBYPHJKLNM").find(input[8]) != string::npos))
+      if (profile_.is_sbfx() && is_capital_consonant(key[14]) &&
+          is_capital_consonant(input[8]))
         key_holder[10] = key[14];
       string input_holder = input;
-      if (boost::regex_match(name_, boost::regex("^sbfx$")) &&
-          string("23789").find(input_holder[8]) != string::npos) {
+      if (profile_.is_sbfx() && is_vowel_digit(input_holder[8])) {
         switch (input_holder[8]) {
           case '2':
             input_holder[8] = 'a';
@@ -463,26 +1047,21 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
         }
       }
       string r1;
-      if (len == 10 && boost::regex_match(name_, boost::regex("^sbjm$")) &&
-          !single_selection_)
+      if (len == 10 && profile_.is_sbjm() && !single_selection_)
         r1 = input_holder.substr(8, 1);
-      else if (len == 11 && boost::regex_match(name_, boost::regex("^sbfx$")) &&
-               !single_selection_)
+      else if (len == 11 && profile_.is_sbfx() && !single_selection_)
         r1 = input_holder.substr(8, 2);
       else
         r1 = input_holder.substr(8, len - 8);
       string r2;
-      if (len == 10 && boost::regex_match(name_, boost::regex("^sbjm$")) &&
-          !single_selection_)
+      if (len == 10 && profile_.is_sbjm() && !single_selection_)
         r2 = key_holder.substr(10, 1);
-      else if (len == 11 && boost::regex_match(name_, boost::regex("^sbfx$")) &&
-               !single_selection_)
+      else if (len == 11 && profile_.is_sbfx() && !single_selection_)
         r2 = key_holder.substr(10, 2);
       else
         r2 = key_holder.substr(10, len - 8);
-      if (string("qwrtsdfgzxcvbyphjklnm").find(r1[0]) == string::npos &&
-          string("qwrtsdfgzxcvbyphjklnm").find(r2[0]) != string::npos &&
-          boost::regex_match(name_, boost::regex("^sbjm$")) && lower_case_) {
+      if (!is_consonant(r1[0]) && is_consonant(r2[0]) && profile_.is_sbjm() &&
+          lower_case_) {
         r2[0] = key_holder[13];
       }
       if (r1 == r2) {
@@ -490,16 +1069,13 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
       } else {
         continue;
       }
-    } else if (!is_exact_match && len > 3 &&
-               boost::regex_match(name_, boost::regex("^sbjm|sbfx$"))) {
+    } else if (!is_exact_match && len > 3 && profile_.is_sbjm_or_sbfx()) {
       string key_holder = key;
-      if (boost::regex_match(name_, boost::regex("^sbfx$")) &&
-          string("QWRTSDFGZXCVBYPHJKLNM").find(key[9]) != string::npos &&
-          (string("QWRTSDFGZXCVBYPHJKLNM").find(input[3]) != string::npos))
+      if (profile_.is_sbfx() && is_capital_consonant(key[9]) &&
+          is_capital_consonant(input[3]))
         key_holder[5] = key[9];
       string input_holder = input;
-      if (boost::regex_match(name_, boost::regex("^sbfx$")) &&
-          string("23789").find(input_holder[3]) != string::npos) {
+      if (profile_.is_sbfx() && is_vowel_digit(input_holder[3])) {
         switch (input_holder[3]) {
           case '2':
             input_holder[3] = 'a';
@@ -519,26 +1095,21 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
         }
       }
       string r1;
-      if (len == 5 && boost::regex_match(name_, boost::regex("^sbjm$")) &&
-          !single_selection_)
+      if (len == 5 && profile_.is_sbjm() && !single_selection_)
         r1 = input_holder.substr(3, 1);
-      else if (len == 6 && boost::regex_match(name_, boost::regex("^sbfx$")) &&
-               !single_selection_)
+      else if (len == 6 && profile_.is_sbfx() && !single_selection_)
         r1 = input_holder.substr(3, 2);
       else
         r1 = input_holder.substr(3, len - 3);
       string r2;
-      if (len == 5 && boost::regex_match(name_, boost::regex("^sbjm$")) &&
-          !single_selection_)
+      if (len == 5 && profile_.is_sbjm() && !single_selection_)
         r2 = key_holder.substr(5, 1);
-      else if (len == 6 && boost::regex_match(name_, boost::regex("^sbfx$")) &&
-               !single_selection_)
+      else if (len == 6 && profile_.is_sbfx() && !single_selection_)
         r2 = key_holder.substr(5, 2);
       else
         r2 = key_holder.substr(5, len - 3);
-      if (string("qwrtsdfgzxcvbyphjklnm").find(r1[0]) == string::npos &&
-          string("qwrtsdfgzxcvbyphjklnm").find(r2[0]) != string::npos &&
-          boost::regex_match(name_, boost::regex("^sbjm$")) && lower_case_) {
+      if (!is_consonant(r1[0]) && is_consonant(r2[0]) && profile_.is_sbjm() &&
+          lower_case_) {
         r2[0] = key_holder[8];
       }
       if (r1 == r2) {
@@ -546,39 +1117,21 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
       } else {
         continue;
       }
-    } else if (!is_exact_match && prefixed && len > 9 &&
-               boost::regex_match(name_, boost::regex("^sbzr|sbxh|sbf[md]$"))) {
-      string r1 =
-          (len == 10 &&
-           boost::regex_match(name_, boost::regex("^sbzr|sbxh|sbf[md]$")) &&
-           !single_selection_)
-              ? input.substr(9, 0)
-              : input.substr(9, len - 9);
-      string r2 =
-          (len == 10 &&
-           boost::regex_match(name_, boost::regex("^sbzr|sbxh|sbf[md]$")) &&
-           !single_selection_)
-              ? key.substr(11, 0)
-              : key.substr(11, len - 9);
+    } else if (!is_exact_match && prefixed && len > 9 && profile_.is_sbzr()) {
+      string r1 = (len == 10 && !single_selection_) ? input.substr(9, 0)
+                                                    : input.substr(9, len - 9);
+      string r2 = (len == 10 && !single_selection_) ? key.substr(11, 0)
+                                                    : key.substr(11, len - 9);
       if (r1 == r2) {
         is_exact_match = true;
       } else {
         continue;
       }
-    } else if (!is_exact_match && len > 4 &&
-               boost::regex_match(name_, boost::regex("^sbzr|sbxh|sbf[md]$"))) {
-      string r1 =
-          (len == 5 &&
-           boost::regex_match(name_, boost::regex("^sbzr|sbxh|sbf[md]$")) &&
-           !single_selection_)
-              ? input.substr(4, 0)
-              : input.substr(4, len - 4);
-      string r2 =
-          (len == 5 &&
-           boost::regex_match(name_, boost::regex("^sbzr|sbxh|sbf[md]$")) &&
-           !single_selection_)
-              ? key.substr(6, 0)
-              : key.substr(6, len - 4);
+    } else if (!is_exact_match && len > 4 && profile_.is_sbzr()) {
+      string r1 = (len == 5 && !single_selection_) ? input.substr(4, 0)
+                                                   : input.substr(4, len - 4);
+      string r2 = (len == 5 && !single_selection_) ? key.substr(6, 0)
+                                                   : key.substr(6, len - 4);
       if (r1 == r2) {
         is_exact_match = true;
       } else {
@@ -599,25 +1152,20 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
       e->comment = "~" + full_code.substr(len);
       e->remaining_code_length = full_code.length() - len;
     }
-    if (boost::regex_match(name_, boost::regex("^sbjm|sbfx$")) &&
-        (len == 3 || (prefixed && len == 8))) {
+    if (profile_.is_sbjm_or_sbfx() && (len == 3 || (prefixed && len == 8))) {
       if (!e_holder) {
         e_holder = e;
       } else if (e_holder->weight < e->weight) {
         e_holder = e;
       }
       continue;
-    } else if (boost::regex_match(name_,
-                                  boost::regex("^sbjm|sbzr|sbxh|sbf[mxd]$")) &&
+    } else if (profile_.is_sbxlm() &&
                (!prefixed && len == 4 || (prefixed && len == 9))) {
       int l = len == 4 ? 3 : 8;
-      if (e->text == string(words[0]) &&
-          !boost::regex_match(name_, boost::regex("^sbfx$")))
+      if (e->text == words[0] && !profile_.is_sbfx())
         continue;
-      else if (boost::regex_match(name_,
-                                  boost::regex("^sbjm|sbzr|sbxh|sbf[mxd]$")) &&
-               !single_selection_ &&
-               string("23789").find(input[l]) == string::npos) {
+      else if (profile_.is_sbxlm() && !single_selection_ &&
+               !is_vowel_digit(input[l])) {
         if (prefixed && len == 9 && delete_threshold_ > 0) {
           if (!DeleteEntry(e))
             result->Add(std::move(e));
@@ -633,11 +1181,10 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
         }
         continue;
       }
-    } else if (boost::regex_match(name_,
-                                  boost::regex("^sbjm|sbzr|sbxh|sbf[mxd]$")) &&
+    } else if (profile_.is_sbxlm() &&
                (!prefixed && len == 5 || (prefixed && len == 10))) {
-      if (boost::regex_match(name_, boost::regex("^sbfx$"))) {
-        if (e->text == string(words[0]))
+      if (profile_.is_sbfx()) {
+        if (e->text == words[0])
           continue;
         if (!single_selection_) {
           if (prefixed && len == 10 && delete_threshold_ > 0) {
@@ -655,9 +1202,7 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
           }
           continue;
         }
-      } else if (boost::regex_match(name_,
-                                    boost::regex("^sbjm|sbzr|sbxh|sbf[md]$")) &&
-                 !single_selection_) {
+      } else if (profile_.is_sbjm_or_sbzr() && !single_selection_) {
         int i = 0;
         int j = (len == 5) ? 4 : 9;
         switch (input[j]) {
@@ -677,9 +1222,9 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
             i = 6;
             break;
         }
-        if (i == 0 || words[i] == string(""))
+        if (i == 0 || words[i].empty())
           return 0;
-        if (e->text != string(words[i]))
+        if (e->text != words[i])
           continue;
         else {
           result->Add(std::move(e));
@@ -688,7 +1233,7 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
       } else {
         int i;
         for (i = 0; i < 2; i++) {
-          if (e->text == string(words[i]))
+          if (e->text == words[i])
             break;
         }
         if (i < 2)
@@ -701,10 +1246,9 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
         }
         continue;
       }
-    } else if (boost::regex_match(name_,
-                                  boost::regex("^sbjm|sbzr|sbxh|sbf[mxd]$")) &&
+    } else if (profile_.is_sbxlm() &&
                (!prefixed && len == 6 || (prefixed && len == 11))) {
-      if (boost::regex_match(name_, boost::regex("^sbfx$"))) {
+      if (profile_.is_sbfx()) {
         if (!single_selection_) {
           int i = 0;
           int j = (len == 6) ? 5 : 10;
@@ -725,9 +1269,9 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
               i = 6;
               break;
           }
-          if (i == 0 || words[i] == string(""))
+          if (i == 0 || words[i].empty())
             return 0;
-          if (e->text != string(words[i]))
+          if (e->text != words[i])
             continue;
           else {
             result->Add(std::move(e));
@@ -735,13 +1279,12 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
           }
         } else {
           int l = len == 6 ? 3 : 8;
-          if (boost::regex_match(name_, boost::regex("^sbfx$")) &&
-              string("aeuio").find(input[l]) != string::npos &&
+          if (profile_.is_sbfx() && is_vowel(input[l]) &&
               last_key[l + 3] == ' ')
             continue;
           int i;
           for (i = 0; i < 2; i++) {
-            if (e->text == string(words[i]))
+            if (e->text == words[i])
               break;
           }
           if (i < 2)
@@ -760,21 +1303,20 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
         if (forced_selection_ && !single_selection_)
           j += 5;
         for (i = 0; i < j; i++) {
-          if (e->text == string(words[i]))
+          if (e->text == words[i])
             break;
         }
         if (i < j)
           continue;
         result->Add(std::move(e));
       }
-    } else if (boost::regex_match(name_, boost::regex("^sbfx$")) &&
-               (len == 7 || (prefixed && len == 12))) {
+    } else if (profile_.is_sbfx() && (len == 7 || (prefixed && len == 12))) {
       int i;
       int j = 2;
       if (forced_selection_ && !single_selection_)
         j += 5;
       for (i = 0; i < j; i++) {
-        if (e->text == string(words[i]))
+        if (e->text == words[i])
           break;
       }
       if (i < j)
@@ -799,40 +1341,40 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
   if (e_holder && result->cache_size() < 1) {  // found one most used entry
     ++count;
     ++exact_match_count;
-    if (boost::regex_match(name_, boost::regex("^sbfx$"))) {
+    if (profile_.is_sbfx()) {
       if (!prefixed && len == 4 || (prefixed && len == 9))
-        std::strcpy(words[0], e_holder->text.c_str());
+        words[0] = e_holder->text;
       else if (!prefixed && len == 5 || (prefixed && len == 10))
-        std::strcpy(words[1], e_holder->text.c_str());
+        words[1] = e_holder->text;
       else if (!prefixed && len == 6 || (prefixed && len == 11))
-        std::strcpy(words[2], e_holder->text.c_str());
+        words[2] = e_holder->text;
     } else {
       if (!prefixed && len == 3 || (prefixed && len == 8))
-        std::strcpy(words[0], e_holder->text.c_str());
+        words[0] = e_holder->text;
       else if (!prefixed && len == 4 || (prefixed && len == 9))
-        std::strcpy(words[1], e_holder->text.c_str());
+        words[1] = e_holder->text;
       else if (!prefixed && len == 5 || (prefixed && len == 10))
-        std::strcpy(words[2], e_holder->text.c_str());
+        words[2] = e_holder->text;
     }
     result->Add(std::move(e_holder));
   }
   if (exact_match_count > 0) {
     result->SortRange(start, exact_match_count);
   }
-  if (boost::regex_match(name_, boost::regex("^sbzr|sbxh|sbjm|sbf[md]$")) &&
-      prefixed && len == 9 && result->cache_size() > 0 && !single_selection_) {
+  if (profile_.is_sbjm_or_sbzr() && prefixed && len == 9 &&
+      result->cache_size() > 0 && !single_selection_) {
     int i = 1;
-    while (words[i] != string("")) {
+    while (i < kMaxWords && !words[i].empty()) {
       result->Next();
       i++;
     }
-    if (i < 7 && result->cache_size() >= i) {
-      while (i < 7) {
+    if (i < kMaxWords && result->cache_size() >= i) {
+      while (i < kMaxWords) {
         auto en = result->Peek();
         if (!en)
           break;
         for (int j = 1; j <= i; j++) {
-          if (!std::strcmp(words[j], en->text.c_str())) {
+          if (words[j] == en->text) {
             result->Next();
             en = result->Peek();
             if (!en)
@@ -841,49 +1383,48 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
           }
         }
         if (en)
-          std::strcpy(words[i], en->text.c_str());
+          words[i] = en->text;
         else
           break;
         result->Next();
         i++;
       }
-      while (i < 7) {
-        std::strcpy(words[i], "");
+      while (i < kMaxWords) {
+        words[i].clear();
         i++;
       }
     }
     result->SetIndex(0);
-  } else if (boost::regex_match(name_,
-                                boost::regex("^sbzr|sbxh|sbjm|sbf[md]$")) &&
-             len == 4 && result->cache_size() > 0 && !single_selection_) {
+  } else if (profile_.is_sbjm_or_sbzr() && len == 4 &&
+             result->cache_size() > 0 && !single_selection_) {
     int i = 1;
-    while (i < 7) {
+    while (i < kMaxWords) {
       auto en = result->Peek();
       if (!en)
         break;
-      std::strcpy(words[i], en->text.c_str());
+      words[i] = en->text;
       result->Next();
       i++;
     }
-    while (i < 7) {
-      std::strcpy(words[i], "");
+    while (i < kMaxWords) {
+      words[i].clear();
       i++;
     }
     result->SetIndex(0);
-  } else if (boost::regex_match(name_, boost::regex("^sbfx$")) && prefixed &&
-             len == 10 && result->cache_size() > 0 && !single_selection_) {
+  } else if (profile_.is_sbfx() && prefixed && len == 10 &&
+             result->cache_size() > 0 && !single_selection_) {
     int i = 1;
-    while (words[i] != string("")) {
+    while (i < kMaxWords && !words[i].empty()) {
       result->Next();
       i++;
     }
-    if (i < 7 && result->cache_size() >= i) {
-      while (i < 7) {
+    if (i < kMaxWords && result->cache_size() >= i) {
+      while (i < kMaxWords) {
         auto en = result->Peek();
         if (!en)
           break;
         for (int j = 1; j <= i; j++) {
-          if (!std::strcmp(words[j], en->text.c_str())) {
+          if (words[j] == en->text) {
             result->Next();
             en = result->Peek();
             if (!en)
@@ -892,31 +1433,31 @@ size_t UserDictionary::LookupWords(UserDictEntryIterator* result,
           }
         }
         if (en)
-          std::strcpy(words[i], en->text.c_str());
+          words[i] = en->text;
         else
           break;
         result->Next();
         i++;
       }
-      while (i < 7) {
-        std::strcpy(words[i], "");
+      while (i < kMaxWords) {
+        words[i].clear();
         i++;
       }
     }
     result->SetIndex(0);
-  } else if (boost::regex_match(name_, boost::regex("^sbfx$")) && len == 5 &&
-             result->cache_size() > 0 && !single_selection_) {
+  } else if (profile_.is_sbfx() && len == 5 && result->cache_size() > 0 &&
+             !single_selection_) {
     int i = 1;
-    while (i < 7) {
+    while (i < kMaxWords) {
       auto en = result->Peek();
       if (!en)
         break;
-      std::strcpy(words[i], en->text.c_str());
+      words[i] = en->text;
       result->Next();
       i++;
     }
-    while (i < 7) {
-      std::strcpy(words[i], "");
+    while (i < kMaxWords) {
+      words[i].clear();
       i++;
     }
     result->SetIndex(0);
@@ -943,10 +1484,11 @@ bool UserDictionary::UpdateEntry(const DictEntry& entry,
   string key(code_str + '\t' + entry.text);
   string value;
   UserDbValue v;
-  if (db_->Fetch(key, &value)) {
+  TickCount present_tick = tick();
+  if (FetchEntry(key, &value)) {
     v.Unpack(value);
-    if (v.tick > tick_) {
-      v.tick = tick_;  // fix abnormal timestamp
+    if (v.tick > present_tick) {
+      v.tick = present_tick;  // fix abnormal timestamp
     }
     if (v.commits < 0)
       v.commits = -v.commits;
@@ -963,17 +1505,22 @@ bool UserDictionary::UpdateEntry(const DictEntry& entry,
       v.commits = 888;
     else
       v.commits += commits;
-    UpdateTickCount(1);
-    v.dee = algo::formula_d(commits, (double)tick_, v.dee, (double)v.tick);
+    present_tick = write_buffer_->AddTick(1);
+    v.dee =
+        algo::formula_d(commits, (double)present_tick, v.dee, (double)v.tick);
   } else if (commits == 0) {
     const double k = 0.1;
-    v.dee = algo::formula_d(k, (double)tick_, v.dee, (double)v.tick);
+    v.dee = algo::formula_d(k, (double)present_tick, v.dee, (double)v.tick);
   } else if (commits < 0) {  // mark as deleted
     v.commits = (std::min)(-1, -v.commits);
-    v.dee = algo::formula_d(0.0, (double)tick_, v.dee, (double)v.tick);
+    v.dee = algo::formula_d(0.0, (double)present_tick, v.dee, (double)v.tick);
   }
-  v.tick = tick_;
-  return db_->Update(key, v.Pack());
+  v.tick = present_tick;
+  if (!StoreEntry(key, v.Pack()))
+    return false;
+  if (!in_transaction_ && IsFlushDue())
+    Flush();
+  return true;
 }
 
 bool UserDictionary::DeleteEntry(an<DictEntry> entry) {
@@ -983,24 +1530,22 @@ bool UserDictionary::DeleteEntry(an<DictEntry> entry) {
   string key(code_str + '\t' + entry->text);
   string value;
   UserDbValue v;
-  if (db_->Fetch(key, &value)) {
+  if (FetchEntry(key, &value)) {
     v.Unpack(value);
-    if (tick_ - v.tick >= delete_threshold_) {
+    TickCount present_tick = tick();
+    if (present_tick - v.tick >= delete_threshold_) {
       v.commits = -1;
-      v.dee = algo::formula_d(0.0, (double)tick_, v.dee, (double)v.tick);
-      return db_->Update(key, v.Pack());
+      v.dee =
+          algo::formula_d(0.0, (double)present_tick, v.dee, (double)v.tick);
+      return StoreEntry(key, v.Pack());
     }
   }
   return false;
 }
 
 bool UserDictionary::UpdateTickCount(TickCount increment) {
-  tick_ += increment;
-  try {
-    return db_->MetaUpdate("/tick", boost::lexical_cast<string>(tick_));
-  } catch (...) {
-    return false;
-  }
+  write_buffer_->AddTick(increment);
+  return true;
 }
 
 bool UserDictionary::Initialize() {
@@ -1008,43 +1553,144 @@ bool UserDictionary::Initialize() {
 }
 
 bool UserDictionary::FetchTickCount() {
-  string value;
-  try {
-    // an earlier version mistakenly wrote tick count into an empty key
-    if (!db_->MetaFetch("/tick", &value) && !db_->Fetch("", &value))
-      return false;
-    tick_ = boost::lexical_cast<TickCount>(value);
-    return true;
-  } catch (...) {
-    // tick_ = 0;
-    return false;
-  }
+  return write_buffer_->FetchTick();
+}
+
+TickCount UserDictionary::tick() const {
+  return write_buffer_->tick();
+}
+
+size_t UserDictionary::pending_updates() const {
+  return write_buffer_->size();
 }
 
+// transactions are kept in the write-behind buffer, which is written to the
+// db in a batch when a flush is due; only transactional dbs support them.
+
 bool UserDictionary::NewTransaction() {
-  auto db = As<Transactional>(db_);
-  if (!db)
+  if (!Is<Transactional>(db_))
     return false;
   CommitPendingTransaction();
   transaction_time_ = time(NULL);
-  return db->BeginTransaction();
+  transaction_flushes_ = write_buffer_->flushes();
+  in_transaction_ = true;
+  return true;
 }
 
 bool UserDictionary::RevertRecentTransaction() {
-  auto db = As<Transactional>(db_);
-  if (!db || !db->in_transaction())
+  if (!in_transaction_)
     return false;
   if (time(NULL) - transaction_time_ > 3 /*seconds*/)
     return false;
-  return db->AbortTransaction();
+  if (write_buffer_->flushes() != transaction_flushes_) {
+    // written to the db by another user of the buffer
+    transaction_log_.clear();
+    in_transaction_ = false;
+    return false;
+  }
+  for (const auto& logged : transaction_log_) {
+    write_buffer_->Restore(logged.first, logged.second);
+  }
+  transaction_log_.clear();
+  in_transaction_ = false;
+  return true;
 }
 
 bool UserDictionary::CommitPendingTransaction() {
-  auto db = As<Transactional>(db_);
-  if (db && db->in_transaction()) {
-    return db->CommitTransaction();
+  bool committed = in_transaction_;
+  transaction_log_.clear();
+  in_transaction_ = false;
+  if (IsFlushDue())
+    Flush();
+  return committed;
+}
+
+bool UserDictionary::Flush() {
+  if (!write_buffer_->Flush())
+    return false;
+  transaction_log_.clear();
+  in_transaction_ = false;
+  return true;
+}
+
+bool UserDictionary::IsFlushDue() const {
+  return write_buffer_->IsFlushDue(flush_interval_, flush_size_);
+}
+
+bool UserDictionary::FetchEntry(const string& key, string* value) {
+  return write_buffer_->Fetch(key, value);
+}
+
+bool UserDictionary::StoreEntry(const string& key, const string& value) {
+  if (!db_->loaded() || db_->readonly())
+    return false;
+  string previous;
+  write_buffer_->Store(key, value, &previous);
+  if (in_transaction_ && transaction_log_.find(key) == transaction_log_.end()) {
+    transaction_log_[key] = previous;
   }
-  return false;
+  return true;
+}
+
+an<DbAccessor> UserDictionary::QueryEntries(const string& prefix) {
+  auto accessor = db_->Query(prefix);
+  if (!accessor)
+    return accessor;
+  auto pending_updates = write_buffer_->Snapshot(prefix);
+  if (!pending_updates)
+    return accessor;
+  return New<PendingUpdatesAccessor>(accessor, pending_updates, prefix);
+}
+
+an<DbAccessor> UserDictionary::QueryCachedEntries(const string& prefix) {
+  if (!query_cache_)
+    return QueryEntries(prefix);
+  size_t generation = 0;
+  if (auto records = query_cache_->Find(prefix, &generation)) {
+    return New<DbRecordsAccessor>(records, prefix);
+  }
+  auto accessor = QueryEntries(prefix);
+  if (!accessor)
+    return accessor;
+  auto records = New<DbRecords>();
+  string key, value;
+  while (records->size() <= kMaxCachedRecords &&
+         accessor->GetNextRecord(&key, &value)) {
+    records->emplace_back(key, value);
+  }
+  if (records->size() > kMaxCachedRecords) {
+    // too many to cache; scan again from the db
+    accessor->Reset();
+    return accessor;
+  }
+  query_cache_->Insert(prefix, records, generation);
+  return New<DbRecordsAccessor>(records, prefix);
+}
+
+size_t UserDictionary::query_cache_hits() const {
+  return query_cache_ ? query_cache_->hits() : 0;
+}
+
+size_t UserDictionary::query_cache_misses() const {
+  return query_cache_ ? query_cache_->misses() : 0;
+}
+
+bool UserDictionary::AppendSpelling(SyllableId syllable_id, string* prefix) {
+  if (!table_ || syllable_id < 0)
+    return false;
+  if (static_cast<size_t>(syllable_id) >= syllable_spellings_.size())
+    syllable_spellings_.resize(syllable_id + 1);
+  string& spelling = syllable_spellings_[syllable_id];
+  if (spelling.empty()) {
+    spelling = table_->GetSyllableById(syllable_id);
+    if (spelling.empty()) {
+      LOG(ERROR) << "Error translating syllable_id '" << syllable_id << "'.";
+      return false;
+    }
+  }
+  *prefix += spelling;
+  *prefix += ' ';
+  return true;
 }
 
 bool UserDictionary::TranslateCodeToString(const Code& code, string* result) {
@@ -1105,17 +1751,55 @@ UserDictionaryComponent::UserDictionaryComponent() {}
 UserDictionary* UserDictionaryComponent::Create(const string& dict_name,
                                                 const string& db_class,
                                                 const string& schema) {
-  auto db = db_pool_[dict_name].lock();
-  if (!db) {
+  auto write_buffer = AcquireWriteBuffer(dict_name, db_class);
+  if (!write_buffer)
+    return NULL;
+  return new UserDictionary(dict_name, write_buffer->db(), schema,
+                            write_buffer);
+}
+
+an<UserDictWriteBuffer> UserDictionaryComponent::AcquireWriteBuffer(
+    const string& dict_name,
+    const string& db_class,
+    bool* created) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto write_buffer = db_pool_[dict_name].lock();
+  if (created)
+    *created = !write_buffer;
+  if (!write_buffer) {
     auto component = Db::Require(db_class);
     if (!component) {
       LOG(ERROR) << "undefined db class '" << db_class << "'.";
-      return NULL;
+      return nullptr;
+    }
+    an<Db> db(component->Create(dict_name));
+    write_buffer = New<UserDictWriteBuffer>(db);
+    db_pool_[dict_name] = write_buffer;
+  }
+  return write_buffer;
+}
+
+size_t UserDictionaryComponent::FlushDue(time_t now) {
+  vector<an<UserDictWriteBuffer>> due;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = db_pool_.begin(); it != db_pool_.end();) {
+      auto write_buffer = it->second.lock();
+      if (!write_buffer) {
+        it = db_pool_.erase(it);
+        continue;
+      }
+      if (write_buffer->IsFlushDue(now))
+        due.push_back(write_buffer);
+      ++it;
     }
-    db.reset(component->Create(dict_name));
-    db_pool_[dict_name] = db;
   }
-  return new UserDictionary(dict_name, db, schema);
+  size_t flushed = 0;
+  for (const auto& write_buffer : due) {
+    if (write_buffer->Flush())
+      ++flushed;
+  }
+  return flushed;
 }
 
 UserDictionary* UserDictionaryComponent::Create(const Ticket& ticket) {
@@ -1142,15 +1826,25 @@ UserDictionary* UserDictionaryComponent::Create(const Ticket& ticket) {
     // user specified db class
   }
   // obtain userdb object
-  auto db = db_pool_[dict_name].lock();
-  if (!db) {
-    auto component = Db::Require(db_class);
-    if (!component) {
-      LOG(ERROR) << "undefined db class '" << db_class << "'.";
-      return NULL;
+  bool created = false;
+  auto write_buffer = AcquireWriteBuffer(dict_name, db_class, &created);
+  if (!write_buffer)
+    return NULL;
+  const auto& db = write_buffer->db();
+  if (created) {
+    if (auto level_db = As<LevelDb>(db)) {
+      // installation-wide settings in default.yaml, overridden by the schema
+      LevelDbOptions options;
+      // the built-in defaults stand without a readable default.yaml
+      if (auto config_component = Config::Require("config")) {
+        the<Config> preset_config(config_component->Create("default"));
+        if (preset_config) {
+          options.Load(preset_config.get(), "db_options");
+        }
+      }
+      options.Load(config, ticket.name_space + "/db_options");
+      level_db->set_options(options);
     }
-    db.reset(component->Create(dict_name));
-    db_pool_[dict_name] = db;
   }
 
   int delete_threshold = 1000;
@@ -1165,9 +1859,32 @@ UserDictionary* UserDictionaryComponent::Create(const Ticket& ticket) {
   config->GetBool(ticket.name_space + "/single_selection", &single_selection);
   bool lower_case = false;
   config->GetBool(ticket.name_space + "/lower_case", &lower_case);
+  // write-behind of user dict updates; an interval of 0 writes through
+  int flush_interval = 5;
+  config->GetInt(ticket.name_space + "/user_dict_flush_interval",
+                 &flush_interval);
+  int flush_size = 64;
+  config->GetInt(ticket.name_space + "/user_dict_flush_size", &flush_size);
+  // number of recent queries to cache, 0 to disable the cache
+  int cache_size = 64;
+  config->GetInt(ticket.name_space + "/user_dict_cache_size", &cache_size);
 
   return new UserDictionary(dict_name, db, ticket.schema->schema_id(),
                             delete_threshold, enable_filtering,
-                            forced_selection, single_selection, lower_case);
+                            forced_selection, single_selection, lower_case,
+                            flush_interval, flush_size, cache_size,
+                            write_buffer);
+}
+
+bool UserDictFlushTask::Run(Deployer* deployer) {
+  auto component = dynamic_cast<UserDictionaryComponent*>(
+      UserDictionary::Require("user_dictionary"));
+  if (!component)
+    return false;
+  size_t flushed = component->FlushDue();
+  if (flushed > 0) {
+    LOG(INFO) << "flushed pending updates to " << flushed << " user dbs.";
+  }
+  return true;
 }
 }  // namespace rime
@@ -8,8 +8,10 @@
 #define RIME_USER_DICTIONARY_H_
 
 #include <time.h>
+#include <mutex>
 #include <rime/common.h>
 #include <rime/component.h>
+#include <rime/deployer.h>
 #include <rime/dict/user_db.h>
 #include <rime/dict/vocabulary.h>
 
@@ -25,6 +27,7 @@ class UserDictEntryIterator : public DictEntryFilterBinder {
 
   bool SetIndex(size_t index);
 
+  using DictEntryFilterBinder::AddFilter;
   void AddFilter(DictEntryFilter filter) override;
   an<DictEntry> Peek();
   bool Next();
@@ -44,13 +47,66 @@ class Schema;
 class Table;
 class Prism;
 class Db;
+struct CompactSyllableGraph;
 struct SyllableGraph;
 struct DfsState;
 struct Ticket;
+class UserDictQueryCache;
+class UserDictWriteBuffer;
+
+// lookup behaviours of the sbxlm schemas, resolved once from the dict name
+// instead of matching regular expressions against it on every lookup
+struct UserDictProfile {
+  enum Scheme {
+    kGeneric,
+    kSbjm,
+    kSbfx,
+    kSbzr,  // also sbxh, sbfm and sbfd
+  };
+  Scheme scheme = kGeneric;
+  // number of leading code letters used to seek the db, 0 for the whole input
+  size_t seek_length = 0;
+
+  bool is_sbxlm() const { return scheme != kGeneric; }
+  bool is_sbjm() const { return scheme == kSbjm; }
+  bool is_sbfx() const { return scheme == kSbfx; }
+  bool is_sbzr() const { return scheme == kSbzr; }
+  bool is_sbjm_or_sbfx() const { return is_sbjm() || is_sbfx(); }
+  bool is_sbjm_or_sbzr() const { return is_sbjm() || is_sbzr(); }
+
+  static UserDictProfile Resolve(const string& dict_name);
+};
+
+// words memorized through the successive lookups as a user types in one
+// session, by which sbxlm schemas arrange the candidates of longer codes.
+// each session (e.g. a translator) keeps its own copy, so that a user
+// dictionary shared among sessions stays reentrant.
+struct UserDictLookupState {
+  static constexpr int kMaxWords = 7;
+  string words[kMaxWords];
+
+  void Clear() {
+    for (string& word : words)
+      word.clear();
+  }
+};
+
+// where a predictive lookup stopped, resumed by the next lookup with the scan
+// of the db held open
+struct UserDictLookupCursor {
+  // the scan starts after this key, e.g. the last exact match
+  string resume_key;
+  an<DbAccessor> accessor;
+};
 
 class UserDictionary : public Class<UserDictionary, const Ticket&> {
  public:
-  UserDictionary(const string& name, an<Db> db, const string& schema);
+  // dictionaries given the same write buffer share the pending updates to
+  // the db; a buffer of its own is created if none is given
+  UserDictionary(const string& name,
+                 an<Db> db,
+                 const string& schema,
+                 an<UserDictWriteBuffer> write_buffer = nullptr);
   UserDictionary(const string& name,
                  an<Db> db,
                  const string& schema,
@@ -58,7 +114,11 @@ class UserDictionary : public Class<UserDictionary, const Ticket&> {
                  const bool& enable_filtering,
                  const bool& forced_seletion,
                  const bool& single_selection,
-                 const bool& lower_case);
+                 const bool& lower_case,
+                 const int& flush_interval,
+                 const int& flush_size,
+                 const int& cache_size,
+                 an<UserDictWriteBuffer> write_buffer = nullptr);
   virtual ~UserDictionary();
 
   void Attach(const an<Table>& table, const an<Prism>& prism);
@@ -66,15 +126,38 @@ class UserDictionary : public Class<UserDictionary, const Ticket&> {
   bool loaded() const;
   bool readonly() const;
 
+  an<UserDictEntryCollector> Lookup(const CompactSyllableGraph& syllable_graph,
+                                    size_t start_pos,
+                                    size_t depth_limit = 0,
+                                    double initial_credibility = 0.0);
+  // looks up phrases from every start position of the syllable graph in a
+  // single pass over the db, indexed by start position
+  map<size_t, an<UserDictEntryCollector>> LookupAll(
+      const CompactSyllableGraph& syllable_graph,
+      size_t depth_limit = 0,
+      double initial_credibility = 0.0);
+  // same as above, converting the graph from nested maps
   an<UserDictEntryCollector> Lookup(const SyllableGraph& syllable_graph,
                                     size_t start_pos,
                                     size_t depth_limit = 0,
                                     double initial_credibility = 0.0);
+  map<size_t, an<UserDictEntryCollector>> LookupAll(
+      const SyllableGraph& syllable_graph,
+      size_t depth_limit = 0,
+      double initial_credibility = 0.0);
   size_t LookupWords(UserDictEntryIterator* result,
                      const string& input,
                      bool predictive,
                      size_t limit = 0,
-                     string* resume_key = NULL);
+                     string* resume_key = NULL,
+                     UserDictLookupState* state = nullptr);
+  // continues a predictive lookup from where the cursor stopped, adding at
+  // most limit entries more to result
+  size_t LookupWords(UserDictEntryIterator* result,
+                     const string& input,
+                     UserDictLookupCursor* cursor,
+                     size_t limit,
+                     UserDictLookupState* state = nullptr);
   bool UpdateEntry(const DictEntry& entry, int commits);
   bool UpdateEntry(const DictEntry& entry,
                    int commits,
@@ -85,14 +168,23 @@ class UserDictionary : public Class<UserDictionary, const Ticket&> {
   bool NewTransaction();
   bool RevertRecentTransaction();
   bool CommitPendingTransaction();
+  // writes the updates buffered since the last flush to the db, including
+  // those of the other user dictionaries opened on it
+  bool Flush();
 
   bool TranslateCodeToString(const Code& code, string* result);
 
   const string& name() const { return name_; }
-  TickCount tick() const { return tick_; }
+  TickCount tick() const;
   const int& delete_threshold() const { return delete_threshold_; }
   const bool& enable_filtering() const { return enable_filtering_; }
   const bool& forced_selection() const { return forced_selection_; }
+  size_t pending_updates() const;
+  const an<UserDictWriteBuffer>& write_buffer() const { return write_buffer_; }
+  size_t query_cache_hits() const;
+  size_t query_cache_misses() const;
+  // number of db seeks made by syllable graph lookups so far
+  size_t seek_count() const { return seek_count_; }
 
   static an<DictEntry> CreateDictEntry(const string& key,
                                        const string& value,
@@ -103,19 +195,54 @@ class UserDictionary : public Class<UserDictionary, const Ticket&> {
  protected:
   bool Initialize();
   bool FetchTickCount();
-  void DfsLookup(const SyllableGraph& syll_graph,
-                 size_t current_pos,
-                 const string& current_prefix,
+  bool FetchEntry(const string& key, string* value);
+  bool StoreEntry(const string& key, const string& value);
+  an<DbAccessor> QueryEntries(const string& prefix);
+  an<DbAccessor> QueryCachedEntries(const string& prefix);
+  bool IsFlushDue() const;
+  size_t ScanWords(UserDictEntryIterator* result,
+                   const string& input,
+                   bool predictive,
+                   size_t limit,
+                   string* resume_key,
+                   UserDictLookupState* state,
+                   UserDictLookupCursor* cursor);
+  bool AppendSpelling(SyllableId syllable_id, string* prefix);
+  void DfsLookup(const CompactSyllableGraph& syll_graph, DfsState* state);
+  void DfsLookup(const CompactSyllableGraph& syll_graph,
+                 size_t depth,
                  DfsState* state);
 
  private:
   string name_;
   an<Db> db_;
   string schema_;
+  UserDictProfile profile_;
   an<Table> table_;
   an<Prism> prism_;
-  TickCount tick_ = 0;
+  // spellings of syllables by id, fetched from the table on demand
+  vector<string> syllable_spellings_;
+  // write-behind buffer of entries updated since the last flush, and of the
+  // tick count, shared by the user dictionaries opened on the same db.
+  // a flush is made when an update or a commit finds it due, on Flush(), on
+  // destruction of any of the dictionaries, and by the "user_dict_flush"
+  // task once the flush interval has passed, which runs as stale sessions
+  // are cleaned up. so the updates are lost if the process exits without
+  // destroying its sessions.
+  an<UserDictWriteBuffer> write_buffer_;
   time_t transaction_time_ = 0;
+  bool in_transaction_ = false;
+  // flushes of the buffer made before the current transaction began
+  size_t transaction_flushes_ = 0;
+  // pending values of the keys updated in the current transaction before
+  // it began; an empty value stands for no pending update
+  map<string, string> transaction_log_;
+  int flush_interval_ = 5;  // seconds to keep updates pending at most,
+                            // 0 means writing through
+  int flush_size_ = 64;     // number of pending entries to trigger a flush
+  // records of recently queried prefixes, reused while the user types
+  an<UserDictQueryCache> query_cache_;
+  size_t seek_count_ = 0;
   int delete_threshold_ = 1000;  // tick distance to delete a word
                                  // automatically, 0 means no deletion
   bool enable_filtering_ =
@@ -135,9 +262,26 @@ class UserDictionaryComponent : public UserDictionary::Component {
   UserDictionary* Create(const string& dict_name,
                          const string& db_class,
                          const string& schema);
+  // flushes the write buffers of the pooled dbs whose pending updates have
+  // waited out the flush interval by now; returns the number of flushes
+  size_t FlushDue(time_t now = time(NULL));
 
  private:
-  map<string, weak<Db>> db_pool_;
+  // the pooled write buffer of the db, opening the db if not in the pool
+  an<UserDictWriteBuffer> AcquireWriteBuffer(const string& dict_name,
+                                              const string& db_class,
+                                              bool* created = nullptr);
+
+  std::mutex mutex_;
+  // write buffers by dict name, each holding the db it writes to
+  map<string, weak<UserDictWriteBuffer>> db_pool_;
+};
+
+// writes the pending updates of idle user dictionaries once due
+class UserDictFlushTask : public DeploymentTask {
+ public:
+  UserDictFlushTask(TaskInitializer arg = TaskInitializer()) {}
+  bool Run(Deployer* deployer);
 };
 
 }  // namespace rime
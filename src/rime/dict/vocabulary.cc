@@ -118,12 +118,24 @@ void DictEntryFilterBinder::AddFilter(DictEntryFilter filter) {
     filter_.swap(filter);
   } else {
     DictEntryFilter previous_filter(std::move(filter_));
-    filter_ = [previous_filter, filter](an<DictEntry> e) {
+    filter_ = [previous_filter, filter](const DictEntryView& e) {
       return previous_filter(e) && filter(e);
     };
   }
 }
 
+void DictEntryFilterBinder::AddFilter(DictEntryPtrFilter filter) {
+  AddFilter([filter](const DictEntryView& e) {
+    auto entry = New<DictEntry>();
+    entry->text = e.text.to_string();
+    if (e.code)
+      entry->code = *e.code;
+    entry->weight = e.weight;
+    entry->remaining_code_length = e.remaining_code_length;
+    return filter(entry);
+  });
+}
+
 ShortDictEntryList* Vocabulary::LocateEntries(const Code& code) {
   Vocabulary* v = this;
   size_t n = code.size();
@@ -66,12 +66,33 @@ class DictEntryList : public vector<of<DictEntry>> {
   void SortRange(size_t start, size_t count);
 };
 
-using DictEntryFilter = function<bool(an<DictEntry> entry)>;
+// a dict entry viewed where it is stored, without copying its code.
+// valid as long as the viewed entry, or the buffer its text is decoded into
+struct DictEntryView {
+  string_view text;
+  const Code* code = nullptr;
+  double weight = 0.0;
+  int remaining_code_length = 0;
+
+  DictEntryView() = default;
+  explicit DictEntryView(const DictEntry& entry)
+      : text(entry.text),
+        code(&entry.code),
+        weight(entry.weight),
+        remaining_code_length(entry.remaining_code_length) {}
+};
+
+using DictEntryFilter = function<bool(const DictEntryView& entry)>;
+// filters written before views, given a dict entry made of the view
+using DictEntryPtrFilter = function<bool(an<DictEntry> entry)>;
 
 class RIME_API DictEntryFilterBinder {
  public:
   virtual ~DictEntryFilterBinder() = default;
   virtual void AddFilter(DictEntryFilter filter);
+  // compatible with filters of an<DictEntry>, at the cost of making a dict
+  // entry of each entry filtered; the entry made bears no comment
+  void AddFilter(DictEntryPtrFilter filter);
 
  protected:
   DictEntryFilter filter_;
@@ -34,12 +34,12 @@ bool is_extended_cjk(uint32_t ch) {
   return false;
 }
 
-bool contains_extended_cjk(const string& text) {
-  const char* p = text.c_str();
-  uint32_t ch;
+bool contains_extended_cjk(string_view text) {
+  const char* p = text.data();
+  const char* end = p + text.size();
 
-  while ((ch = utf8::unchecked::next(p)) != 0) {
-    if (is_extended_cjk(ch)) {
+  while (p < end) {
+    if (is_extended_cjk(utf8::unchecked::next(p))) {
       return true;
     }
   }
@@ -85,12 +85,12 @@ bool CharsetFilterTranslation::LocateNextCandidate() {
 
 // CharsetFilter
 
-bool CharsetFilter::FilterText(const string& text) {
+bool CharsetFilter::FilterText(string_view text) {
   return !contains_extended_cjk(text);
 }
 
-bool CharsetFilter::FilterDictEntry(an<DictEntry> entry) {
-  return entry && FilterText(entry->text);
+bool CharsetFilter::FilterDictEntry(const DictEntryView& entry) {
+  return FilterText(entry.text);
 }
 
 CharsetFilter::CharsetFilter(const Ticket& ticket)
@@ -29,7 +29,7 @@ class CharsetFilterTranslation : public Translation {
   an<Translation> translation_;
 };
 
-struct DictEntry;
+struct DictEntryView;
 
 class CharsetFilter : public Filter, TagMatching {
  public:
@@ -41,8 +41,8 @@ class CharsetFilter : public Filter, TagMatching {
   virtual bool AppliesToSegment(Segment* segment) { return TagsMatch(segment); }
 
   // return true to accept, false to reject the tested item
-  static bool FilterText(const string& text);
-  static bool FilterDictEntry(an<DictEntry> entry);
+  static bool FilterText(string_view text);
+  static bool FilterDictEntry(const DictEntryView& entry);
 };
 
 }  // namespace rime
@@ -173,20 +173,20 @@ an<Translation> ReverseLookupTranslator::Query(const string& input,
   if (start < input.length()) {
     if (options_ && options_->enable_completion()) {
       dict_->LookupWords(&iter, code, true, 100);
-      quality = !iter.exhausted() && (iter.Peek()->remaining_code_length == 0);
+      quality =
+          !iter.exhausted() && (iter.PeekView().remaining_code_length == 0);
     } else {
       // 2012-04-08 gongchen: fetch multi-syllable words from rev-lookup table
-      SyllableGraph graph;
       Syllabifier syllabifier("", true, options_->strict_spelling());
-      size_t consumed =
-          syllabifier.BuildSyllableGraph(code, *dict_->prism(), &graph);
+      size_t consumed = syllabifier.BuildSyllableGraph(code, *dict_->prism());
+      const auto& graph = syllabifier.syllable_graph();
       if (consumed == code.length()) {
         auto collector = dict_->Lookup(graph, 0);
         if (collector && !collector->empty() &&
             collector->rbegin()->first == consumed) {
           iter = std::move(collector->rbegin()->second);
           quality = !graph.vertices.empty() &&
-                    (graph.vertices.rbegin()->second == kNormalSpelling);
+                    (graph.vertices.back().second == kNormalSpelling);
         }
       }
     }
@@ -10,7 +10,6 @@
 #include <stack>
 #include <cmath>
 #include <boost/algorithm/string/join.hpp>
-#include <boost/range/adaptor/reversed.hpp>
 #include <rime/composition.h>
 #include <rime/candidate.h>
 #include <rime/config.h>
@@ -35,7 +34,7 @@ namespace {
 
 struct SyllabifyTask {
   const Code& code;
-  const SyllableGraph& graph;
+  const CompactSyllableGraph& graph;
   size_t target_pos;
   function<void(SyllabifyTask* task,
                 size_t depth,
@@ -52,21 +51,17 @@ static bool syllabify_dfs(SyllabifyTask* task,
     return current_pos == task->target_pos;
   }
   SyllableId syllable_id = task->code.at(depth);
-  auto z = task->graph.edges.find(current_pos);
-  if (z == task->graph.edges.end())
-    return false;
   // favor longer spellings
-  for (const auto& y : boost::adaptors::reverse(z->second)) {
-    size_t end_vertex_pos = y.first;
+  auto spellings = task->graph.FindSyllable(current_pos, syllable_id);
+  for (size_t i = spellings.first; i < spellings.second; ++i) {
+    const auto& edge = task->graph.edges[task->graph.index[i]];
+    size_t end_vertex_pos = edge.properties.end_pos;
     if (end_vertex_pos > task->target_pos)
       continue;
-    auto x = y.second.find(syllable_id);
-    if (x != y.second.end()) {
-      task->push(task, depth, current_pos, end_vertex_pos);
-      if (syllabify_dfs(task, depth + 1, end_vertex_pos))
-        return true;
-      task->pop(task, depth);
-    }
+    task->push(task, depth, current_pos, end_vertex_pos);
+    if (syllabify_dfs(task, depth + 1, end_vertex_pos))
+      return true;
+    task->pop(task, depth);
   }
   return false;
 }
@@ -88,6 +83,7 @@ class ScriptSyllabifier : public PhraseSyllabifier {
     if (corrector) {
       syllabifier_.EnableCorrection(corrector);
     }
+    syllabifier_.EnableIncremental(translator->syllable_graph_cache());
   }
 
   virtual Spans Syllabify(const Phrase* phrase);
@@ -96,14 +92,15 @@ class ScriptSyllabifier : public PhraseSyllabifier {
   string GetOriginalSpelling(const Phrase& cand) const;
   bool IsCandidateCorrection(const Phrase& cand) const;
 
-  const SyllableGraph& syllable_graph() const { return syllable_graph_; }
+  const CompactSyllableGraph& syllable_graph() const {
+    return syllabifier_.syllable_graph();
+  }
 
  protected:
   ScriptTranslator* translator_;
   string input_;
   size_t start_;
   Syllabifier syllabifier_;
-  SyllableGraph syllable_graph_;
 };
 
 class ScriptTranslation : public Translation {
@@ -157,7 +154,10 @@ class ScriptTranslation : public Translation {
 // ScriptTranslator implementation
 
 ScriptTranslator::ScriptTranslator(const Ticket& ticket)
-    : Translator(ticket), Memory(ticket), TranslatorOptions(ticket) {
+    : Translator(ticket),
+      Memory(ticket),
+      TranslatorOptions(ticket),
+      syllable_graph_cache_(New<SyllableGraphCache>()) {
   if (!engine_)
     return;
   if (Config* config = engine_->schema()->config()) {
@@ -253,7 +253,7 @@ Spans ScriptSyllabifier::Syllabify(const Phrase* phrase) {
   vector<size_t> vertices;
   vertices.push_back(start_);
   SyllabifyTask task{
-      phrase->code(), syllable_graph_, phrase->end() - start_,
+      phrase->code(), syllable_graph(), phrase->end() - start_,
       [&](SyllabifyTask* task, size_t depth, size_t current_pos,
           size_t next_pos) { vertices.push_back(start_ + next_pos); },
       [&](SyllabifyTask* task, size_t depth) { vertices.pop_back(); }};
@@ -264,34 +264,20 @@ Spans ScriptSyllabifier::Syllabify(const Phrase* phrase) {
 }
 
 size_t ScriptSyllabifier::BuildSyllableGraph(Prism& prism) {
-  return (size_t)syllabifier_.BuildSyllableGraph(input_, prism,
-                                                 &syllable_graph_);
+  return (size_t)syllabifier_.BuildSyllableGraph(input_, prism);
 }
 
 bool ScriptSyllabifier::IsCandidateCorrection(const rime::Phrase& cand) const {
   std::stack<bool> results;
   // Perform DFS on syllable graph to find whether this candidate is a
   // correction
-  SyllabifyTask task{cand.code(), syllable_graph_, cand.end() - start_,
+  SyllabifyTask task{cand.code(), syllable_graph(), cand.end() - start_,
                      [&](SyllabifyTask* task, size_t depth, size_t current_pos,
                          size_t next_pos) {
                        auto id = cand.code()[depth];
-                       auto it_s = syllable_graph_.edges.find(current_pos);
-                       // C++ prohibit operator [] of const map
-                       // if
-                       // (syllable_graph_.edges[current_pos][next_pos][id].type
-                       // == kCorrection)
-                       if (it_s != syllable_graph_.edges.end()) {
-                         auto it_e = it_s->second.find(next_pos);
-                         if (it_e != it_s->second.end()) {
-                           auto it_type = it_e->second.find(id);
-                           if (it_type != it_e->second.end()) {
-                             results.push(it_type->second.is_correction);
-                             return;
-                           }
-                         }
-                       }
-                       results.push(false);
+                       auto edge = syllable_graph().FindEdge(current_pos,
+                                                             next_pos, id);
+                       results.push(edge && edge->properties.is_correction);
                      },
                      [&](SyllabifyTask* task, size_t depth) { results.pop(); }};
   if (syllabify_dfs(&task, 0, cand.start() - start_)) {
@@ -307,7 +293,7 @@ string ScriptSyllabifier::GetPreeditString(const Phrase& cand) const {
   const auto& delimiters = translator_->delimiters();
   std::stack<size_t> lengths;
   string output;
-  SyllabifyTask task{cand.code(), syllable_graph_, cand.end() - start_,
+  SyllabifyTask task{cand.code(), syllable_graph(), cand.end() - start_,
                      [&](SyllabifyTask* task, size_t depth, size_t current_pos,
                          size_t next_pos) {
                        size_t len = output.length();
@@ -356,8 +342,13 @@ bool ScriptTranslation::Evaluate(Dictionary* dict, UserDictionary* user_dict) {
     translated_len = (std::max)(translated_len, phrase_->rbegin()->first);
   if (user_phrase_ && !user_phrase_->empty())
     translated_len = (std::max)(translated_len, user_phrase_->rbegin()->first);
+  size_t num_syllable_starts = 0;
+  for (const auto& v : syllable_graph.vertices) {
+    if (syllable_graph.has_edges(v.first))
+      ++num_syllable_starts;
+  }
   if (translated_len < consumed &&
-      syllable_graph.edges.size() > 1) {  // at least 2 syllables required
+      num_syllable_starts > 1) {  // at least 2 syllables required
     sentence_ = MakeSentence(dict, user_dict);
   }
 
@@ -508,15 +499,23 @@ an<Sentence> ScriptTranslation::MakeSentence(Dictionary* dict,
   const int kMaxSyllablesForUserPhraseQuery = 5;
   const auto& syllable_graph = syllabifier_->syllable_graph();
   WordGraph graph;
-  for (const auto& x : syllable_graph.edges) {
-    auto& same_start_pos = graph[x.first];
-    if (user_dict) {
-      EnrollEntries(same_start_pos,
-                    user_dict->Lookup(syllable_graph, x.first,
-                                      kMaxSyllablesForUserPhraseQuery));
+  map<size_t, an<UserDictEntryCollector>> user_phrases;
+  if (user_dict) {
+    // look up user phrases from all start positions in one pass
+    user_phrases =
+        user_dict->LookupAll(syllable_graph, kMaxSyllablesForUserPhraseQuery);
+  }
+  for (const auto& v : syllable_graph.vertices) {
+    size_t start_pos = v.first;
+    if (!syllable_graph.has_edges(start_pos))
+      continue;
+    auto& same_start_pos = graph[start_pos];
+    auto user_phrase = user_phrases.find(start_pos);
+    if (user_phrase != user_phrases.end()) {
+      EnrollEntries(same_start_pos, user_phrase->second);
     }
     // merge lookup results
-    EnrollEntries(same_start_pos, dict->Lookup(syllable_graph, x.first));
+    EnrollEntries(same_start_pos, dict->Lookup(syllable_graph, start_pos));
   }
   if (auto sentence =
           poet_->MakeSentence(graph, syllable_graph.interpreted_length,
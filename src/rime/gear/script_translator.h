@@ -23,6 +23,7 @@ class Dictionary;
 class Poet;
 class UserDictionary;
 struct SyllableGraph;
+struct SyllableGraphCache;
 
 class ScriptTranslator : public Translator,
                          public Memory,
@@ -41,6 +42,9 @@ class ScriptTranslator : public Translator,
   int max_homophones() const { return max_homophones_; }
   int spelling_hints() const { return spelling_hints_; }
   bool always_show_comments() const { return always_show_comments_; }
+  SyllableGraphCache* syllable_graph_cache() const {
+    return syllable_graph_cache_.get();
+  }
 
  protected:
   int max_homophones_ = 1;
@@ -49,6 +53,8 @@ class ScriptTranslator : public Translator,
   bool enable_correction_ = false;
   the<Corrector> corrector_;
   the<Poet> poet_;
+  // edges of the last syllabified input, reused as the input is typed on
+  an<SyllableGraphCache> syllable_graph_cache_;
 };
 
 }  // namespace rime
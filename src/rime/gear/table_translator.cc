@@ -104,7 +104,7 @@ bool TableTranslation::PreferUserPhrase() {
     return false;
   if (iter_.exhausted())
     return true;
-  if (iter_.Peek()->remaining_code_length == 0 &&
+  if (iter_.PeekView().remaining_code_length == 0 &&
       (uter_.Peek()->remaining_code_length != 0 ||
        is_constructed(uter_.Peek().get())))
     return false;
@@ -126,15 +126,23 @@ class LazyTableTranslation : public TableTranslation {
                        const string& preedit,
                        bool enable_user_dict);
   bool FetchUserPhrases(TableTranslator* translator);
+  bool FetchCompletions();
   virtual bool FetchMoreUserPhrases();
   virtual bool FetchMoreTableEntries();
 
  private:
   Dictionary* dict_;
   UserDictionary* user_dict_;
+  UserDictLookupState* user_dict_state_;
   size_t limit_;
   size_t user_dict_limit_;
-  string user_dict_key_;
+  // where the lookups for more entries stopped
+  ExpandSearchCursor cursor_;
+  UserDictLookupCursor user_dict_cursor_;
+  // entries served from the completion index so far, of the ones indexed
+  size_t num_completions_ = 0;
+  size_t num_indexed_ = 0;
+  bool completions_complete_ = false;
 };
 
 LazyTableTranslation::LazyTableTranslation(TableTranslator* translator,
@@ -151,10 +159,11 @@ LazyTableTranslation::LazyTableTranslation(TableTranslator* translator,
                        preedit),
       dict_(translator->dict()),
       user_dict_(enable_user_dict ? translator->user_dict() : NULL),
+      user_dict_state_(translator->user_dict_state()),
       limit_(kInitialSearchLimit),
       user_dict_limit_(kInitialSearchLimit) {
   FetchUserPhrases(translator) || FetchMoreUserPhrases();
-  FetchMoreTableEntries();
+  FetchCompletions() || FetchMoreTableEntries();
   CheckEmpty();
 }
 
@@ -162,10 +171,11 @@ bool LazyTableTranslation::FetchUserPhrases(TableTranslator* translator) {
   if (!user_dict_)
     return false;
   // fetch all exact match entries
-  user_dict_->LookupWords(&uter_, input_, false, 0, &user_dict_key_);
+  user_dict_->LookupWords(&uter_, input_, false, 0,
+                          &user_dict_cursor_.resume_key, user_dict_state_);
   auto encoder = translator->encoder();
   if (encoder && encoder->loaded()) {
-    encoder->LookupPhrases(&uter_, input_, false);
+    encoder->LookupPhrases(&uter_, input_, false, 0, NULL, user_dict_state_);
   }
   return !uter_.exhausted();
 }
@@ -173,8 +183,8 @@ bool LazyTableTranslation::FetchUserPhrases(TableTranslator* translator) {
 bool LazyTableTranslation::FetchMoreUserPhrases() {
   if (!user_dict_ || user_dict_limit_ == 0)
     return false;
-  size_t count = user_dict_->LookupWords(&uter_, input_, true, user_dict_limit_,
-                                         &user_dict_key_);
+  size_t count = user_dict_->LookupWords(&uter_, input_, &user_dict_cursor_,
+                                         user_dict_limit_, user_dict_state_);
   if (count < user_dict_limit_) {
     DLOG(INFO) << "all user dict entries obtained.";
     user_dict_limit_ = 0;  // no more try
@@ -184,21 +194,54 @@ bool LazyTableTranslation::FetchMoreUserPhrases() {
   return !uter_.exhausted();
 }
 
+bool LazyTableTranslation::FetchCompletions() {
+  if (!dict_)
+    return false;
+  num_indexed_ = dict_->LookupCompletions(&iter_, input_, 0, limit_,
+                                          &completions_complete_);
+  if (num_indexed_ == 0)
+    return false;
+  num_completions_ = iter_.entry_count();
+  DLOG(INFO) << "fetched " << num_completions_ << " of " << num_indexed_
+             << " completions.";
+  return true;
+}
+
 bool LazyTableTranslation::FetchMoreTableEntries() {
   if (!dict_ || limit_ == 0)
     return false;
-  size_t previous_entry_count = iter_.entry_count();
-  DLOG(INFO) << "fetching more table entries: limit = " << limit_
-             << ", count = " << previous_entry_count;
+  if (num_indexed_ > 0) {
+    DictEntryIterator more;
+    if (num_completions_ < num_indexed_) {
+      limit_ *= kExpandingFactor;
+      dict_->LookupCompletions(&more, input_, num_completions_, limit_);
+      num_completions_ += more.entry_count();
+    } else {
+      limit_ = 0;  // no more try
+      if (completions_complete_)
+        return false;
+      // the rest of all entries, following the completions in order
+      dict_->LookupWords(&more, input_, true);
+      more.Sort();
+      more.Skip(num_completions_);
+    }
+    if (!more.exhausted()) {
+      iter_ = std::move(more);
+    }
+    return true;
+  }
+  // the entries of keys found before are all consumed
   DictEntryIterator more;
-  if (dict_->LookupWords(&more, input_, true, limit_) < limit_) {
-    DLOG(INFO) << "all table entries obtained.";
-    limit_ = 0;  // no more try
-  } else {
-    limit_ *= kExpandingFactor;
+  while (more.exhausted() && limit_ != 0) {
+    DLOG(INFO) << "fetching more table entries: limit = " << limit_;
+    if (dict_->LookupWords(&more, input_, &cursor_, limit_) < limit_) {
+      DLOG(INFO) << "all table entries obtained.";
+      limit_ = 0;  // no more try
+    } else {
+      limit_ *= kExpandingFactor;
+    }
   }
-  if (more.entry_count() > previous_entry_count) {
-    more.Skip(previous_entry_count);
+  if (!more.exhausted()) {
     iter_ = std::move(more);
   }
   return true;
@@ -331,14 +374,17 @@ an<Translation> TableTranslator::Query(const string& input,
       else if (boost::regex_match(dict_->name(), boost::regex("^sbjm$")) &&
                code.length() == 3) {
         if (ctx->get_option("third_pop"))
-          user_dict_->LookupWords(&uter, code, false);
+          user_dict_->LookupWords(&uter, code, false, 0, NULL,
+                                  &user_dict_state_);
         else if (!ctx->get_option("slow_adjust") &&
                  string("aeuio").find(code[2]) != string::npos)
-          user_dict_->LookupWords(&uter, code, false);
+          user_dict_->LookupWords(&uter, code, false, 0, NULL,
+                                  &user_dict_state_);
         else
           ;
       } else
-        user_dict_->LookupWords(&uter, code, false);
+        user_dict_->LookupWords(&uter, code, false, 0, NULL,
+                                &user_dict_state_);
       if (encoder_ && encoder_->loaded()) {
         if (boost::regex_match(user_dict_->name(),
                                boost::regex("^sbjm|sbfx$")) &&
@@ -350,7 +396,8 @@ an<Translation> TableTranslator::Query(const string& input,
                  code.length() == 3)
           ;
         else
-          encoder_->LookupPhrases(&uter, code, false);
+          encoder_->LookupPhrases(&uter, code, false, 0, NULL,
+                                  &user_dict_state_);
       }
     }
     if (!iter.exhausted() || !uter.exhausted())
@@ -689,7 +736,8 @@ an<Translation> TableTranslator::MakeSentence(const string& input,
         UserDictEntryIterator uter;
         string resume_key;
         string key = active_input.substr(0, len);
-        user_dict_->LookupWords(&uter, key, false, 0, &resume_key);
+        user_dict_->LookupWords(&uter, key, false, 0, &resume_key,
+                                &user_dict_state_);
         if (filter_by_charset) {
           uter.AddFilter(CharsetFilter::FilterDictEntry);
         }
@@ -728,7 +776,8 @@ an<Translation> TableTranslator::MakeSentence(const string& input,
         UserDictEntryIterator uter;
         string resume_key;
         string key = active_input.substr(0, len);
-        encoder_->LookupPhrases(&uter, key, false, 0, &resume_key);
+        encoder_->LookupPhrases(&uter, key, false, 0, &resume_key,
+                                &user_dict_state_);
         if (filter_by_charset) {
           uter.AddFilter(CharsetFilter::FilterDictEntry);
         }
@@ -36,6 +36,7 @@ class TableTranslator : public Translator,
                                bool include_prefix_phrases = false);
   string GetPrecedingText(size_t start) const;
   UnityTableEncoder* encoder() const { return encoder_.get(); }
+  UserDictLookupState* user_dict_state() { return &user_dict_state_; }
 
  protected:
   bool enable_charset_filter_ = false;
@@ -48,6 +49,7 @@ class TableTranslator : public Translator,
   int max_homographs_ = 1;
   the<Poet> poet_;
   the<UnityTableEncoder> encoder_;
+  UserDictLookupState user_dict_state_;
 };
 
 class TableTranslation : public Translation {
@@ -72,7 +72,8 @@ size_t UnityTableEncoder::LookupPhrases(UserDictEntryIterator* result,
                                         const string& input,
                                         bool predictive,
                                         size_t limit,
-                                        string* resume_key) {
+                                        string* resume_key,
+                                        UserDictLookupState* state) {
   if (!user_dict_)
     return 0;
   if (boost::regex_match(user_dict_->name(), boost::regex("^sbjm|sbfx$")) &&
@@ -85,7 +86,7 @@ size_t UnityTableEncoder::LookupPhrases(UserDictEntryIterator* result,
   }
 
   return user_dict_->LookupWords(result, kEncodedPrefix + input, predictive,
-                                 limit, resume_key);
+                                 limit, resume_key, state);
 }
 
 bool UnityTableEncoder::HasPrefix(const string& key) {
@@ -15,6 +15,7 @@ namespace rime {
 struct Ticket;
 class ReverseLookupDictionary;
 class UserDictionary;
+struct UserDictLookupState;
 
 class UnityTableEncoder : public TableEncoder, public PhraseCollector {
  public:
@@ -32,7 +33,8 @@ class UnityTableEncoder : public TableEncoder, public PhraseCollector {
                        const string& input,
                        bool predictive,
                        size_t limit = 0,
-                       string* resume_key = NULL);
+                       string* resume_key = NULL,
+                       UserDictLookupState* state = nullptr);
 
   static bool HasPrefix(const string& key);
   static bool AddPrefix(string* key);
@@ -139,6 +139,10 @@ void Service::CleanupStaleSessions() {
   if (count > 0) {
     LOG(INFO) << "Recycled " << count << " stale sessions.";
   }
+  // the remaining sessions may be idle with user dict updates pending
+  if (DeploymentTask::Require("user_dict_flush")) {
+    deployer_.RunTask("user_dict_flush");
+  }
 }
 
 void Service::CleanupAllSessions() {
@@ -97,6 +97,25 @@ TEST_F(RimeCorrectorSearchTest, CaseFarSubstitute) {
   ASSERT_TRUE(g.vertices.end() == g.vertices.find(5));
 }
 
+TEST_F(RimeCorrectorSearchTest, CaseKeyboardLayout) {
+  rime::corrector::Corrections qwerty_results;
+  corrector_->ToleranceSearch(*prism_, "chong", &qwerty_results, 1);
+  EXPECT_TRUE(qwerty_results.empty());
+  const rime::KeyboardLayout* dvorak = rime::KeyboardLayout::Find("dvorak");
+  ASSERT_TRUE(dvorak != nullptr);
+  EXPECT_TRUE(dvorak->IsNeighbor('o', 'a'));
+  rime::NearSearchCorrector dvorak_corrector(*dvorak);
+  rime::corrector::Corrections dvorak_results;
+  dvorak_corrector.ToleranceSearch(*prism_, "chong", &dvorak_results, 1);
+  ASSERT_EQ(1, dvorak_results.size());
+  auto& correction = dvorak_results[syllable_id_["chang"]];
+  EXPECT_EQ(1, correction.distance);
+  EXPECT_EQ(5, correction.length);
+  EXPECT_TRUE(rime::KeyboardLayout::Qwerty().IsNeighbor('2', 'e'));
+  EXPECT_FALSE(rime::KeyboardLayout::Qwerty().IsNeighbor('q', '1'));
+  EXPECT_TRUE(rime::KeyboardLayout::Find("colemak") == nullptr);
+}
+
 TEST_F(RimeCorrectorSearchTest, DISABLED_CaseTranspose) {
   rime::Syllabifier s;
   s.EnableCorrection(corrector_.get());
@@ -153,3 +172,46 @@ TEST_F(RimeCorrectorTest, CaseMultipleEdges1) {
   ASSERT_FALSE(sp2.end() == sp2.find(syllable_id_["jue"]));
   ASSERT_TRUE(sp2[syllable_id_["jue"]].type == rime::kNormalSpelling);
 }
+
+TEST(RimeCorrectorDistanceTest, WeightedDistances) {
+  rime::EditDistanceCorrector corrector("corrector_distance_test.bin");
+  EXPECT_EQ(0, corrector.RestrictedDistance("chang", "chang", 5));
+  // mistyped for a neighboring key
+  EXPECT_EQ(1, corrector.RestrictedDistance("chang", "chsng", 5));
+  EXPECT_EQ(2, corrector.RestrictedDistance("chang", "chng", 5));
+  EXPECT_EQ(2, corrector.RestrictedDistance("chang", "cahng", 5));
+  EXPECT_EQ(4, corrector.RestrictedDistance("chang", "ang", 5));
+  EXPECT_LT(5, corrector.RestrictedDistance("chang", "xyz", 5));
+  EXPECT_EQ(1, corrector.LevenshteinDistance("chang", "chsng"));
+  EXPECT_EQ(1, corrector.LevenshteinDistance("chang", "chng"));
+  EXPECT_EQ(2, corrector.LevenshteinDistance("chang", "cahng"));
+  EXPECT_EQ(8, corrector.LevenshteinDistance("chang", "ppp"));
+}
+
+TEST(RimeCorrectorDistanceTest, DistanceKernel) {
+  rime::corrector::DistanceKernel kernel("chsng", true);
+  auto distances = kernel.Score({"chang", "chsng", "shang", "hang"}, 5);
+  ASSERT_EQ(4, distances.size());
+  EXPECT_EQ(1, distances[0]);
+  EXPECT_EQ(0, distances[1]);
+  EXPECT_EQ(5, distances[2]);
+  EXPECT_EQ(3, distances[3]);
+  // against prefixes of the input
+  EXPECT_EQ(0, kernel.Score("chs", 5, 3));
+  EXPECT_EQ(1, kernel.Score("cha", 5, 3));
+  EXPECT_EQ(3, kernel.Score("chang", 5, 4));
+}
+
+TEST(RimeCorrectorDistanceTest, KeyboardLayout) {
+  // 'a' and 'o' are next to each other on dvorak, far apart on qwerty
+  rime::corrector::DistanceKernel qwerty("chong", true);
+  rime::corrector::DistanceKernel dvorak("chong", true,
+                                         rime::KeyboardLayout::Dvorak());
+  EXPECT_EQ(4, qwerty.Score("chang", 5));
+  EXPECT_EQ(1, dvorak.Score("chang", 5));
+  rime::EditDistanceCorrector corrector("corrector_distance_test.bin",
+                                        rime::KeyboardLayout::Dvorak());
+  EXPECT_EQ(1, corrector.RestrictedDistance("chang", "chong", 5));
+  EXPECT_EQ(1, corrector.LevenshteinDistance("chang", "chong"));
+  EXPECT_EQ(2, corrector.LevenshteinDistance("chang", "chsng"));
+}
@@ -4,6 +4,7 @@
 //
 // 2011-07-05 GONG Chen <chen.sst@gmail.com>
 //
+#include <algorithm>
 #include <gtest/gtest.h>
 #include <rime/common.h>
 #include <rime/algo/encoder.h>
@@ -68,6 +69,195 @@ TEST_F(RimeDictionaryTest, PredictiveLookup) {
   EXPECT_EQ("za", raw_code.ToString());
 }
 
+TEST_F(RimeDictionaryTest, PredictiveLookupInOrder) {
+  ASSERT_TRUE(dict_->loaded());
+  rime::DictEntryIterator it;
+  dict_->LookupWords(&it, "z", true);
+  it.Sort();
+  rime::vector<rime::string> texts;
+  int previous_length = 0;
+  double previous_weight = 0.0;
+  for (; !it.exhausted(); it.Next()) {
+    auto e = it.Peek();
+    if (!texts.empty() && e->remaining_code_length == previous_length) {
+      EXPECT_LE(e->weight, previous_weight);
+    } else {
+      EXPECT_GE(e->remaining_code_length, previous_length);
+    }
+    previous_length = e->remaining_code_length;
+    previous_weight = e->weight;
+    texts.push_back(e->text);
+  }
+  ASSERT_GT(texts.size(), 10);
+  // skips in the same order
+  rime::DictEntryIterator more;
+  dict_->LookupWords(&more, "z", true);
+  more.Sort();
+  EXPECT_TRUE(more.Skip(10));
+  ASSERT_FALSE(more.exhausted());
+  EXPECT_EQ(texts[10], more.Peek()->text);
+}
+
+TEST_F(RimeDictionaryTest, PeekView) {
+  ASSERT_TRUE(dict_->loaded());
+  rime::DictEntryIterator it;
+  dict_->LookupWords(&it, "z", true);
+  it.Sort();
+  rime::DictEntryIterator filtered;
+  dict_->LookupWords(&filtered, "z", true);
+  filtered.Sort();
+  // rejects the words completing the code
+  filtered.AddFilter([](const rime::DictEntryView& e) {
+    return e.remaining_code_length == 0;
+  });
+  size_t num_entries = 0;
+  for (; !it.exhausted(); it.Next()) {
+    auto view = it.PeekView();
+    auto e = it.Peek();
+    EXPECT_EQ(e->text, view.text.to_string());
+    EXPECT_EQ(e->code, *view.code);
+    EXPECT_EQ(e->weight, view.weight);
+    EXPECT_EQ(e->remaining_code_length, view.remaining_code_length);
+    if (e->remaining_code_length == 0) {
+      ASSERT_FALSE(filtered.exhausted());
+      EXPECT_EQ(e->text, filtered.Peek()->text);
+      filtered.Next();
+    }
+    ++num_entries;
+  }
+  EXPECT_GT(num_entries, 10);
+  EXPECT_TRUE(filtered.exhausted());
+  EXPECT_TRUE(it.PeekView().text.empty());
+}
+
+TEST_F(RimeDictionaryTest, FilterDictEntries) {
+  ASSERT_TRUE(dict_->loaded());
+  rime::DictEntryIterator by_view;
+  dict_->LookupWords(&by_view, "z", true);
+  by_view.Sort();
+  by_view.AddFilter([](const rime::DictEntryView& e) {
+    return e.remaining_code_length > 0;
+  });
+  rime::DictEntryIterator by_entry;
+  dict_->LookupWords(&by_entry, "z", true);
+  by_entry.Sort();
+  // filters taking dict entries still apply
+  by_entry.AddFilter([](rime::an<rime::DictEntry> e) {
+    return e->remaining_code_length > 0;
+  });
+  size_t num_entries = 0;
+  for (; !by_view.exhausted(); by_view.Next(), by_entry.Next()) {
+    ASSERT_FALSE(by_entry.exhausted());
+    EXPECT_EQ(by_view.Peek()->text, by_entry.Peek()->text);
+    ++num_entries;
+  }
+  EXPECT_GT(num_entries, 0);
+  EXPECT_TRUE(by_entry.exhausted());
+}
+
+TEST_F(RimeDictionaryTest, ResumePredictiveLookup) {
+  ASSERT_TRUE(dict_->loaded());
+  rime::DictEntryIterator it;
+  size_t num_keys = dict_->LookupWords(&it, "z", true);
+  rime::vector<rime::string> texts;
+  for (; !it.exhausted(); it.Next()) {
+    texts.push_back(it.Peek()->text);
+  }
+  ASSERT_GT(num_keys, 1);
+  // pages through the same entries, each key looked up only once
+  rime::ExpandSearchCursor cursor;
+  rime::vector<rime::string> resumed_texts;
+  for (size_t limit = 1; !cursor.exhausted(); ++limit) {
+    rime::DictEntryIterator more;
+    EXPECT_EQ(std::min(limit, num_keys),
+              dict_->LookupWords(&more, "z", &cursor, limit));
+    for (; !more.exhausted(); more.Next()) {
+      resumed_texts.push_back(more.Peek()->text);
+    }
+  }
+  std::sort(texts.begin(), texts.end());
+  std::sort(resumed_texts.begin(), resumed_texts.end());
+  EXPECT_EQ(texts, resumed_texts);
+}
+
+TEST_F(RimeDictionaryTest, LookupCompletions) {
+  ASSERT_TRUE(dict_->loaded());
+  for (const char* code : {"z", "zh", "b", "o"}) {
+    rime::DictEntryIterator it;
+    dict_->LookupWords(&it, code, true);
+    it.Sort();
+    rime::DictEntryIterator completions;
+    bool complete = false;
+    size_t num_indexed =
+        dict_->LookupCompletions(&completions, code, 0, 0, &complete);
+    ASSERT_GT(num_indexed, 0) << code;
+    EXPECT_LE(num_indexed, 20) << code;
+    // the same words in the same order as the predictive lookup
+    rime::vector<rime::string> texts;
+    for (; !completions.exhausted(); completions.Next(), it.Next()) {
+      ASSERT_FALSE(it.exhausted()) << code;
+      EXPECT_EQ(it.Peek()->text, completions.Peek()->text) << code;
+      EXPECT_EQ(it.Peek()->comment, completions.Peek()->comment) << code;
+      EXPECT_EQ(it.Peek()->weight, completions.Peek()->weight) << code;
+      texts.push_back(it.Peek()->text);
+    }
+    EXPECT_EQ(num_indexed, texts.size()) << code;
+    EXPECT_EQ(complete, it.exhausted()) << code;
+    // a page of them
+    rime::DictEntryIterator page;
+    EXPECT_EQ(num_indexed, dict_->LookupCompletions(&page, code, 2, 3));
+    for (size_t i = 2; i < std::min<size_t>(5, num_indexed); ++i) {
+      ASSERT_FALSE(page.exhausted()) << code;
+      EXPECT_EQ(texts[i], page.Peek()->text) << code;
+      page.Next();
+    }
+    EXPECT_TRUE(page.exhausted()) << code;
+  }
+  rime::DictEntryIterator it;
+  // longer than the indexed prefixes
+  EXPECT_EQ(0, dict_->LookupCompletions(&it, "zho"));
+}
+
+TEST_F(RimeDictionaryTest, WarmupOnLoad) {
+  rime::MappedFileLoadPolicy policy;
+  EXPECT_FALSE(rime::ParseMappedFileLoadPolicy("eager", &policy));
+  ASSERT_TRUE(rime::ParseMappedFileLoadPolicy("populate", &policy));
+  rime::Dictionary dict(
+      "dictionary_test",
+      {},
+      {rime::New<rime::Table>("dictionary_test.table.bin")},
+      rime::New<rime::Prism>("dictionary_test.prism.bin"));
+  dict.set_load_policy(policy);
+  dict.set_warmup_on_load(true);
+  ASSERT_TRUE(dict.Load());
+  EXPECT_EQ(rime::MappedFileLoadPolicy::kPopulate,
+            dict.primary_table()->load_policy());
+  EXPECT_LT(0, dict.FinishWarmup());
+  rime::DictEntryIterator it;
+  dict.LookupWords(&it, "zhong", false);
+  ASSERT_FALSE(it.exhausted());
+  EXPECT_EQ("\xe4\xb8\xad", it.Peek()->text);  // 中
+}
+
+TEST_F(RimeDictionaryTest, CancelWarmup) {
+  rime::Dictionary dict(
+      "dictionary_test",
+      {},
+      {rime::New<rime::Table>("dictionary_test.table.bin")},
+      rime::New<rime::Prism>("dictionary_test.prism.bin"));
+  dict.set_warmup_on_load(true);
+  ASSERT_TRUE(dict.Load());
+  dict.CancelWarmup();
+  EXPECT_EQ(0, dict.FinishWarmup());
+  // the dictionary stays usable
+  rime::DictEntryIterator it;
+  dict.LookupWords(&it, "zhong", false);
+  ASSERT_FALSE(it.exhausted());
+  // warms up again on demand
+  dict.Warmup();
+  EXPECT_LT(0, dict.FinishWarmup());
+}
+
 TEST_F(RimeDictionaryTest, ScriptLookup) {
   ASSERT_TRUE(dict_->loaded());
   rime::SyllableGraph g;
@@ -0,0 +1,236 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include <rime/dict/mapped_db.h>
+#include <rime/dict/user_db.h>
+
+using namespace rime;
+
+using TestDb = UserDbWrapper<MappedDb>;
+
+static const char kFileName[] = "mapped_db_test.userdb.bin";
+
+static vector<string> Keys(an<DbAccessor> accessor) {
+  vector<string> keys;
+  string key, value;
+  while (accessor && accessor->GetNextRecord(&key, &value)) {
+    keys.push_back(key);
+  }
+  return keys;
+}
+
+TEST(RimeMappedDbTest, ReopenFromSortedRun) {
+  TestDb db(kFileName, "mapped_db_test");
+  if (db.Exists())
+    db.Remove();
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Update("b \tbee", "2"));
+  EXPECT_TRUE(db.Update("a \tay", "1"));
+  EXPECT_TRUE(db.Update("c \tsee", "3"));
+  EXPECT_EQ(0, db.num_records());
+  EXPECT_TRUE(db.Close());
+  // the log is folded into the run on closing
+  EXPECT_FALSE(boost::filesystem::file_size(string(kFileName) + ".log"));
+  ASSERT_TRUE(db.OpenReadOnly());
+  EXPECT_EQ(0, db.num_updates());
+  EXPECT_TRUE(UserDbHelper(&db).IsUserDb());
+  EXPECT_EQ((vector<string>{"a \tay", "b \tbee", "c \tsee"}),
+            Keys(db.QueryAll()));
+  EXPECT_FALSE(db.Update("d \tdee", "4"));
+  EXPECT_TRUE(db.Close());
+  db.Remove();
+}
+
+TEST(RimeMappedDbTest, MergeUpdatesOverRun) {
+  TestDb db(kFileName, "mapped_db_test");
+  if (db.Exists())
+    db.Remove();
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Update("a \tay", "1"));
+  EXPECT_TRUE(db.Update("b \tbee", "2"));
+  EXPECT_TRUE(db.Update("c \tsee", "3"));
+  EXPECT_TRUE(db.Compact());
+  EXPECT_EQ(0, db.num_updates());
+  EXPECT_TRUE(db.Erase("b \tbee"));
+  EXPECT_TRUE(db.Update("c \tsee", "33"));
+  EXPECT_TRUE(db.Update("bb \tbebe", "22"));
+  string value;
+  EXPECT_FALSE(db.Fetch("b \tbee", &value));
+  EXPECT_TRUE(db.Fetch("c \tsee", &value));
+  EXPECT_EQ("33", value);
+  EXPECT_TRUE(db.Fetch("a \tay", &value));
+  EXPECT_EQ("1", value);
+  EXPECT_EQ((vector<string>{"a \tay", "bb \tbebe", "c \tsee"}),
+            Keys(db.QueryAll()));
+  EXPECT_EQ(vector<string>{"bb \tbebe"}, Keys(db.Query("b")));
+  auto accessor = db.Query("c");
+  string key;
+  ASSERT_TRUE(accessor->GetNextRecord(&key, &value));
+  EXPECT_EQ("33", value);
+  EXPECT_TRUE(accessor->exhausted());
+  EXPECT_TRUE(db.Close());
+  ASSERT_TRUE(db.Open());
+  EXPECT_EQ(3, Keys(db.QueryAll()).size());
+  EXPECT_TRUE(db.Update("b \tbee", "222"));
+  EXPECT_TRUE(db.Fetch("b \tbee", &value));
+  EXPECT_EQ("222", value);
+  // the update is visible to other readers from the log
+  {
+    TestDb other(kFileName, "mapped_db_test");
+    ASSERT_TRUE(other.OpenReadOnly());
+    EXPECT_TRUE(other.Fetch("b \tbee", &value));
+    EXPECT_EQ("222", value);
+  }
+  EXPECT_TRUE(db.Close());
+  db.Remove();
+}
+
+TEST(RimeMappedDbTest, Transaction) {
+  TestDb db(kFileName, "mapped_db_test");
+  if (db.Exists())
+    db.Remove();
+  ASSERT_TRUE(db.Open());
+  size_t num_updates = db.num_updates();
+  EXPECT_TRUE(db.BeginTransaction());
+  EXPECT_TRUE(db.Update("a \tay", "1"));
+  string value;
+  EXPECT_FALSE(db.Fetch("a \tay", &value));
+  EXPECT_TRUE(db.AbortTransaction());
+  EXPECT_EQ(num_updates, db.num_updates());
+  EXPECT_TRUE(db.BeginTransaction());
+  EXPECT_TRUE(db.Update("a \tay", "1"));
+  EXPECT_TRUE(db.Update("b \tbee", "2"));
+  EXPECT_TRUE(db.CommitTransaction());
+  EXPECT_EQ(num_updates + 2, db.num_updates());
+  EXPECT_TRUE(db.Fetch("b \tbee", &value));
+  EXPECT_TRUE(db.Close());
+  db.Remove();
+}
+
+TEST(RimeMappedDbTest, CompactInBackground) {
+  TestDb db(kFileName, "mapped_db_test");
+  if (db.Exists())
+    db.Remove();
+  ASSERT_TRUE(db.Open());
+  const int kNumRecords = 5000;
+  for (int i = 0; i < kNumRecords; ++i) {
+    EXPECT_TRUE(db.Update(std::to_string(i) + " \t", std::to_string(i)));
+  }
+  // compacted several times while writing
+  EXPECT_LT(db.num_updates(), kNumRecords);
+  EXPECT_TRUE(db.Compact());
+  string value;
+  for (int i = 0; i < kNumRecords; i += 99) {
+    ASSERT_TRUE(db.Fetch(std::to_string(i) + " \t", &value));
+    EXPECT_EQ(std::to_string(i), value);
+  }
+  EXPECT_EQ(kNumRecords, Keys(db.QueryAll()).size());
+  EXPECT_TRUE(db.Close());
+  db.Remove();
+}
+
+TEST(RimeMappedDbTest, RecoverInterruptedCompaction) {
+  TestDb db(kFileName, "mapped_db_test");
+  if (db.Exists())
+    db.Remove();
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Update("a \tay", "1"));
+  EXPECT_TRUE(db.Update("b \tbee", "2"));
+  // quit without closing the db
+  auto log_file = string(kFileName) + ".log";
+  boost::filesystem::copy_file(log_file, log_file + ".bak");
+  EXPECT_TRUE(db.Close());
+  boost::filesystem::rename(log_file + ".bak", log_file + ".1");
+  {
+    std::ofstream fout(log_file, std::ios::out | std::ios::binary);
+    // a newer update, followed by a truncated entry
+    fout.write("-\x06\0\0\0\0\0\0\0b \tbee+\x06\0", 18);
+  }
+  ASSERT_TRUE(db.Open());
+  EXPECT_FALSE(boost::filesystem::exists(log_file + ".1"));
+  EXPECT_EQ(0, db.num_updates());
+  EXPECT_EQ(vector<string>{"a \tay"}, Keys(db.QueryAll()));
+  EXPECT_TRUE(db.Close());
+  db.Remove();
+}
+
+TEST(RimeMappedDbTest, AppendAfterTruncatedLogEntry) {
+  TestDb db(kFileName, "mapped_db_test");
+  if (db.Exists())
+    db.Remove();
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Close());
+  auto log_file = string(kFileName) + ".log";
+  {
+    std::ofstream fout(log_file, std::ios::out | std::ios::binary);
+    // an update, followed by an entry cut off in the middle
+    fout.write("+\x06\0\0\0\x01\0\0\0b \tbee2+\x06\0", 19);
+  }
+  ASSERT_TRUE(db.Open());
+  string value;
+  EXPECT_TRUE(db.Fetch("b \tbee", &value));
+  EXPECT_TRUE(db.Update("c \tsee", "3"));
+  // new entries are replayed by other readers of the log
+  {
+    TestDb other(kFileName, "mapped_db_test");
+    ASSERT_TRUE(other.OpenReadOnly());
+    EXPECT_TRUE(other.Fetch("b \tbee", &value));
+    EXPECT_EQ("2", value);
+    EXPECT_TRUE(other.Fetch("c \tsee", &value));
+    EXPECT_EQ("3", value);
+  }
+  EXPECT_TRUE(db.Close());
+  db.Remove();
+}
+
+TEST(RimeMappedDbTest, CompactWhileReading) {
+  TestDb db(kFileName, "mapped_db_test");
+  if (db.Exists())
+    db.Remove();
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Update("a \tay", "1"));
+  EXPECT_TRUE(db.Update("b \tbee", "2"));
+  EXPECT_TRUE(db.Compact());
+  auto reader = db.QueryAll();
+  EXPECT_TRUE(db.Update("c \tsee", "3"));
+  // the run being read is not replaced, but a new generation is written
+  EXPECT_TRUE(db.Compact());
+  auto first_generation = string(kFileName) + ".1";
+  EXPECT_TRUE(boost::filesystem::exists(first_generation));
+  EXPECT_EQ((vector<string>{"a \tay", "b \tbee"}), Keys(reader));
+  reader.reset();
+  EXPECT_FALSE(boost::filesystem::exists(first_generation));
+  EXPECT_TRUE(db.Close());
+  // the latest run has taken the place of the db file
+  EXPECT_FALSE(boost::filesystem::exists(string(kFileName) + ".2"));
+  ASSERT_TRUE(db.OpenReadOnly());
+  EXPECT_EQ((vector<string>{"a \tay", "b \tbee", "c \tsee"}),
+            Keys(db.QueryAll()));
+  EXPECT_TRUE(db.Close());
+  db.Remove();
+}
+
+TEST(RimeMappedDbTest, RetryFailedCompaction) {
+  TestDb db(kFileName, "mapped_db_test");
+  if (db.Exists())
+    db.Remove();
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Update("a \tay", "1"));
+  // block the file of the next run
+  auto next_generation = string(kFileName) + ".1";
+  boost::filesystem::create_directories(next_generation + "/blocked");
+  size_t num_updates = db.num_updates();
+  EXPECT_FALSE(db.Compact());
+  EXPECT_EQ(num_updates, db.num_updates());
+  boost::filesystem::remove_all(next_generation);
+  EXPECT_TRUE(db.Update("b \tbee", "2"));
+  EXPECT_TRUE(db.Compact());
+  EXPECT_EQ(0, db.num_updates());
+  EXPECT_EQ((vector<string>{"a \tay", "b \tbee"}), Keys(db.QueryAll()));
+  EXPECT_TRUE(db.Close());
+  db.Remove();
+}
@@ -89,3 +89,27 @@ TEST_F(RimePrismTest, ExpandSearch) {
   EXPECT_EQ(result[2].value, 3);  // goodbye
   EXPECT_EQ(result[2].length, 7);  // goodbye
 }
+
+TEST_F(RimePrismTest, ResumeExpandSearch) {
+  vector<Prism::Match> result;
+  ExpandSearchCursor cursor;
+
+  prism_->ExpandSearch("goo", &cursor, &result, 1);
+  ASSERT_EQ(result.size(), 1);
+  EXPECT_EQ(result[0].value, 2);  // good
+  EXPECT_FALSE(cursor.exhausted());
+  // picks up where it stopped, with the same results as searching anew
+  prism_->ExpandSearch("goo", &cursor, &result, 10);
+  ASSERT_EQ(result.size(), 3);
+  EXPECT_EQ(result[1].value, 4);  // google
+  EXPECT_EQ(result[1].length, 6);  // google
+  EXPECT_EQ(result[2].value, 3);  // goodbye
+  EXPECT_EQ(result[2].length, 7);  // goodbye
+  EXPECT_TRUE(cursor.exhausted());
+
+  ExpandSearchCursor no_match;
+  result.clear();
+  prism_->ExpandSearch("gx", &no_match, &result, 10);
+  EXPECT_TRUE(result.empty());
+  EXPECT_TRUE(no_match.exhausted());
+}
@@ -160,3 +160,87 @@ TEST_F(RimeSyllabifierTest, TransposedSyllableGraph) {
   ASSERT_FALSE(NULL == g.indices[0][syllable_id_["chan"]][0]);
   EXPECT_EQ(4, g.indices[0][syllable_id_["chan"]][0]->end_pos);
 }
+
+static void ExpectSameGraph(const rime::SyllableGraph& x,
+                            const rime::SyllableGraph& y) {
+  EXPECT_EQ(x.input_length, y.input_length);
+  EXPECT_EQ(x.interpreted_length, y.interpreted_length);
+  EXPECT_EQ(x.vertices, y.vertices);
+  ASSERT_EQ(x.edges.size(), y.edges.size());
+  for (auto i = x.edges.begin(), j = y.edges.begin(); i != x.edges.end();
+       ++i, ++j) {
+    ASSERT_EQ(i->first, j->first);
+    ASSERT_EQ(i->second.size(), j->second.size());
+    for (auto k = i->second.begin(), l = j->second.begin();
+         k != i->second.end(); ++k, ++l) {
+      ASSERT_EQ(k->first, l->first);
+      ASSERT_EQ(k->second.size(), l->second.size());
+      for (auto m = k->second.begin(), n = l->second.begin();
+           m != k->second.end(); ++m, ++n) {
+        EXPECT_EQ(m->first, n->first);
+        EXPECT_EQ(m->second.type, n->second.type);
+        EXPECT_EQ(m->second.end_pos, n->second.end_pos);
+        EXPECT_EQ(m->second.credibility, n->second.credibility);
+      }
+    }
+  }
+  EXPECT_EQ(x.indices.size(), y.indices.size());
+}
+
+TEST_F(RimeSyllabifierTest, IncrementalSyllableGraph) {
+  rime::SyllableGraphCache cache;
+  rime::Syllabifier incremental("'", true);
+  incremental.EnableIncremental(&cache);
+  rime::Syllabifier s("'", true);
+  const rime::string typed("changan'tuanan");
+  rime::vector<rime::string> inputs;
+  for (size_t i = 1; i <= typed.length(); ++i) {
+    inputs.push_back(typed.substr(0, i));
+  }
+  // backspace, then edit in the middle
+  inputs.push_back("changan'tua");
+  inputs.push_back("changan'tuan");
+  inputs.push_back("chang'antuan");
+  for (const auto& input : inputs) {
+    SCOPED_TRACE(input);
+    rime::SyllableGraph g, h;
+    incremental.BuildSyllableGraph(input, *prism_, &g);
+    s.BuildSyllableGraph(input, *prism_, &h);
+    ExpectSameGraph(h, g);
+  }
+  // edges from vertices out of reach of the last keystroke are kept
+  EXPECT_FALSE(cache.edges.empty());
+  EXPECT_EQ("chang'antuan", cache.input);
+}
+
+TEST_F(RimeSyllabifierTest, CompactSyllableGraph) {
+  rime::Syllabifier s;
+  const rime::string input("changan");
+  EXPECT_EQ(input.length(), s.BuildSyllableGraph(input, *prism_));
+  const rime::CompactSyllableGraph& g(s.syllable_graph());
+  EXPECT_EQ(input.length(), g.interpreted_length);
+  ASSERT_EQ(4, g.vertices.size());
+  EXPECT_EQ(0, g.vertices.front().first);
+  EXPECT_EQ(input.length(), g.vertices.back().first);
+  // edges from 0 in the order of end position: chan, chang
+  ASSERT_EQ(2, g.end_of(0) - g.begin_of(0));
+  EXPECT_EQ(syllable_id_["chan"], g.edges[g.begin_of(0)].syllable_id);
+  EXPECT_EQ(4, g.edges[g.begin_of(0)].properties.end_pos);
+  EXPECT_EQ(syllable_id_["chang"], g.edges[g.begin_of(0) + 1].syllable_id);
+  EXPECT_FALSE(g.has_edges(1));
+  auto chang = g.FindSyllable(0, syllable_id_["chang"]);
+  ASSERT_EQ(1, chang.second - chang.first);
+  EXPECT_EQ(5, g.edges[g.index[chang.first]].properties.end_pos);
+  auto gan = g.FindSyllable(0, syllable_id_["gan"]);
+  EXPECT_EQ(gan.first, gan.second);
+  ASSERT_FALSE(NULL == g.FindEdge(5, 7, syllable_id_["an"]));
+  EXPECT_TRUE(NULL == g.FindEdge(5, 7, syllable_id_["na"]));
+  // converted to nested maps and back
+  rime::SyllableGraph maps;
+  g.Export(&maps);
+  EXPECT_EQ(2, maps.indices[0].size());
+  rime::CompactSyllableGraph h(maps);
+  EXPECT_EQ(g.vertices, h.vertices);
+  EXPECT_EQ(g.edge_offsets, h.edge_offsets);
+  EXPECT_EQ(g.index, h.index);
+}
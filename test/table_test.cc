@@ -208,3 +208,171 @@ TEST_F(RimeTableTest, QueryWithSyllableGraph) {
   EXPECT_STREQ("lia", Text(result[4].front()).c_str());
   EXPECT_FALSE(result[4].front().Next());
 }
+
+TEST_F(RimeTableTest, QueryWithReusedBuffer) {
+  const rime::string input("yiersan");
+  rime::SyllableGraph g;
+  g.input_length = input.length();
+  g.interpreted_length = g.input_length;
+  g.vertices[0] = rime::kNormalSpelling;
+  g.vertices[2] = rime::kNormalSpelling;
+  g.vertices[4] = rime::kNormalSpelling;
+  g.vertices[7] = rime::kNormalSpelling;
+  g.edges[0][2][1].type = rime::kNormalSpelling;
+  g.edges[0][2][1].end_pos = 2;
+  g.edges[2][4][2].type = rime::kNormalSpelling;
+  g.edges[2][4][2].end_pos = 4;
+  g.edges[4][7][3].type = rime::kNormalSpelling;
+  g.edges[4][7][3].end_pos = 7;
+  g.indices[0][1].push_back(&g.edges[0][2][1]);
+  g.indices[2][2].push_back(&g.edges[2][4][2]);
+  g.indices[4][3].push_back(&g.edges[4][7][3]);
+
+  rime::TableQueryBuffer buffer;
+  ASSERT_TRUE(table_->Query(g, 0, &buffer));
+  ASSERT_EQ(2, buffer.matches.size());
+  EXPECT_EQ(2, buffer.matches[0].end_pos);
+  EXPECT_STREQ("yi", Text(buffer.matches[0].accessor).c_str());
+  EXPECT_EQ(7, buffer.matches[1].end_pos);
+  EXPECT_STREQ("yi-er-san", Text(buffer.matches[1].accessor).c_str());
+  rime::Code code = buffer.matches[1].accessor.index_code();
+  ASSERT_EQ(3, code.size());
+  EXPECT_EQ(1, code[0]);
+  EXPECT_EQ(3, code[2]);
+
+  ASSERT_TRUE(table_->Query(g, 2, &buffer));
+  ASSERT_EQ(1, buffer.matches.size());
+  EXPECT_EQ(4, buffer.matches[0].end_pos);
+  EXPECT_STREQ("er", Text(buffer.matches[0].accessor).c_str());
+  EXPECT_EQ(1, buffer.matches[0].accessor.index_code().size());
+}
+
+TEST_F(RimeTableTest, RejectUnsupportedFormat) {
+  EXPECT_STREQ("Rime::Table/4.0", table_->metadata()->format);
+  const char kFileName[] = "table_test_v5.bin";
+  {
+    rime::Table table(kFileName);
+    table.Remove();
+    rime::Syllabary syll;
+    rime::Vocabulary voc;
+    PrepareSampleVocabulary(syll, voc);
+    ASSERT_TRUE(table.Build(syll, voc, total_num_entries));
+    // as built by an unreleased version in a different layout
+    std::strncpy(table.metadata()->format, "Rime::Table/5.0",
+                 rime::table::Metadata::kFormatMaxLength);
+    ASSERT_TRUE(table.Save());
+  }
+  rime::Table table(kFileName);
+  EXPECT_FALSE(table.Load());
+  table.Remove();
+}
+
+TEST_F(RimeTableTest, KeepOriginalEntryOrder) {
+  const char kFileName[] = "table_test_weights.bin";
+  rime::Table table(kFileName);
+  table.Remove();
+  rime::Syllabary syll{"a"};
+  rime::Vocabulary voc;
+  const double weights[] = {1.0, 3.0, 2.0, 3.0};
+  for (size_t i = 0; i < 4; ++i) {
+    auto d = rime::New<rime::ShortDictEntry>();
+    d->code.push_back(0);
+    d->text = std::to_string(i);
+    d->weight = weights[i];
+    voc[0].entries.push_back(d);
+  }
+  // homophones are left unsorted with `sort: original`
+  table.set_completion_index(1, 10);
+  ASSERT_TRUE(table.Build(syll, voc, 4));
+  ASSERT_TRUE(table.Save());
+  ASSERT_TRUE(table.Load());
+  EXPECT_FALSE(table.entries_sorted_by_weight());
+  EXPECT_FALSE(table.completion_index());
+  rime::TableAccessor v = table.QueryWords(0);
+  ASSERT_EQ(4, v.remaining());
+  for (size_t i = 0; i < 4; ++i, v.Next()) {
+    EXPECT_EQ(weights[i], v.entry()->weight);
+    EXPECT_EQ(std::to_string(i), table.GetEntryText(*v.entry()));
+  }
+  table.Remove();
+
+  // and sorted by weight otherwise
+  voc.SortHomophones();
+  ASSERT_TRUE(table.Build(syll, voc, 4));
+  ASSERT_TRUE(table.Save());
+  ASSERT_TRUE(table.Load());
+  EXPECT_TRUE(table.entries_sorted_by_weight());
+  EXPECT_TRUE(table.completion_index());
+  v = table.QueryWords(0);
+  ASSERT_EQ(4, v.remaining());
+  const double sorted_weights[] = {3.0, 3.0, 2.0, 1.0};
+  for (size_t i = 0; i < 4; ++i, v.Next()) {
+    EXPECT_EQ(sorted_weights[i], v.entry()->weight);
+    if (i == 2)
+      EXPECT_EQ("2", table.GetEntryText(*v.entry()));
+    if (i == 3)
+      EXPECT_EQ("0", table.GetEntryText(*v.entry()));
+  }
+  table.Remove();
+}
+
+TEST_F(RimeTableTest, SearchWideTrunkIndex) {
+  const char kFileName[] = "table_test_wide.bin";
+  const int kNumSyllables = 100;
+  rime::Syllabary syll;
+  rime::Vocabulary voc;
+  for (int i = 0; i < kNumSyllables; ++i) {
+    syll.insert(std::to_string(i));
+  }
+  // phrases of the first syllable followed by one of even id, and of the
+  // first two followed by one of id divisible by 3
+  auto make_code = [](std::initializer_list<rime::SyllableId> ids) {
+    rime::Code code;
+    code.assign(ids);
+    return code;
+  };
+  auto has_phrase = [](const rime::Code& code) {
+    if (code[1] < 0 || code[1] >= kNumSyllables || code[1] % 2 != 0)
+      return false;
+    return code.size() == 2 ||
+           (code[1] == 2 && code[2] >= 0 && code[2] < kNumSyllables &&
+            code[2] % 3 == 0);
+  };
+  size_t num_entries = 0;
+  for (int i = 0; i < kNumSyllables; ++i) {
+    for (const rime::Code& code : {make_code({0, i}), make_code({0, 2, i})}) {
+      if (!has_phrase(code))
+        continue;
+      auto d = rime::New<rime::ShortDictEntry>();
+      d->code = code;
+      d->text = code.ToString();
+      d->weight = 1.0;
+      voc.LocateEntries(d->code)->push_back(d);
+      ++num_entries;
+    }
+  }
+  for (bool search_index : {false, true}) {
+    rime::Table table(kFileName);
+    table.Remove();
+    table.set_search_index(search_index);
+    ASSERT_TRUE(table.Build(syll, voc, num_entries));
+    ASSERT_TRUE(table.Save());
+    ASSERT_TRUE(table.Load());
+    EXPECT_STREQ("Rime::Table/4.0", table.metadata()->format);
+    EXPECT_EQ(search_index, table.search_index() != nullptr);
+    for (int i = -1; i <= kNumSyllables; ++i) {
+      for (const rime::Code& code :
+           {make_code({0, i}), make_code({0, 2, i})}) {
+        rime::TableAccessor v = table.QueryPhrases(code);
+        if (has_phrase(code)) {
+          ASSERT_EQ(1, v.remaining())
+              << search_index << ": " << code.ToString();
+          EXPECT_EQ(code.ToString(), table.GetEntryText(*v.entry()));
+        } else {
+          EXPECT_TRUE(v.exhausted()) << search_index << ": " << code.ToString();
+        }
+      }
+    }
+    table.Remove();
+  }
+}
@@ -4,17 +4,49 @@
 //
 // 2011-07-03 GONG Chen <chen.sst@gmail.com>
 //
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <locale>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <boost/filesystem.hpp>
 #include <gtest/gtest.h>
+#include <rime/config.h>
 #include <rime/algo/syllabifier.h>
+#include <rime/dict/level_db.h>
+#include <rime/dict/mapped_db.h>
 #include <rime/dict/text_db.h>
 #include <rime/dict/user_db.h>
 
 using namespace rime;
 
-using TestDb = UserDbWrapper<TextDb>;
+static vector<string> Keys(an<DbAccessor> accessor) {
+  vector<string> keys;
+  string key, value;
+  while (accessor && accessor->GetNextRecord(&key, &value)) {
+    keys.push_back(key);
+  }
+  return keys;
+}
+
+template <class T>
+class RimeUserDbTest : public ::testing::Test {
+ protected:
+  static string file_name() { return FileName(static_cast<T*>(nullptr)); }
+
+ private:
+  static string FileName(TextDb*) { return "user_db_test.txt"; }
+  static string FileName(MappedDb*) { return "user_db_test.userdb.bin"; }
+};
 
-TEST(RimeUserDbTest, AccessRecordByKey) {
-  TestDb db("user_db_test.txt", "user_db_test");
+using TestDbTypes =
+    ::testing::Types<UserDbWrapper<TextDb>, UserDbWrapper<MappedDb>>;
+TYPED_TEST_SUITE(RimeUserDbTest, TestDbTypes);
+
+TYPED_TEST(RimeUserDbTest, AccessRecordByKey) {
+  TypeParam db(this->file_name(), "user_db_test");
   if (db.Exists())
     db.Remove();
   ASSERT_FALSE(db.Exists());
@@ -40,8 +72,8 @@ TEST(RimeUserDbTest, AccessRecordByKey) {
   ASSERT_FALSE(db.loaded());
 }
 
-TEST(RimeUserDbTest, Query) {
-  TestDb db("user_db_test.txt", "user_db_test");
+TYPED_TEST(RimeUserDbTest, Query) {
+  TypeParam db(this->file_name(), "user_db_test");
   if (db.Exists())
     db.Remove();
   ASSERT_FALSE(db.Exists());
@@ -89,3 +121,295 @@ TEST(RimeUserDbTest, Query) {
   }
   db.Close();
 }
+
+TEST(RimeUserDbValueTest, PackValue) {
+  UserDbValue v;
+  v.commits = -3;
+  v.dee = 1.25;
+  v.tick = (TickCount(1) << 40) + 7;
+  string packed = v.Pack();
+  EXPECT_TRUE(UserDbValue::IsBinary(packed));
+  UserDbValue u;
+  EXPECT_TRUE(u.Unpack(packed));
+  EXPECT_EQ(-3, u.commits);
+  EXPECT_EQ(1.25, u.dee);
+  EXPECT_EQ(v.tick, u.tick);
+  EXPECT_EQ("c=-3 d=1.25 t=1099511627783", u.PackText());
+  // truncated
+  EXPECT_FALSE(u.Unpack(packed.substr(0, packed.length() - 1)));
+}
+
+TEST(RimeUserDbValueTest, UnpackLegacyTextValue) {
+  UserDbValue v("c=2 d=0.5 t=42");
+  EXPECT_FALSE(UserDbValue::IsBinary("c=2 d=0.5 t=42"));
+  EXPECT_EQ(2, v.commits);
+  EXPECT_EQ(0.5, v.dee);
+  EXPECT_EQ(42, v.tick);
+  UserDbValue u;
+  EXPECT_TRUE(u.Unpack("t=3  c=-1 x=unknown"));
+  EXPECT_EQ(-1, u.commits);
+  EXPECT_EQ(3, u.tick);
+  EXPECT_FALSE(u.Unpack("c=1 d=abc"));
+  EXPECT_FALSE(u.Unpack("c="));
+}
+
+TEST(RimeUserDbValueTest, UnpackNumbersInTextForm) {
+  // parsed in place, or else by a stream, to the same double as strtod
+  for (const char* d : {"0.1", "1e-05", "-2.5E+3", ".5", "5.", "+0.75",
+                        "3.14159265358979", "0.12345678901234567890",
+                        "1e-30", "1.5e+3"}) {
+    UserDbValue v(string("c=1 d=") + d + " t=1");
+    EXPECT_EQ(std::strtod(d, nullptr), v.dee) << d;
+  }
+  UserDbValue v("c=+5 d=0 t=18446744073709551615");
+  EXPECT_EQ(5, v.commits);
+  EXPECT_EQ(18446744073709551615ULL, v.tick);
+  UserDbValue u;
+  EXPECT_FALSE(u.Unpack("c=1.5"));
+  EXPECT_FALSE(u.Unpack("c=1x"));
+  EXPECT_FALSE(u.Unpack("d=1e"));
+  EXPECT_FALSE(u.Unpack("d=."));
+}
+
+TEST(RimeUserDbValueTest, UnpackLegacyTextValueInCommaLocale) {
+  std::locale original;
+  bool comma_locale = false;
+  for (const char* name : {"de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8",
+                           "fr_FR.utf8", "German_Germany.1252"}) {
+    try {
+      // also sets the C locale for LC_NUMERIC
+      std::locale::global(std::locale(name));
+      comma_locale = true;
+      break;
+    } catch (const std::runtime_error&) {
+    }
+  }
+  if (!comma_locale) {
+    std::cout << "no comma-decimal locale available; skipped." << std::endl;
+    return;
+  }
+  UserDbValue v("c=2 d=0.5 t=42");
+  string text = v.PackText();
+  std::locale::global(original);
+  EXPECT_EQ(2, v.commits);
+  EXPECT_EQ(0.5, v.dee);
+  EXPECT_EQ(42, v.tick);
+  EXPECT_EQ("c=2 d=0.5 t=42", text);
+}
+
+TYPED_TEST(RimeUserDbTest, RecordValueFormat) {
+  TypeParam db(this->file_name(), "user_db_test");
+  if (db.Exists())
+    db.Remove();
+  ASSERT_TRUE(db.Open());
+  string format;
+  EXPECT_FALSE(db.MetaFetch("/value_format", &format));
+  UserDbImporter importer(&db);
+  EXPECT_TRUE(importer.Put("a \tay", "c=1 d=1 t=1"));
+  // a text db keeps values in the text form on disk
+  bool is_text_db = std::is_base_of<TextDb, TypeParam>::value;
+  EXPECT_EQ(!is_text_db, db.MetaFetch("/value_format", &format));
+  if (!is_text_db) {
+    EXPECT_EQ(UserDbValue::kBinaryFormat, format);
+  }
+  db.Close();
+  db.Remove();
+}
+
+TYPED_TEST(RimeUserDbTest, SnapshotInTextForm) {
+  TypeParam db(this->file_name(), "user_db_test");
+  if (db.Exists())
+    db.Remove();
+  db.Open();
+  UserDbValue v;
+  v.commits = 1;
+  v.dee = 2.0;
+  v.tick = 3;
+  EXPECT_TRUE(db.Update("abc \tdef", v.Pack()));
+  EXPECT_TRUE(db.Update("xyz \tuvw", "c=4 d=5 t=6"));
+  EXPECT_TRUE(db.Backup("user_db_test.snapshot.txt"));
+  db.Close();
+  std::ifstream fin("user_db_test.snapshot.txt");
+  string line;
+  vector<string> records;
+  while (std::getline(fin, line)) {
+    if (!line.empty() && line[0] != '#')
+      records.push_back(line);
+  }
+  fin.close();
+  boost::filesystem::remove("user_db_test.snapshot.txt");
+  ASSERT_EQ(2, records.size());
+  EXPECT_EQ("abc \tdef\tc=1 d=2 t=3", records[0]);
+  EXPECT_EQ("xyz \tuvw\tc=4 d=5 t=6", records[1]);
+}
+
+TEST(RimeLevelDbOptionsTest, LoadFromConfig) {
+  std::istringstream yaml(
+      "db_options:\n"
+      "  block_cache_size: 8388608\n"
+      "  bloom_filter_bits: 10\n"
+      "translator:\n"
+      "  db_options:\n"
+      "    bloom_filter_bits: 0\n"
+      "    compression: false\n"
+      "    fill_cache: true\n");
+  Config config;
+  ASSERT_TRUE(config.LoadFromStream(yaml));
+  LevelDbOptions options;
+  options.Load(&config, "db_options");
+  EXPECT_EQ(8388608, options.block_cache_size);
+  EXPECT_EQ(10, options.bloom_filter_bits);
+  EXPECT_TRUE(options.compression);
+  EXPECT_FALSE(options.fill_cache);
+  options.Load(&config, "translator/db_options");
+  EXPECT_EQ(8388608, options.block_cache_size);
+  EXPECT_EQ(0, options.bloom_filter_bits);
+  EXPECT_EQ(0, options.block_size);
+  EXPECT_FALSE(options.compression);
+  EXPECT_TRUE(options.fill_cache);
+}
+
+TEST(RimeLevelDbTest, ReuseIteratorsUntilWritten) {
+  UserDbWrapper<LevelDb> db("level_db_test.userdb", "level_db_test");
+  if (db.Exists())
+    db.Remove();
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Update("a \tay", "1"));
+  EXPECT_EQ(1, Keys(db.Query("a")).size());
+  EXPECT_EQ(1, Keys(db.Query("a")).size());
+  EXPECT_EQ(1, db.num_iterators_created());
+  {
+    // accessors in use at the same time do not share an iterator
+    auto first = db.Query("a");
+    auto second = db.Query("a");
+    EXPECT_EQ(2, db.num_iterators_created());
+  }
+  EXPECT_TRUE(db.Update("b \tbee", "2"));
+  EXPECT_EQ(2, Keys(db.QueryAll()).size());
+  EXPECT_EQ(3, db.num_iterators_created());
+  EXPECT_TRUE(db.BeginTransaction());
+  EXPECT_TRUE(db.Erase("a \tay"));
+  EXPECT_EQ(2, Keys(db.QueryAll()).size());
+  EXPECT_TRUE(db.CommitTransaction());
+  EXPECT_EQ(vector<string>{"b \tbee"}, Keys(db.QueryAll()));
+  EXPECT_TRUE(db.Close());
+  db.Remove();
+}
+
+TEST(RimeLevelDbTest, KeepAccessorAcrossReopening) {
+  UserDbWrapper<LevelDb> db("level_db_test.userdb", "level_db_test");
+  if (db.Exists())
+    db.Remove();
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Update("a \tay", "1"));
+  EXPECT_TRUE(db.Update("ab \tabby", "2"));
+  auto accessor = db.Query("a");
+  string key, value;
+  ASSERT_TRUE(accessor->GetNextRecord(&key, &value));
+  EXPECT_EQ("a \tay", key);
+  EXPECT_TRUE(db.Close());
+  // closing the db leaves the accessor exhausted
+  EXPECT_TRUE(accessor->exhausted());
+  EXPECT_FALSE(accessor->GetNextRecord(&key, &value));
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Update("abc \tabc", "3"));
+  EXPECT_FALSE(accessor->Reset());
+  EXPECT_EQ(3, Keys(db.Query("a")).size());
+  // the reopened db is not handed the stale accessor's iterator
+  accessor.reset();
+  EXPECT_EQ(3, Keys(db.Query("a")).size());
+  EXPECT_TRUE(db.Close());
+  db.Remove();
+}
+
+TEST(RimeTextDbTest, LoadUnsortedRecords) {
+  const string file_name("text_db_test.userdb.txt");
+  {
+    std::ofstream fout(file_name);
+    fout << "#@/db_name\ttext_db_test\n"
+         << "zyx \tz\tc=1 d=1 t=1\n"
+         << "abc \ta\tc=1 d=1 t=1\n"
+         << "# comment\n"
+         << "\n"
+         << "mno \tm\tc=1 d=1 t=1\r\n"
+         << "abc \ta\tc=2 d=2 t=2\n";
+  }
+  UserDbWrapper<TextDb> db(file_name, "text_db_test");
+  ASSERT_TRUE(db.OpenReadOnly());
+  string value;
+  EXPECT_TRUE(db.MetaFetch("/db_name", &value));
+  EXPECT_EQ("text_db_test", value);
+  EXPECT_EQ((vector<string>{"abc \ta", "mno \tm", "zyx \tz"}),
+            Keys(db.QueryAll()));
+  // the last of duplicate records wins
+  EXPECT_TRUE(db.Fetch("abc \ta", &value));
+  EXPECT_EQ("c=2 d=2 t=2", value);
+  EXPECT_TRUE(db.Fetch("mno \tm", &value));
+  EXPECT_EQ("c=1 d=1 t=1", value);
+  db.Close();
+  boost::filesystem::remove(file_name);
+}
+
+TEST(RimeTextDbTest, MergeUpdatesOverLoadedRecords) {
+  const string file_name("text_db_test.userdb.txt");
+  UserDbWrapper<TextDb> db(file_name, "text_db_test");
+  if (db.Exists())
+    db.Remove();
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Update("a \tay", "1"));
+  EXPECT_TRUE(db.Update("b \tbee", "2"));
+  EXPECT_TRUE(db.Update("c \tsee", "3"));
+  ASSERT_TRUE(db.Close());
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Erase("b \tbee"));
+  EXPECT_FALSE(db.Erase("b \tbee"));
+  EXPECT_FALSE(db.Erase("d \tdee"));
+  EXPECT_TRUE(db.Update("c \tsee", "33"));
+  EXPECT_TRUE(db.Update("bb \tbebe", "22"));
+  string value;
+  EXPECT_FALSE(db.Fetch("b \tbee", &value));
+  EXPECT_TRUE(db.Fetch("c \tsee", &value));
+  EXPECT_EQ("33", value);
+  EXPECT_EQ((vector<string>{"a \tay", "bb \tbebe", "c \tsee"}),
+            Keys(db.QueryAll()));
+  EXPECT_EQ(vector<string>{"bb \tbebe"}, Keys(db.Query("b")));
+  auto accessor = db.QueryAll();
+  EXPECT_FALSE(accessor->exhausted());
+  EXPECT_TRUE(accessor->Jump("bb"));
+  EXPECT_EQ((vector<string>{"bb \tbebe", "c \tsee"}), Keys(accessor));
+  ASSERT_TRUE(db.Close());
+  // merged on saving
+  ASSERT_TRUE(db.OpenReadOnly());
+  EXPECT_EQ((vector<string>{"a \tay", "bb \tbebe", "c \tsee"}),
+            Keys(db.QueryAll()));
+  EXPECT_TRUE(db.Fetch("c \tsee", &value));
+  EXPECT_EQ("33", value);
+  db.Close();
+  db.Remove();
+}
+
+TEST(RimeTextDbTest, MergeUpdatesOnSaving) {
+  const string file_name("text_db_test.userdb.txt");
+  const string snapshot_file("text_db_test.snapshot.txt");
+  UserDbWrapper<TextDb> db(file_name, "text_db_test");
+  if (db.Exists())
+    db.Remove();
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Update("a \tay", "1"));
+  EXPECT_TRUE(db.Update("b \tbee", "2"));
+  EXPECT_EQ(2, db.num_updates());
+  auto accessor = db.QueryAll();
+  ASSERT_TRUE(db.Backup(snapshot_file));
+  EXPECT_EQ(0, db.num_updates());
+  // reads the records as of the query
+  EXPECT_EQ((vector<string>{"a \tay", "b \tbee"}), Keys(accessor));
+  string value;
+  EXPECT_TRUE(db.Fetch("b \tbee", &value));
+  EXPECT_EQ("2", value);
+  EXPECT_TRUE(db.Erase("a \tay"));
+  EXPECT_EQ(1, db.num_updates());
+  EXPECT_EQ(vector<string>{"b \tbee"}, Keys(db.QueryAll()));
+  db.Close();
+  db.Remove();
+  boost::filesystem::remove(snapshot_file);
+}
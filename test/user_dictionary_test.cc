@@ -0,0 +1,632 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <future>
+#include <gtest/gtest.h>
+#include <rime/algo/syllabifier.h>
+#include <rime/dict/mapped_db.h>
+#include <rime/dict/prism.h>
+#include <rime/dict/table.h>
+#include <rime/dict/text_db.h>
+#include <rime/dict/user_db.h>
+#include <rime/dict/user_dictionary.h>
+
+using namespace rime;
+
+using TestDb = UserDbWrapper<TextDb>;
+
+TEST(RimeUserDictionaryTest, ResolveProfile) {
+  EXPECT_FALSE(UserDictProfile::Resolve("luna_pinyin").is_sbxlm());
+  EXPECT_EQ(0, UserDictProfile::Resolve("luna_pinyin").seek_length);
+  // the whole name is to be matched
+  EXPECT_FALSE(UserDictProfile::Resolve("sbjm_extended").is_sbxlm());
+
+  auto sbjm = UserDictProfile::Resolve("sbjm");
+  EXPECT_TRUE(sbjm.is_sbjm());
+  EXPECT_TRUE(sbjm.is_sbjm_or_sbfx());
+  EXPECT_TRUE(sbjm.is_sbjm_or_sbzr());
+  EXPECT_EQ(3, sbjm.seek_length);
+
+  auto sbfx = UserDictProfile::Resolve("sbfx");
+  EXPECT_TRUE(sbfx.is_sbfx());
+  EXPECT_TRUE(sbfx.is_sbjm_or_sbfx());
+  EXPECT_FALSE(sbfx.is_sbjm_or_sbzr());
+  EXPECT_EQ(3, sbfx.seek_length);
+
+  for (const char* name : {"sbzr", "sbxh", "sbfm", "sbfd"}) {
+    auto profile = UserDictProfile::Resolve(name);
+    EXPECT_TRUE(profile.is_sbzr()) << name;
+    EXPECT_TRUE(profile.is_sbjm_or_sbzr()) << name;
+    EXPECT_FALSE(profile.is_sbjm_or_sbfx()) << name;
+    EXPECT_EQ(4, profile.seek_length) << name;
+  }
+}
+
+TEST(RimeUserDictionaryTest, LookupWords) {
+  auto db = New<TestDb>("user_dictionary_test.txt", "user_dictionary_test");
+  if (db->Exists())
+    db->Remove();
+  ASSERT_TRUE(db->Open());
+  EXPECT_TRUE(db->Update("abc \tone", "c=1 d=1 t=1"));
+  EXPECT_TRUE(db->Update("abcd \ttwo", "c=2 d=2 t=1"));
+  EXPECT_TRUE(db->Update("abd \tthree", "c=1 d=1 t=1"));
+  UserDictionary dict("user_dictionary_test", db, "user_dictionary_test");
+  {
+    UserDictEntryIterator it;
+    EXPECT_EQ(1, dict.LookupWords(&it, "abc", false));
+    ASSERT_FALSE(it.exhausted());
+    EXPECT_EQ("one", it.Peek()->text);
+  }
+  {
+    UserDictEntryIterator it;
+    EXPECT_EQ(2, dict.LookupWords(&it, "abc", true));
+    EXPECT_EQ(2, it.cache_size());
+  }
+  {
+    UserDictEntryIterator it;
+    EXPECT_EQ(0, dict.LookupWords(&it, "xyz", true));
+    EXPECT_TRUE(it.exhausted());
+  }
+  db->Close();
+  db->Remove();
+}
+
+TEST(RimeUserDictionaryTest, ResumeLookupWords) {
+  auto db = New<TestDb>("user_dictionary_test.txt", "user_dictionary_test");
+  if (db->Exists())
+    db->Remove();
+  ASSERT_TRUE(db->Open());
+  EXPECT_TRUE(db->Update("abc \tone", "c=1 d=1 t=1"));
+  EXPECT_TRUE(db->Update("abcd \ttwo", "c=2 d=2 t=1"));
+  EXPECT_TRUE(db->Update("abd \tthree", "c=1 d=1 t=1"));
+  UserDictionary dict("user_dictionary_test", db, "user_dictionary_test");
+  {
+    UserDictEntryIterator it;
+    UserDictLookupCursor cursor;
+    for (const char* text : {"one", "two", "three"}) {
+      EXPECT_EQ(1, dict.LookupWords(&it, "ab", &cursor, 1));
+      ASSERT_FALSE(it.exhausted());
+      EXPECT_EQ(text, it.Peek()->text);
+      it.Next();
+    }
+    EXPECT_EQ(0, dict.LookupWords(&it, "ab", &cursor, 1));
+    EXPECT_EQ(3, it.cache_size());
+  }
+  {
+    // continues after the exact matches
+    UserDictEntryIterator it;
+    UserDictLookupCursor cursor;
+    EXPECT_EQ(1, dict.LookupWords(&it, "abc", false, 0, &cursor.resume_key));
+    EXPECT_EQ(1, dict.LookupWords(&it, "abc", &cursor, 10));
+    ASSERT_EQ(2, it.cache_size());
+    it.Next();
+    EXPECT_EQ("two", it.Peek()->text);
+  }
+  db->Close();
+  db->Remove();
+}
+
+static an<DictEntry> MakeEntry(const string& code, const string& text) {
+  auto e = New<DictEntry>();
+  e->custom_code = code + " ";
+  e->text = text;
+  return e;
+}
+
+static size_t CountWords(UserDictionary* dict, const string& input) {
+  UserDictEntryIterator it;
+  return dict->LookupWords(&it, input, false);
+}
+
+TEST(RimeUserDictionaryTest, WriteBehind) {
+  auto db = New<TestDb>("user_dictionary_test.txt", "user_dictionary_test");
+  if (db->Exists())
+    db->Remove();
+  ASSERT_TRUE(db->Open());
+  {
+    UserDictionary dict("user_dictionary_test", db, "user_dictionary_test",
+                        1000, false, true, false, false, 3600, 3, 0);
+    EXPECT_TRUE(dict.UpdateEntry(*MakeEntry("abc", "one"), 1));
+    EXPECT_TRUE(dict.UpdateEntry(*MakeEntry("abc", "one"), 1));
+    // coalesced
+    EXPECT_EQ(1, dict.pending_updates());
+    string value;
+    EXPECT_FALSE(db->Fetch("abc \tone", &value));
+    // yet visible to lookups
+    EXPECT_EQ(1, CountWords(&dict, "abc"));
+    EXPECT_TRUE(dict.UpdateEntry(*MakeEntry("abd", "two"), 1));
+    EXPECT_TRUE(dict.UpdateEntry(*MakeEntry("abe", "three"), 1));
+    // flushed for reaching the size limit
+    EXPECT_EQ(0, dict.pending_updates());
+    ASSERT_TRUE(db->Fetch("abc \tone", &value));
+    EXPECT_GT(UserDbValue(value).commits, 0);
+    string tick;
+    ASSERT_TRUE(db->MetaFetch("/tick", &tick));
+    EXPECT_EQ(std::to_string(dict.tick()), tick);
+    EXPECT_TRUE(dict.UpdateEntry(*MakeEntry("xyz", "four"), 1));
+    EXPECT_EQ(1, dict.pending_updates());
+  }
+  // flushed on destruction
+  string value;
+  EXPECT_TRUE(db->Fetch("xyz \tfour", &value));
+  db->Close();
+  db->Remove();
+}
+
+TEST(RimeUserDictionaryTest, ShareWriteBehindBuffer) {
+  auto db = New<TestDb>("user_dictionary_test.txt", "user_dictionary_test");
+  if (db->Exists())
+    db->Remove();
+  ASSERT_TRUE(db->Open());
+  {
+    UserDictionary first("user_dictionary_test", db, "user_dictionary_test",
+                         1000, false, true, false, false, 3600, 64, 0);
+    UserDictionary second("user_dictionary_test", db, "user_dictionary_test",
+                          1000, false, true, false, false, 3600, 64, 0,
+                          first.write_buffer());
+    EXPECT_TRUE(first.UpdateEntry(*MakeEntry("abc", "one"), 1));
+    EXPECT_EQ(1, second.pending_updates());
+    EXPECT_EQ(first.tick(), second.tick());
+    // builds on the value pending in the other dictionary
+    EXPECT_TRUE(second.UpdateEntry(*MakeEntry("abc", "one"), 1));
+    EXPECT_EQ(1, first.pending_updates());
+    EXPECT_EQ(2, first.tick());
+    EXPECT_TRUE(second.Flush());
+    EXPECT_EQ(0, first.pending_updates());
+    // nothing older to write over the flushed values
+    EXPECT_TRUE(first.Flush());
+    string value;
+    ASSERT_TRUE(db->Fetch("abc \tone", &value));
+    EXPECT_EQ(889, UserDbValue(value).commits);
+    string tick;
+    ASSERT_TRUE(db->MetaFetch("/tick", &tick));
+    EXPECT_EQ("2", tick);
+  }
+  db->Close();
+  db->Remove();
+}
+
+TEST(RimeUserDictionaryTest, FlushDueFromPool) {
+  const string file_name = "user_dictionary_test.userdb.txt";
+  {
+    TestDb db(file_name, "user_dictionary_test");
+    if (db.Exists())
+      db.Remove();
+  }
+  {
+    UserDictionaryComponent component;
+    the<UserDictionary> first(component.Create(
+        "user_dictionary_test", "plain_userdb", "user_dictionary_test"));
+    the<UserDictionary> second(component.Create(
+        "user_dictionary_test", "plain_userdb", "user_dictionary_test"));
+    ASSERT_TRUE(first && second);
+    // pooled by dict name
+    EXPECT_EQ(first->write_buffer(), second->write_buffer());
+    ASSERT_TRUE(first->Load());
+    ASSERT_TRUE(second->Load());
+    EXPECT_TRUE(first->UpdateEntry(*MakeEntry("abc", "one"), 1));
+    EXPECT_EQ(1, second->pending_updates());
+    // kept pending within the default interval of 5 seconds
+    EXPECT_EQ(0, component.FlushDue());
+    EXPECT_EQ(1, second->pending_updates());
+    EXPECT_EQ(1, component.FlushDue(time(NULL) + 5));
+    EXPECT_EQ(0, first->pending_updates());
+    EXPECT_EQ(0, component.FlushDue(time(NULL) + 5));
+  }
+  TestDb db(file_name, "user_dictionary_test");
+  ASSERT_TRUE(db.OpenReadOnly());
+  string value;
+  EXPECT_TRUE(db.Fetch("abc \tone", &value));
+  db.Close();
+  db.Remove();
+}
+
+namespace {
+
+class FailingTestDb : public TestDb {
+ public:
+  using TestDb::TestDb;
+
+  bool Update(const string& key, const string& value) override {
+    return !failing && TestDb::Update(key, value);
+  }
+
+  bool failing = false;
+};
+
+}  // namespace
+
+TEST(RimeUserDictionaryTest, KeepUpdatesOnFailedFlush) {
+  auto db = New<FailingTestDb>("user_dictionary_test.txt",
+                               "user_dictionary_test");
+  if (db->Exists())
+    db->Remove();
+  ASSERT_TRUE(db->Open());
+  {
+    UserDictionary dict("user_dictionary_test", db, "user_dictionary_test",
+                        1000, false, true, false, false, 3600, 64, 0);
+    EXPECT_TRUE(dict.UpdateEntry(*MakeEntry("abc", "one"), 1));
+    db->failing = true;
+    EXPECT_FALSE(dict.Flush());
+    EXPECT_EQ(1, dict.pending_updates());
+    EXPECT_EQ(1, CountWords(&dict, "abc"));
+    db->failing = false;
+    EXPECT_TRUE(dict.Flush());
+    EXPECT_EQ(0, dict.pending_updates());
+  }
+  string value;
+  EXPECT_TRUE(db->Fetch("abc \tone", &value));
+  db->Close();
+  db->Remove();
+}
+
+TEST(RimeUserDictionaryTest, QueryCache) {
+  auto db = New<TestDb>("user_dictionary_test.txt", "user_dictionary_test");
+  if (db->Exists())
+    db->Remove();
+  ASSERT_TRUE(db->Open());
+  EXPECT_TRUE(db->Update("abc \tone", "c=1 d=1 t=1"));
+  EXPECT_TRUE(db->Update("abcd \ttwo", "c=1 d=1 t=1"));
+  UserDictionary dict("user_dictionary_test", db, "user_dictionary_test",
+                      1000, false, true, false, false, 0, 64, 2);
+  EXPECT_EQ(1, CountWords(&dict, "abc"));
+  EXPECT_EQ(0, dict.query_cache_hits());
+  EXPECT_EQ(1, dict.query_cache_misses());
+  EXPECT_EQ(1, CountWords(&dict, "abc"));
+  EXPECT_EQ(1, dict.query_cache_hits());
+  {
+    UserDictEntryIterator it;
+    EXPECT_EQ(2, dict.LookupWords(&it, "abc", true));
+    EXPECT_EQ(2, dict.query_cache_hits());
+  }
+  // an update to an overlapping key invalidates the cached query
+  EXPECT_TRUE(dict.UpdateEntry(*MakeEntry("abc", "three"), 1));
+  EXPECT_EQ(2, CountWords(&dict, "abc"));
+  EXPECT_EQ(2, dict.query_cache_hits());
+  EXPECT_EQ(2, dict.query_cache_misses());
+  // while others stay cached
+  EXPECT_EQ(0, CountWords(&dict, "xyz"));
+  EXPECT_TRUE(dict.UpdateEntry(*MakeEntry("abd", "four"), 1));
+  EXPECT_EQ(0, CountWords(&dict, "xyz"));
+  EXPECT_EQ(3, dict.query_cache_hits());
+  // the least recently used query is evicted
+  EXPECT_EQ(0, CountWords(&dict, "uvw"));
+  EXPECT_EQ(2, CountWords(&dict, "abc"));
+  EXPECT_EQ(5, dict.query_cache_misses());
+  db->Close();
+  db->Remove();
+}
+
+namespace {
+
+class TransactionalTestDb : public TestDb, public Transactional {
+ public:
+  using TestDb::TestDb;
+};
+
+}  // namespace
+
+TEST(RimeUserDictionaryTest, RevertPendingTransaction) {
+  auto db = New<TransactionalTestDb>("user_dictionary_test.txt",
+                                     "user_dictionary_test");
+  if (db->Exists())
+    db->Remove();
+  ASSERT_TRUE(db->Open());
+  UserDictionary dict("user_dictionary_test", db, "user_dictionary_test",
+                      1000, false, true, false, false, 3600, 64, 0);
+  EXPECT_TRUE(dict.NewTransaction());
+  EXPECT_TRUE(dict.UpdateEntry(*MakeEntry("abc", "one"), 1));
+  EXPECT_TRUE(dict.CommitPendingTransaction());
+  EXPECT_TRUE(dict.NewTransaction());
+  EXPECT_TRUE(dict.UpdateEntry(*MakeEntry("abc", "one"), 1));
+  EXPECT_TRUE(dict.UpdateEntry(*MakeEntry("abd", "two"), 1));
+  EXPECT_EQ(2, dict.pending_updates());
+  EXPECT_TRUE(dict.RevertRecentTransaction());
+  // the committed update stays pending
+  EXPECT_EQ(1, dict.pending_updates());
+  EXPECT_EQ(1, CountWords(&dict, "abc"));
+  EXPECT_EQ(0, CountWords(&dict, "abd"));
+  EXPECT_FALSE(dict.RevertRecentTransaction());
+  EXPECT_TRUE(dict.Flush());
+  EXPECT_EQ(0, dict.pending_updates());
+  string value;
+  ASSERT_TRUE(db->Fetch("abc \tone", &value));
+  EXPECT_GT(UserDbValue(value).commits, 0);
+  EXPECT_FALSE(db->Fetch("abd \ttwo", &value));
+  db->Close();
+  db->Remove();
+}
+
+TEST(RimeUserDictionaryTest, InvalidateQueryCacheOnSharedBuffer) {
+  auto db = New<TransactionalTestDb>("user_dictionary_test.txt",
+                                     "user_dictionary_test");
+  if (db->Exists())
+    db->Remove();
+  ASSERT_TRUE(db->Open());
+  EXPECT_TRUE(db->Update("abc \tone", "c=1 d=1 t=1"));
+  UserDictionary writer("user_dictionary_test", db, "user_dictionary_test",
+                        1000, false, true, false, false, 3600, 64, 0);
+  UserDictionary reader("user_dictionary_test", db, "user_dictionary_test",
+                        1000, false, true, false, false, 3600, 64, 2,
+                        writer.write_buffer());
+  EXPECT_EQ(1, CountWords(&reader, "abc"));
+  EXPECT_EQ(1, CountWords(&reader, "abc"));
+  EXPECT_EQ(1, reader.query_cache_hits());
+  // an update by another dictionary on the db
+  EXPECT_TRUE(writer.UpdateEntry(*MakeEntry("abc", "two"), 1));
+  EXPECT_EQ(2, CountWords(&reader, "abc"));
+  EXPECT_EQ(1, reader.query_cache_hits());
+  EXPECT_EQ(2, reader.query_cache_misses());
+  // and its reversion
+  EXPECT_TRUE(writer.NewTransaction());
+  EXPECT_TRUE(writer.UpdateEntry(*MakeEntry("abc", "three"), 1));
+  EXPECT_EQ(3, CountWords(&reader, "abc"));
+  EXPECT_TRUE(writer.RevertRecentTransaction());
+  EXPECT_EQ(2, CountWords(&reader, "abc"));
+  EXPECT_EQ(4, reader.query_cache_misses());
+  // values stay the same on flushing
+  EXPECT_TRUE(writer.Flush());
+  EXPECT_EQ(2, CountWords(&reader, "abc"));
+  EXPECT_EQ(2, reader.query_cache_hits());
+  db->Close();
+  db->Remove();
+}
+
+namespace {
+
+using Transcript = vector<vector<string>>;
+
+class Session {
+ public:
+  Session(UserDictionary* dict, const string& code) : dict_(dict) {
+    for (size_t len = 1; len <= code.length(); ++len) {
+      inputs_.push_back(code.substr(0, len));
+    }
+  }
+
+  bool done() const { return next_ >= inputs_.size(); }
+
+  // looks up the next keystroke of the code, as the user types
+  void Type() {
+    UserDictEntryIterator it;
+    dict_->LookupWords(&it, inputs_[next_++], false, 0, NULL, &state_);
+    vector<string> texts;
+    for (; !it.exhausted(); it.Next()) {
+      texts.push_back(it.Peek()->text);
+    }
+    transcript_.push_back(texts);
+  }
+
+  const Transcript& transcript() const { return transcript_; }
+
+ private:
+  UserDictionary* dict_;
+  vector<string> inputs_;
+  size_t next_ = 0;
+  UserDictLookupState state_;
+  Transcript transcript_;
+};
+
+// every combination of 3 or 4 code letters, with a few phrases apiece
+void PopulateDb(Db* db) {
+  const string letters = "bcdfaeuio";
+  for (char a : letters) {
+    for (char b : letters) {
+      for (char c : letters) {
+        string code{a, b, c};
+        db->Update(code + " \t" + code, "c=1 d=1 t=0");
+        for (char d : letters) {
+          string long_code = code + d;
+          db->Update(long_code + " \t" + long_code, "c=2 d=2 t=0");
+          db->Update(long_code + " \t" + long_code + "'", "c=1 d=3 t=0");
+        }
+      }
+    }
+  }
+}
+
+// the transcript of typing a code in a session of its own
+Transcript TypeAlone(UserDictionary* dict, const string& code) {
+  Session session(dict, code);
+  while (!session.done()) {
+    session.Type();
+  }
+  return session.transcript();
+}
+
+const vector<string> kDictNames = {"sbjm", "sbfx", "sbzr", "luna"};
+const vector<string> kCodes = {"bcdaa", "fdbeu", "bcdai",
+                               "dfcoe", "bcfau", "aeiou"};
+
+}  // namespace
+
+TEST(RimeUserDictionaryTest, InterleavedSessions) {
+  for (const string& dict_name : kDictNames) {
+    auto db = New<TestDb>("user_dictionary_test.txt", dict_name);
+    if (db->Exists())
+      db->Remove();
+    ASSERT_TRUE(db->Open());
+    PopulateDb(db.get());
+    UserDictionary dict(dict_name, db, dict_name);
+    vector<Transcript> expected;
+    for (const string& code : kCodes) {
+      expected.push_back(TypeAlone(&dict, code));
+    }
+    vector<Session> sessions;
+    for (const string& code : kCodes) {
+      sessions.emplace_back(&dict, code);
+    }
+    // keystrokes of all sessions alternate
+    for (bool typing = true; typing;) {
+      typing = false;
+      for (Session& session : sessions) {
+        if (!session.done()) {
+          session.Type();
+          typing = true;
+        }
+      }
+    }
+    for (size_t i = 0; i < sessions.size(); ++i) {
+      EXPECT_EQ(expected[i], sessions[i].transcript())
+          << dict_name << ": " << kCodes[i];
+    }
+    db->Close();
+    db->Remove();
+  }
+}
+
+#ifndef RIME_NO_THREADING
+TEST(RimeUserDictionaryTest, ConcurrentSessions) {
+  const int kRounds = 20;
+  for (const string& dict_name : kDictNames) {
+    auto db = New<TestDb>("user_dictionary_test.txt", dict_name);
+    if (db->Exists())
+      db->Remove();
+    ASSERT_TRUE(db->Open());
+    PopulateDb(db.get());
+    // with and without a query cache, small enough to evict queries
+    for (int cache_size : {0, 4}) {
+      UserDictionary dict(dict_name, db, dict_name, 1000, false, true, false,
+                          false, 5, 64, cache_size);
+      vector<Transcript> expected;
+      for (const string& code : kCodes) {
+        expected.push_back(TypeAlone(&dict, code));
+      }
+      vector<std::future<bool>> results;
+      for (size_t i = 0; i < kCodes.size(); ++i) {
+        results.push_back(std::async(std::launch::async, [&, i] {
+          for (int round = 0; round < kRounds; ++round) {
+            if (TypeAlone(&dict, kCodes[i]) != expected[i])
+              return false;
+          }
+          return true;
+        }));
+      }
+      for (size_t i = 0; i < results.size(); ++i) {
+        EXPECT_TRUE(results[i].get())
+            << dict_name << ": " << kCodes[i] << ", cache " << cache_size;
+      }
+      if (cache_size > 0) {
+        EXPECT_GT(dict.query_cache_hits(), 0);
+      }
+    }
+    db->Close();
+    db->Remove();
+  }
+}
+
+TEST(RimeUserDictionaryTest, ConcurrentSessionsOnMappedDb) {
+  // words are written to the db while sessions look up others
+  const int kNumWords = 3000;
+  const int kRounds = 5;
+  auto db = New<UserDbWrapper<MappedDb>>("user_dictionary_test.userdb.bin",
+                                         "luna");
+  if (db->Exists())
+    db->Remove();
+  ASSERT_TRUE(db->Open());
+  PopulateDb(db.get());
+  UserDictionary dict("luna", db, "luna");
+  vector<Transcript> expected;
+  for (const string& code : kCodes) {
+    expected.push_back(TypeAlone(&dict, code));
+  }
+  auto writer = std::async(std::launch::async, [&] {
+    for (int i = 0; i < kNumWords; ++i) {
+      string word = "z" + std::to_string(i);
+      if (!db->Update(word + " \t" + word, "c=1 d=1 t=1"))
+        return false;
+    }
+    return true;
+  });
+  vector<std::future<bool>> results;
+  for (size_t i = 0; i < kCodes.size(); ++i) {
+    results.push_back(std::async(std::launch::async, [&, i] {
+      for (int round = 0; round < kRounds; ++round) {
+        if (TypeAlone(&dict, kCodes[i]) != expected[i])
+          return false;
+      }
+      return true;
+    }));
+  }
+  for (size_t i = 0; i < results.size(); ++i) {
+    EXPECT_TRUE(results[i].get()) << kCodes[i];
+  }
+  EXPECT_TRUE(writer.get());
+  string value;
+  for (int i = 0; i < kNumWords; ++i) {
+    string word = "z" + std::to_string(i);
+    EXPECT_TRUE(db->Fetch(word + " \t" + word, &value)) << word;
+  }
+  db->Close();
+  db->Remove();
+}
+#endif  // RIME_NO_THREADING
+
+static vector<string> Texts(UserDictEntryIterator& it) {
+  vector<string> texts;
+  for (; !it.exhausted(); it.Next()) {
+    texts.push_back(it.Peek()->text);
+  }
+  return texts;
+}
+
+TEST(RimeUserDictionaryTest, LookupAll) {
+  Syllabary syllabary = {"an", "hao", "ni", "xi", "xian"};
+  auto table = New<Table>("user_dictionary_test.table.bin");
+  table->Remove();
+  ASSERT_TRUE(table->Build(syllabary, Vocabulary(), 0));
+  ASSERT_TRUE(table->Save());
+  ASSERT_TRUE(table->Load());
+  auto prism = New<Prism>("user_dictionary_test.prism.bin");
+  prism->Remove();
+  ASSERT_TRUE(prism->Build(syllabary));
+  SyllableGraph graph;
+  Syllabifier().BuildSyllableGraph("xianhao", *prism, &graph);
+
+  auto db = New<TestDb>("user_dictionary_test.txt", "user_dictionary_test");
+  if (db->Exists())
+    db->Remove();
+  ASSERT_TRUE(db->Open());
+  EXPECT_TRUE(db->Update("hao \tgood", "c=1 d=1 t=1"));
+  EXPECT_TRUE(db->Update("ni hao \thello", "c=1 d=1 t=1"));
+  EXPECT_TRUE(db->Update("xi an \tXi'an", "c=1 d=1 t=1"));
+  EXPECT_TRUE(db->Update("xian \tfirst", "c=2 d=2 t=1"));
+  EXPECT_TRUE(db->Update("xian hao \tfirst good", "c=1 d=1 t=1"));
+  UserDictionary dict("user_dictionary_test", db, "user_dictionary_test");
+  dict.Attach(table, prism);
+
+  auto all = dict.LookupAll(graph);
+  // a single seek to skip 'ni hao'
+  EXPECT_EQ(1, dict.seek_count());
+  ASSERT_EQ(2, all.size());
+  ASSERT_EQ(1, all.count(0));
+  auto& from_0 = *all[0];
+  EXPECT_EQ(2, from_0.size());
+  EXPECT_EQ((vector<string>{"first", "Xi'an"}), Texts(from_0[4]));
+  EXPECT_EQ(vector<string>{"first good"}, Texts(from_0[7]));
+  ASSERT_EQ(1, all.count(4));
+  auto& from_4 = *all[4];
+  EXPECT_EQ(1, from_4.size());
+  EXPECT_EQ(vector<string>{"good"}, Texts(from_4[7]));
+
+  // looking up from each start position finds the same phrases
+  EXPECT_TRUE(dict.Lookup(graph, 2) == nullptr);
+  auto from_4_only = dict.Lookup(graph, 4);
+  ASSERT_TRUE(from_4_only != nullptr);
+  EXPECT_EQ(vector<string>{"good"}, Texts((*from_4_only)[7]));
+  auto from_0_only = dict.Lookup(graph, 0);
+  ASSERT_TRUE(from_0_only != nullptr);
+  EXPECT_EQ((vector<string>{"first", "Xi'an"}), Texts((*from_0_only)[4]));
+  EXPECT_EQ(vector<string>{"first good"}, Texts((*from_0_only)[7]));
+  // with a limited number of syllables
+  auto single_syllables = dict.Lookup(graph, 0, 1);
+  ASSERT_TRUE(single_syllables != nullptr);
+  EXPECT_EQ(1, single_syllables->size());
+  EXPECT_EQ(vector<string>{"first"}, Texts((*single_syllables)[4]));
+
+  db->Close();
+  db->Remove();
+  table->Remove();
+  prism->Remove();
+}
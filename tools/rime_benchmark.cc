@@ -0,0 +1,1206 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+// micro benchmarks for hot paths of the dictionary lookups.
+//
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#include <boost/filesystem.hpp>
+#include <rime/common.h>
+#include <rime/setup.h>
+#include <rime/algo/algebra.h>
+#include <rime/algo/syllabifier.h>
+#include <rime/dict/corrector.h>
+#include <rime/dict/dictionary.h>
+#include <rime/dict/level_db.h>
+#include <rime/dict/prism.h>
+#include <rime/dict/table.h>
+#include <rime/dict/text_db.h>
+#include <rime/dict/user_db.h>
+#include <rime/dict/user_dictionary.h>
+
+// usage:
+//   rime_benchmark userdb_lookup [dict_name] [num_entries] [num_lookups]
+//   rime_benchmark userdb_scan [num_records]
+//   rime_benchmark userdb_graph [num_phrases]
+//   rime_benchmark userdb_iterators [num_records]
+//   rime_benchmark textdb_load [num_records]
+//   rime_benchmark dict_predict [num_packs]
+//   rime_benchmark table_query [num_phrases]
+//   rime_benchmark table_search [num_phrases]
+//   rime_benchmark prism_expand [num_rounds]
+//   rime_benchmark syllabify_typing [num_rounds]
+//   rime_benchmark correction_typing [num_rounds]
+//   rime_benchmark symdelete_collect [num_syllables]
+//   rime_benchmark dict_cold_start [num_phrases]
+// example:
+//   rime_benchmark userdb_lookup sbjm 100000 10000
+//   rime_benchmark userdb_scan 1000000
+//   rime_benchmark userdb_graph 100000
+//   rime_benchmark userdb_iterators 100000
+//   rime_benchmark textdb_load 500000
+//   rime_benchmark dict_predict 3
+//   rime_benchmark table_query 100000
+//   rime_benchmark table_search 500000
+//   rime_benchmark prism_expand 10000
+//   rime_benchmark syllabify_typing 1000
+//   rime_benchmark correction_typing 100
+//   rime_benchmark symdelete_collect 1500
+//   rime_benchmark dict_cold_start 500000
+
+using namespace rime;
+
+using Clock = std::chrono::steady_clock;
+
+static double ElapsedMicroseconds(Clock::time_point since) {
+  return std::chrono::duration<double, std::micro>(Clock::now() - since)
+      .count();
+}
+
+static string RandomCode(std::mt19937& rng, size_t length) {
+  static const char kLetters[] = "qwrtsdfgzxcvbyphjklnmaeuio";
+  std::uniform_int_distribution<size_t> pick(0, sizeof(kLetters) - 2);
+  string code;
+  for (size_t i = 0; i < length; ++i) {
+    code.push_back(kLetters[pick(rng)]);
+  }
+  return code;
+}
+
+static int BenchmarkUserDbLookup(const string& dict_name,
+                                 size_t num_entries,
+                                 size_t num_lookups) {
+  auto file_path =
+      boost::filesystem::temp_directory_path() /
+      boost::filesystem::unique_path("rime_benchmark_%%%%%%%%.userdb.txt");
+  {
+    auto db = New<UserDbWrapper<TextDb>>(file_path.string(), dict_name);
+    if (!db->Open()) {
+      std::cerr << "failed to open db: " << file_path << std::endl;
+      return 1;
+    }
+    std::mt19937 rng(20111030);
+    std::uniform_int_distribution<size_t> code_length(3, 6);
+    for (size_t i = 0; i < num_entries; ++i) {
+      string code = RandomCode(rng, code_length(rng));
+      db->Update(code + " \t" + std::to_string(i), "c=1 d=1 t=1");
+    }
+    UserDictionary dict(dict_name, db, dict_name);
+    vector<string> inputs;
+    for (size_t i = 0; i < num_lookups; ++i) {
+      inputs.push_back(RandomCode(rng, code_length(rng)));
+    }
+    size_t total_found = 0;
+    auto start = Clock::now();
+    for (const string& input : inputs) {
+      UserDictEntryIterator it;
+      total_found += dict.LookupWords(&it, input, false);
+    }
+    double elapsed = ElapsedMicroseconds(start);
+    std::cout << "userdb_lookup: dict = " << dict_name
+              << ", entries = " << num_entries << ", lookups = " << num_lookups
+              << ", found = " << total_found << std::endl
+              << "  " << elapsed / num_lookups << " us per lookup" << std::endl;
+    db->Close();
+  }
+  boost::filesystem::remove(file_path);
+  return 0;
+}
+
+// decodes user db values in the binary and the legacy text encodings
+static int BenchmarkUserDbScan(size_t num_records) {
+  std::mt19937 rng(20111102);
+  std::uniform_int_distribution<int> commits(-1, 1000);
+  std::uniform_real_distribution<double> dee(0.0, 100.0);
+  vector<string> binary_values;
+  vector<string> text_values;
+  binary_values.reserve(num_records);
+  text_values.reserve(num_records);
+  for (size_t i = 0; i < num_records; ++i) {
+    UserDbValue v;
+    v.commits = commits(rng);
+    v.dee = dee(rng);
+    v.tick = i;
+    binary_values.push_back(v.Pack());
+    text_values.push_back(v.PackText());
+  }
+  for (const auto* values : {&text_values, &binary_values}) {
+    double sum = 0.0;
+    UserDbValue v;
+    auto start = Clock::now();
+    for (const string& value : *values) {
+      v.Unpack(value);
+      sum += v.dee;
+    }
+    double elapsed = ElapsedMicroseconds(start);
+    std::cout << "userdb_scan: "
+              << (values == &text_values ? "text" : "binary")
+              << " values = " << num_records << ", checksum = " << sum
+              << std::endl
+              << "  " << elapsed / 1000 << " ms in total, "
+              << elapsed * 1000 / num_records << " ns per record" << std::endl;
+  }
+  return 0;
+}
+
+static const char* kPinyinSyllables[] = {
+    "an",  "chang", "de",    "ge",  "guo",   "hang", "hao",  "hen",
+    "huo", "ju",    "men",   "min", "ni",    "qi",   "qu",   "ren",
+    "shang", "shi", "sheng", "wo",  "xi",    "xian", "xue",  "yi",
+    "yin", "zhe",   "zhong", "zi",
+};
+
+static const char kPinyinInput[] =
+    "womenyiqiqushangxuezhongguorenminyinhangdeshenghuo";
+
+// spells syllables in full or abbreviated by initials, as in luna_pinyin
+static void AbbreviatePinyin(const Syllabary& syllabary, Script* script) {
+  for (const string& syllable : syllabary) {
+    script->AddSyllable(syllable);
+    size_t initial_length =
+        syllable.length() > 1 && syllable[1] == 'h' ? 2 : 1;
+    SpellingProperties abbreviation;
+    abbreviation.type = kAbbreviation;
+    abbreviation.credibility = std::log(0.5);
+    script->Merge(syllable.substr(0, initial_length), abbreviation,
+                  {Spelling(syllable)});
+  }
+}
+
+// looks up user phrases in the syllable graph of a long pinyin input,
+// as it is typed keystroke by keystroke
+static int BenchmarkUserDbGraph(size_t num_phrases) {
+  const int kMaxSyllablesForUserPhraseQuery = 5;
+  auto temp_path = boost::filesystem::temp_directory_path() /
+                   boost::filesystem::unique_path("rime_benchmark_%%%%%%%%");
+  Syllabary syllabary(std::begin(kPinyinSyllables), std::end(kPinyinSyllables));
+  Script script;
+  AbbreviatePinyin(syllabary, &script);
+  auto table = New<Table>(temp_path.string() + ".table.bin");
+  auto prism = New<Prism>(temp_path.string() + ".prism.bin");
+  if (!table->Build(syllabary, Vocabulary(), 0) || !table->Save() ||
+      !table->Load() || !prism->Build(syllabary, &script)) {
+    std::cerr << "failed to build dictionary: " << temp_path << std::endl;
+    return 1;
+  }
+  auto db = New<UserDbWrapper<TextDb>>(temp_path.string() + ".userdb.txt",
+                                       "luna_pinyin");
+  if (!db->Open()) {
+    std::cerr << "failed to open db: " << temp_path << std::endl;
+    return 1;
+  }
+  std::mt19937 rng(20130625);
+  std::uniform_int_distribution<size_t> pick(0, syllabary.size() - 1);
+  std::uniform_int_distribution<size_t> phrase_length(1, 4);
+  vector<string> spellings(syllabary.begin(), syllabary.end());
+  for (size_t i = 0; i < num_phrases; ++i) {
+    string code;
+    for (size_t n = phrase_length(rng); n > 0; --n) {
+      code += spellings[pick(rng)] + " ";
+    }
+    db->Update(code + "\t" + std::to_string(i), "c=1 d=1 t=1");
+  }
+  UserDictionary dict("luna_pinyin", db, "luna_pinyin");
+  dict.Attach(table, prism);
+  const string input(kPinyinInput);
+  vector<CompactSyllableGraph> graphs;
+  for (size_t len = 1; len <= input.length(); ++len) {
+    Syllabifier syllabifier;
+    syllabifier.BuildSyllableGraph(input.substr(0, len), *prism);
+    graphs.push_back(syllabifier.syllable_graph());
+  }
+  for (bool single_pass : {false, true}) {
+    size_t total_found = 0;
+    size_t seeks = dict.seek_count();
+    auto start = Clock::now();
+    for (const auto& graph : graphs) {
+      if (single_pass) {
+        auto all = dict.LookupAll(graph, kMaxSyllablesForUserPhraseQuery);
+        for (const auto& x : all) {
+          for (const auto& y : *x.second) {
+            total_found += y.second.cache_size();
+          }
+        }
+        continue;
+      }
+      for (const auto& x : graph.vertices) {
+        if (!graph.has_edges(x.first))
+          continue;
+        if (auto result = dict.Lookup(graph, x.first,
+                                      kMaxSyllablesForUserPhraseQuery)) {
+          for (const auto& y : *result) {
+            total_found += y.second.cache_size();
+          }
+        }
+      }
+    }
+    double elapsed = ElapsedMicroseconds(start);
+    seeks = dict.seek_count() - seeks;
+    std::cout << "userdb_graph: " << (single_pass ? "single pass" : "per start")
+              << ", phrases = " << num_phrases
+              << ", keystrokes = " << graphs.size()
+              << ", found = " << total_found << std::endl
+              << "  " << double(seeks) / graphs.size()
+              << " seeks per keystroke, " << elapsed / graphs.size()
+              << " us per keystroke" << std::endl;
+  }
+  db->Close();
+  db->Remove();
+  table->Remove();
+  prism->Remove();
+  return 0;
+}
+
+// prefix scans of a level db, as issued by translators on every keystroke,
+// with a phrase committed every few keystrokes
+static int BenchmarkUserDbIterators(size_t num_records) {
+  const size_t kQueriesPerKeystroke = 3;
+  const size_t kRecordsPerQuery = 20;
+  const size_t kKeystrokesPerCommit = 10;
+  auto file_path =
+      boost::filesystem::temp_directory_path() /
+      boost::filesystem::unique_path("rime_benchmark_%%%%%%%%.userdb");
+  auto db = New<UserDbWrapper<LevelDb>>(file_path.string(), "luna_pinyin");
+  if (!db->Open()) {
+    std::cerr << "failed to open db: " << file_path << std::endl;
+    return 1;
+  }
+  std::mt19937 rng(20141204);
+  std::uniform_int_distribution<size_t> code_length(3, 6);
+  for (size_t i = 0; i < num_records; ++i) {
+    db->Update(RandomCode(rng, code_length(rng)) + " \t" + std::to_string(i),
+               "c=1 d=1 t=1");
+  }
+  const string input(kPinyinInput);
+  size_t iterators = db->num_iterators_created();
+  size_t total_found = 0;
+  auto start = Clock::now();
+  for (size_t len = 1; len <= input.length(); ++len) {
+    for (size_t i = 0; i < kQueriesPerKeystroke && i < len; ++i) {
+      auto accessor = db->Query(input.substr(len - 1 - i, i + 1));
+      string key, value;
+      for (size_t n = 0;
+           n < kRecordsPerQuery && accessor->GetNextRecord(&key, &value);
+           ++n) {
+        ++total_found;
+      }
+    }
+    if (len % kKeystrokesPerCommit == 0) {
+      db->Update(input.substr(0, len) + " \t", "c=1 d=1 t=1");
+    }
+  }
+  double elapsed = ElapsedMicroseconds(start);
+  iterators = db->num_iterators_created() - iterators;
+  std::cout << "userdb_iterators: records = " << num_records
+            << ", keystrokes = " << input.length()
+            << ", found = " << total_found << std::endl
+            << "  " << double(iterators) / input.length()
+            << " iterators created per keystroke, "
+            << elapsed / input.length() << " us per keystroke" << std::endl;
+  db->Close();
+  db->Remove();
+  return 0;
+}
+
+static size_t ResidentKilobytes() {
+#ifdef __linux__
+  std::ifstream statm("/proc/self/statm");
+  size_t total_pages = 0, resident_pages = 0;
+  statm >> total_pages >> resident_pages;
+  return resident_pages * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+  return 0;
+#endif
+}
+
+// loads a plain text user db, then scans it by prefixes
+static int BenchmarkTextDbLoad(size_t num_records) {
+  const size_t kNumQueries = 10000;
+  auto file_path =
+      boost::filesystem::temp_directory_path() /
+      boost::filesystem::unique_path("rime_benchmark_%%%%%%%%.userdb.txt");
+  {
+    // codes in ascending order, as in a saved db
+    std::ofstream fout(file_path.string());
+    fout << "#@/db_name\tluna_pinyin" << std::endl
+         << "#@/db_type\tuserdb" << std::endl;
+    for (size_t i = 0; i < num_records; ++i) {
+      char code[] = "aaaa";
+      for (size_t n = i, k = 4; k > 0; n /= 26) {
+        code[--k] = 'a' + n % 26;
+      }
+      fout << code << " \t" << i << "\tc=" << i % 100 << " d=1 t=" << i
+           << std::endl;
+    }
+  }
+  std::mt19937 rng(20130414);
+  UserDbWrapper<TextDb> db(file_path.string(), "luna_pinyin");
+  size_t memory = ResidentKilobytes();
+  auto start = Clock::now();
+  if (!db.OpenReadOnly()) {
+    std::cerr << "failed to load db: " << file_path << std::endl;
+    return 1;
+  }
+  double load_time = ElapsedMicroseconds(start);
+  memory = ResidentKilobytes() - memory;
+  size_t total_found = 0;
+  start = Clock::now();
+  for (size_t i = 0; i < kNumQueries; ++i) {
+    auto accessor = db.Query(RandomCode(rng, 2));
+    string key, value;
+    while (accessor->GetNextRecord(&key, &value)) {
+      ++total_found;
+    }
+  }
+  double query_time = ElapsedMicroseconds(start);
+  std::cout << "textdb_load: records = " << num_records
+            << ", file size = " << boost::filesystem::file_size(file_path)
+            << ", found = " << total_found << std::endl
+            << "  " << load_time / 1000 << " ms to load, " << memory
+            << " KiB resident, " << query_time / kNumQueries
+            << " us per prefix query" << std::endl;
+  db.Close();
+  boost::filesystem::remove(file_path);
+  return 0;
+}
+
+// pages through the candidates of a 1-letter predictive query, merged from
+// syllables of the same initial in the main table and the packs
+static int BenchmarkDictPredict(size_t num_packs) {
+  const size_t kEntriesPerSyllable = 8;
+  const size_t kNumCandidates = 500;
+  const size_t kNumQueries = 200;
+  const size_t kCompletionMaxEntries = 100;
+  auto temp_path = boost::filesystem::temp_directory_path() /
+                   boost::filesystem::unique_path("rime_benchmark_%%%%%%%%");
+  // syllables of 3 letters
+  Syllabary syllabary;
+  for (char a = 'a'; a <= 'z'; ++a) {
+    for (char b = 'a'; b <= 'z'; ++b) {
+      for (char c = 'a'; c <= 'z'; ++c) {
+        syllabary.insert(string{a, b, c});
+      }
+    }
+  }
+  std::mt19937 rng(20110705);
+  std::uniform_real_distribution<double> weight(1.0, 1000.0);
+  vector<of<Table>> tables;
+  for (size_t i = 0; i <= num_packs; ++i) {
+    Vocabulary vocabulary;
+    size_t num_entries = 0;
+    int syllable_id = 0;
+    for (const string& syllable : syllabary) {
+      for (size_t k = 0; k < kEntriesPerSyllable; ++k) {
+        auto e = New<ShortDictEntry>();
+        e->code.push_back(syllable_id);
+        e->text = syllable + std::to_string(i * kEntriesPerSyllable + k);
+        e->weight = weight(rng);
+        vocabulary[syllable_id].entries.push_back(e);
+        ++num_entries;
+      }
+      ++syllable_id;
+    }
+    vocabulary.SortHomophones();
+    auto table = New<Table>(temp_path.string() + "." + std::to_string(i) +
+                            ".table.bin");
+    table->set_completion_index(2, kCompletionMaxEntries);
+    if (!table->Build(syllabary, vocabulary, num_entries) || !table->Save() ||
+        !table->Load()) {
+      std::cerr << "failed to build table: " << table->file_name()
+                << std::endl;
+      return 1;
+    }
+    tables.push_back(table);
+  }
+  auto prism = New<Prism>(temp_path.string() + ".prism.bin");
+  if (!prism->Build(syllabary)) {
+    std::cerr << "failed to build prism: " << prism->file_name() << std::endl;
+    return 1;
+  }
+  Dictionary dict("benchmark", vector<string>(num_packs), tables, prism);
+  size_t total_found = 0;
+  double checksum = 0.0;
+  auto start = Clock::now();
+  for (size_t i = 0; i < kNumQueries; ++i) {
+    DictEntryIterator it;
+    dict.LookupWords(&it, string(1, 'a' + i % 26), true);
+    for (size_t n = 0; n < kNumCandidates && !it.exhausted(); ++n) {
+      // sensitive to the order of candidates
+      checksum += it.Peek()->weight * (n + 1);
+      ++total_found;
+      it.Next();
+    }
+  }
+  double elapsed = ElapsedMicroseconds(start);
+  std::cout << "dict_predict: packs = " << num_packs
+            << ", chunks per query = " << 26 * 26 * (num_packs + 1)
+            << ", candidates = " << total_found
+            << ", checksum = " << std::setprecision(15) << checksum
+            << std::setprecision(6)
+            << std::endl
+            << "  " << elapsed / kNumQueries << " us per query, "
+            << elapsed * 1000 / total_found << " ns per candidate"
+            << std::endl;
+  // scrolls down the candidates, fetching more keys whenever the entries run
+  // out as the table translator does
+  const size_t kInitialSearchLimit = 10;
+  const size_t kExpandingFactor = 10;
+  const size_t kScrollDepth = 5000;
+  size_t total_paged = 0;
+  start = Clock::now();
+  for (size_t i = 0; i < kNumQueries; ++i) {
+    string input(1, 'a' + i % 26);
+    DictEntryIterator it;
+    size_t n = 0;
+    for (size_t limit = kInitialSearchLimit; limit && n < kScrollDepth;) {
+      size_t consumed = it.entry_count();
+      DictEntryIterator more;
+      limit = dict.LookupWords(&more, input, true, limit) < limit
+                  ? 0
+                  : limit * kExpandingFactor;
+      more.Skip(consumed);
+      for (it = std::move(more); !it.exhausted() && n < kScrollDepth;
+           it.Next()) {
+        ++n;
+      }
+    }
+    total_paged += n;
+  }
+  double elapsed_paged = ElapsedMicroseconds(start);
+  size_t total_resumed = 0;
+  start = Clock::now();
+  for (size_t i = 0; i < kNumQueries; ++i) {
+    string input(1, 'a' + i % 26);
+    ExpandSearchCursor cursor;
+    size_t n = 0;
+    for (size_t limit = kInitialSearchLimit; limit && n < kScrollDepth;) {
+      DictEntryIterator more;
+      limit = dict.LookupWords(&more, input, &cursor, limit) < limit
+                  ? 0
+                  : limit * kExpandingFactor;
+      for (; !more.exhausted() && n < kScrollDepth; more.Next()) {
+        ++n;
+      }
+    }
+    total_resumed += n;
+  }
+  double elapsed_resumed = ElapsedMicroseconds(start);
+  std::cout << "  scrolling: " << elapsed_paged / kNumQueries
+            << " us per query re-searched, " << elapsed_resumed / kNumQueries
+            << " us per query resumed, candidates = " << total_paged << " / "
+            << total_resumed << std::endl;
+  // the first page of candidates, as the table translator shows it
+  const size_t kPageSize = 10;
+  size_t total_searched = 0;
+  start = Clock::now();
+  for (size_t i = 0; i < kNumQueries; ++i) {
+    DictEntryIterator it;
+    ExpandSearchCursor cursor;
+    dict.LookupWords(&it, string(1, 'a' + i % 26), &cursor,
+                     kInitialSearchLimit);
+    for (size_t n = 0; n < kPageSize && !it.exhausted(); ++n, it.Next()) {
+      ++total_searched;
+    }
+  }
+  double elapsed_searched = ElapsedMicroseconds(start);
+  size_t total_merged = 0;
+  start = Clock::now();
+  for (size_t i = 0; i < kNumQueries; ++i) {
+    DictEntryIterator it;
+    dict.LookupWords(&it, string(1, 'a' + i % 26), true);
+    it.Sort();
+    for (size_t n = 0; n < kPageSize && !it.exhausted(); ++n, it.Next()) {
+      ++total_merged;
+    }
+  }
+  double elapsed_merged = ElapsedMicroseconds(start);
+  size_t total_indexed = 0;
+  start = Clock::now();
+  for (size_t i = 0; i < kNumQueries; ++i) {
+    DictEntryIterator it;
+    dict.LookupCompletions(&it, string(1, 'a' + i % 26), 0,
+                           kInitialSearchLimit);
+    for (size_t n = 0; n < kPageSize && !it.exhausted(); ++n, it.Next()) {
+      ++total_indexed;
+    }
+  }
+  double elapsed_indexed = ElapsedMicroseconds(start);
+  std::cout << "  first page: " << elapsed_searched / kNumQueries
+            << " us per query searching " << kInitialSearchLimit << " keys, "
+            << elapsed_merged / kNumQueries
+            << " us per query merging all keys, "
+            << elapsed_indexed / kNumQueries
+            << " us per query from the completion index, candidates = "
+            << total_searched << " / " << total_merged << " / "
+            << total_indexed << std::endl;
+  // examines candidates as a filter does, by dict entries or by views
+  double elapsed_peeked[2] = {0.0, 0.0};
+  size_t total_peeked[2] = {0, 0};
+  double checksums[2] = {0.0, 0.0};
+  for (size_t i = 0; i < kNumQueries; ++i) {
+    for (int by_view = 0; by_view < 2; ++by_view) {
+      DictEntryIterator it;
+      dict.LookupWords(&it, string(1, 'a' + i % 26), true);
+      it.Sort();
+      start = Clock::now();
+      for (size_t n = 0; n < kScrollDepth && !it.exhausted(); ++n) {
+        checksums[by_view] +=
+            by_view ? it.PeekView().text.size() : it.Peek()->text.size();
+        ++total_peeked[by_view];
+        it.Next();
+      }
+      elapsed_peeked[by_view] += ElapsedMicroseconds(start);
+    }
+  }
+  std::cout << "  peeking: " << elapsed_peeked[0] * 1000 / total_peeked[0]
+            << " ns per candidate as dict entries, "
+            << elapsed_peeked[1] * 1000 / total_peeked[1]
+            << " ns per candidate as views, candidates = " << total_peeked[0]
+            << " / " << total_peeked[1]
+            << (checksums[0] != checksums[1] ? ", MISMATCH" : "")
+            << std::endl;
+  for (const auto& table : tables) {
+    table->Remove();
+  }
+  prism->Remove();
+  return 0;
+}
+
+// queries the table at every start position of the syllable graph of a long
+// pinyin input, as the script translator does keystroke by keystroke
+static int BenchmarkTableQuery(size_t num_phrases) {
+  auto temp_path = boost::filesystem::temp_directory_path() /
+                   boost::filesystem::unique_path("rime_benchmark_%%%%%%%%");
+  Syllabary syllabary(std::begin(kPinyinSyllables), std::end(kPinyinSyllables));
+  Script script;
+  AbbreviatePinyin(syllabary, &script);
+  std::mt19937 rng(20110701);
+  std::uniform_int_distribution<SyllableId> pick(0, syllabary.size() - 1);
+  std::uniform_int_distribution<size_t> phrase_length(1, 5);
+  std::uniform_real_distribution<double> weight(1.0, 1000.0);
+  Vocabulary vocabulary;
+  for (size_t i = 0; i < num_phrases; ++i) {
+    auto e = New<ShortDictEntry>();
+    for (size_t n = phrase_length(rng); n > 0; --n) {
+      e->code.push_back(pick(rng));
+    }
+    e->text = std::to_string(i);
+    e->weight = weight(rng);
+    vocabulary.LocateEntries(e->code)->push_back(e);
+  }
+  vocabulary.SortHomophones();
+  auto table = New<Table>(temp_path.string() + ".table.bin");
+  auto prism = New<Prism>(temp_path.string() + ".prism.bin");
+  if (!table->Build(syllabary, vocabulary, num_phrases) || !table->Save() ||
+      !table->Load() || !prism->Build(syllabary, &script)) {
+    std::cerr << "failed to build dictionary: " << temp_path << std::endl;
+    return 1;
+  }
+  const string input(kPinyinInput);
+  vector<CompactSyllableGraph> graphs;
+  for (size_t len = 1; len <= input.length(); ++len) {
+    Syllabifier syllabifier;
+    syllabifier.BuildSyllableGraph(input.substr(0, len), *prism);
+    graphs.push_back(syllabifier.syllable_graph());
+  }
+  const int kRepeat = 20;
+  size_t total_found = 0;
+  auto start = Clock::now();
+  for (int i = 0; i < kRepeat; ++i) {
+    for (const auto& graph : graphs) {
+      for (const auto& x : graph.vertices) {
+        if (!graph.has_edges(x.first))
+          continue;
+        TableQueryResult result;
+        if (table->Query(graph, x.first, &result)) {
+          for (const auto& y : result) {
+            total_found += y.second.size();
+          }
+        }
+      }
+    }
+  }
+  double elapsed = ElapsedMicroseconds(start);
+  size_t num_keystrokes = graphs.size() * kRepeat;
+  std::cout << "table_query: phrases = " << num_phrases
+            << ", file size = " << table->file_size()
+            << ", keystrokes = " << num_keystrokes
+            << ", accessors = " << total_found << std::endl
+            << "  table: " << elapsed / num_keystrokes << " us per keystroke"
+            << std::endl;
+  TableQueryBuffer buffer;
+  total_found = 0;
+  start = Clock::now();
+  for (int i = 0; i < kRepeat; ++i) {
+    for (const auto& graph : graphs) {
+      for (const auto& x : graph.vertices) {
+        if (!graph.has_edges(x.first))
+          continue;
+        if (table->Query(graph, x.first, &buffer)) {
+          total_found += buffer.matches.size();
+        }
+      }
+    }
+  }
+  elapsed = ElapsedMicroseconds(start);
+  std::cout << "  table, reused buffer: " << elapsed / num_keystrokes
+            << " us per keystroke, accessors = " << total_found << std::endl;
+  Dictionary dict("benchmark", {}, {table}, prism);
+  total_found = 0;
+  start = Clock::now();
+  for (int i = 0; i < kRepeat; ++i) {
+    for (const auto& graph : graphs) {
+      for (const auto& x : graph.vertices) {
+        if (!graph.has_edges(x.first))
+          continue;
+        if (auto result = dict.Lookup(graph, x.first)) {
+          for (const auto& y : *result) {
+            total_found += y.second.entry_count();
+          }
+        }
+      }
+    }
+  }
+  elapsed = ElapsedMicroseconds(start);
+  std::cout << "  dictionary: " << elapsed / num_keystrokes
+            << " us per keystroke, entries = " << total_found << std::endl;
+  table->Remove();
+  prism->Remove();
+  return 0;
+}
+
+// looks up phrases by code in tables of a full-size syllabary, where
+// phrases of frequent syllables make up wide trunk indices, searched with and
+// without the search index
+static int BenchmarkTableSearch(size_t num_phrases) {
+  const size_t kNumSyllables = 410;
+  const size_t kNumLookups = 2000000;
+  auto temp_path = boost::filesystem::temp_directory_path() /
+                   boost::filesystem::unique_path("rime_benchmark_%%%%%%%%");
+  Syllabary syllabary;
+  for (size_t i = 0; i < kNumSyllables; ++i) {
+    syllabary.insert("s" + std::to_string(i));
+  }
+  std::mt19937 rng(20110701);
+  // frequent syllables come first
+  vector<double> frequencies;
+  for (size_t i = 0; i < kNumSyllables; ++i) {
+    frequencies.push_back(1.0 / (i + 1));
+  }
+  std::discrete_distribution<SyllableId> pick(frequencies.begin(),
+                                              frequencies.end());
+  std::uniform_int_distribution<size_t> phrase_length(2, 4);
+  std::uniform_real_distribution<double> weight(1.0, 1000.0);
+  Vocabulary vocabulary;
+  vector<Code> codes;
+  for (size_t i = 0; i < num_phrases; ++i) {
+    auto e = New<ShortDictEntry>();
+    for (size_t n = phrase_length(rng); n > 0; --n) {
+      e->code.push_back(pick(rng));
+    }
+    e->text = std::to_string(i);
+    e->weight = weight(rng);
+    vocabulary.LocateEntries(e->code)->push_back(e);
+    codes.push_back(e->code);
+  }
+  vocabulary.SortHomophones();
+  std::shuffle(codes.begin(), codes.end(), rng);
+  // rounds alternate between the tables, to even out the noise
+  const int kRounds = 5;
+  vector<the<Table>> tables;
+  for (bool search_index : {false, true}) {
+    the<Table> table(new Table(temp_path.string() + "." +
+                               std::to_string(search_index) + ".table.bin"));
+    table->set_search_index(search_index);
+    if (!table->Build(syllabary, vocabulary, num_phrases) || !table->Save() ||
+        !table->Load()) {
+      std::cerr << "failed to build table: " << table->file_name()
+                << std::endl;
+      return 1;
+    }
+    tables.push_back(std::move(table));
+  }
+  vector<double> best(tables.size());
+  vector<size_t> total_found(tables.size());
+  for (int round = 0; round < kRounds; ++round) {
+    for (size_t t = 0; t < tables.size(); ++t) {
+      total_found[t] = 0;
+      auto start = Clock::now();
+      for (size_t i = 0; i < kNumLookups; ++i) {
+        total_found[t] +=
+            tables[t]->QueryPhrases(codes[i % codes.size()]).remaining();
+      }
+      double elapsed = ElapsedMicroseconds(start);
+      if (round == 0 || elapsed < best[t])
+        best[t] = elapsed;
+    }
+  }
+  for (size_t t = 0; t < tables.size(); ++t) {
+    std::cout << "table_search: search index = " << t
+              << ", phrases = " << num_phrases
+              << ", file size = " << tables[t]->file_size()
+              << ", lookups = " << kNumLookups
+              << ", found = " << total_found[t] << std::endl
+              << "  " << std::fixed << std::setprecision(0)
+              << kNumLookups / best[t] * 1e6
+              << " lookups per second, best of " << kRounds
+              << std::defaultfloat << std::setprecision(6) << std::endl;
+    tables[t]->Remove();
+  }
+  return 0;
+}
+
+static const char* kInitials[] = {
+    "",  "b", "p", "m", "f",  "d",  "t",  "n", "l", "g", "k", "h",
+    "j", "q", "x", "zh", "ch", "sh", "r", "z", "c", "s", "y", "w",
+};
+
+static const char* kFinals[] = {
+    "a",   "o",    "e",   "i",   "u",    "v",    "ai",   "ei",
+    "ao",  "ou",   "an",  "en",  "ang",  "eng",  "ong",  "ia",
+    "ie",  "iao",  "iu",  "ian", "in",   "iang", "ing",  "iong",
+    "ua",  "uo",   "uai", "ui",  "uan",  "un",   "uang", "ve",
+};
+
+// every combination of pinyin initials and finals, valid or not
+static Syllabary CombinePinyin() {
+  Syllabary syllabary;
+  for (const char* initial : kInitials) {
+    for (const char* final : kFinals) {
+      syllabary.insert(string(initial) + final);
+    }
+  }
+  return syllabary;
+}
+
+// expands 1-letter inputs to keys in the prism, paging with a growing limit
+// as the table translator does
+static int BenchmarkPrismExpand(size_t num_rounds) {
+  auto temp_path = boost::filesystem::temp_directory_path() /
+                   boost::filesystem::unique_path("rime_benchmark_%%%%%%%%");
+  Syllabary syllabary(CombinePinyin());
+  auto prism = New<Prism>(temp_path.string() + ".prism.bin");
+  if (!prism->Build(syllabary)) {
+    std::cerr << "failed to build prism: " << prism->file_name() << std::endl;
+    return 1;
+  }
+  const size_t kInitialSearchLimit = 10;
+  const size_t kExpandingFactor = 10;
+  const size_t kMaxSearchLimit = 1000;
+  size_t total_found = 0;
+  auto start = Clock::now();
+  for (size_t i = 0; i < num_rounds; ++i) {
+    string key(1, 'a' + i % 26);
+    vector<Prism::Match> keys;
+    for (size_t limit = kInitialSearchLimit; limit <= kMaxSearchLimit;
+         limit *= kExpandingFactor) {
+      prism->ExpandSearch(key, &keys, limit);
+      total_found += keys.size();
+      if (keys.size() < limit)
+        break;
+    }
+  }
+  double elapsed = ElapsedMicroseconds(start);
+  size_t total_resumed = 0;
+  start = Clock::now();
+  for (size_t i = 0; i < num_rounds; ++i) {
+    string key(1, 'a' + i % 26);
+    vector<Prism::Match> keys;
+    ExpandSearchCursor cursor;
+    for (size_t limit = kInitialSearchLimit; limit <= kMaxSearchLimit;
+         limit *= kExpandingFactor) {
+      prism->ExpandSearch(key, &cursor, &keys, limit);
+      total_resumed += keys.size();
+      if (keys.size() < limit)
+        break;
+    }
+  }
+  double elapsed_resumed = ElapsedMicroseconds(start);
+  std::cout << "prism_expand: syllables = " << syllabary.size()
+            << ", rounds = " << num_rounds << ", keys = " << total_found
+            << std::endl
+            << "  from scratch: " << elapsed / num_rounds << " us per round"
+            << std::endl
+            << "  resumed: " << elapsed_resumed / num_rounds
+            << " us per round, keys = " << total_resumed << std::endl;
+  prism->Remove();
+  return 0;
+}
+
+// syllabifies a pinyin sentence as it is typed keystroke by keystroke,
+// building the syllable graph from scratch or extending the last one's
+static int BenchmarkSyllabifyTyping(size_t num_rounds) {
+  const size_t kSentenceLength = 30;
+  auto temp_path = boost::filesystem::temp_directory_path() /
+                   boost::filesystem::unique_path("rime_benchmark_%%%%%%%%");
+  Syllabary syllabary(CombinePinyin());
+  Script script;
+  AbbreviatePinyin(syllabary, &script);
+  auto prism = New<Prism>(temp_path.string() + ".prism.bin");
+  if (!prism->Build(syllabary, &script)) {
+    std::cerr << "failed to build prism: " << prism->file_name() << std::endl;
+    return 1;
+  }
+  const string sentence(kPinyinInput, kSentenceLength);
+  enum { kFromScratch, kIncremental, kExported, kNumModes };
+  size_t spellings[kNumModes] = {};
+  double elapsed[kNumModes] = {};
+  for (int mode = kFromScratch; mode < kNumModes; ++mode) {
+    auto start = Clock::now();
+    for (size_t i = 0; i < num_rounds; ++i) {
+      SyllableGraphCache cache;
+      for (size_t len = 1; len <= sentence.length(); ++len) {
+        // a syllabifier for each keystroke, as in the script translator
+        Syllabifier syllabifier(" '", true);
+        if (mode == kIncremental) {
+          syllabifier.EnableIncremental(&cache);
+        }
+        if (mode == kExported) {
+          SyllableGraph graph;
+          syllabifier.BuildSyllableGraph(sentence.substr(0, len), *prism,
+                                         &graph);
+          for (const auto& x : graph.edges) {
+            for (const auto& y : x.second) {
+              spellings[mode] += y.second.size();
+            }
+          }
+        } else {
+          syllabifier.BuildSyllableGraph(sentence.substr(0, len), *prism);
+          spellings[mode] += syllabifier.syllable_graph().edges.size();
+        }
+      }
+    }
+    elapsed[mode] = ElapsedMicroseconds(start);
+  }
+  size_t keystrokes = num_rounds * sentence.length();
+  std::cout << "syllabify_typing: syllables = " << syllabary.size()
+            << ", input = " << sentence << ", rounds = " << num_rounds
+            << std::endl
+            << "  from scratch: " << elapsed[kFromScratch] / keystrokes
+            << " us per keystroke, spellings = " << spellings[kFromScratch]
+            << std::endl
+            << "  incremental: " << elapsed[kIncremental] / keystrokes
+            << " us per keystroke, spellings = " << spellings[kIncremental]
+            << std::endl
+            << "  exported to maps: " << elapsed[kExported] / keystrokes
+            << " us per keystroke, spellings = " << spellings[kExported]
+            << std::endl;
+  prism->Remove();
+  if (spellings[kIncremental] != spellings[kFromScratch] ||
+      spellings[kExported] != spellings[kFromScratch]) {
+    std::cerr << "syllable graphs differ." << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// syllabifies a pinyin sentence with typos as it is typed keystroke by
+// keystroke, with spelling correction by either corrector
+static int BenchmarkCorrectionTyping(size_t num_rounds) {
+  const size_t kSentenceLength = 30;
+  auto temp_path = boost::filesystem::temp_directory_path() /
+                   boost::filesystem::unique_path("rime_benchmark_%%%%%%%%");
+  Syllabary syllabary(CombinePinyin());
+  auto prism = New<Prism>(temp_path.string() + ".prism.bin");
+  auto edit_distance =
+      New<EditDistanceCorrector>(temp_path.string() + ".correction.bin");
+  if (!prism->Build(syllabary) || !edit_distance->Build(syllabary)) {
+    std::cerr << "failed to build prism: " << prism->file_name() << std::endl;
+    return 1;
+  }
+  NearSearchCorrector near_search;
+  string sentence(kPinyinInput, kSentenceLength);
+  // shang => shsng, xue => xuw
+  sentence[13] = 's';
+  sentence[18] = 'w';
+  enum { kNoCorrection, kNearSearch, kEditDistance, kNumModes };
+  Corrector* correctors[kNumModes] = {nullptr, &near_search,
+                                      edit_distance.get()};
+  size_t corrections[kNumModes] = {};
+  double elapsed[kNumModes] = {};
+  for (int mode = kNoCorrection; mode < kNumModes; ++mode) {
+    auto start = Clock::now();
+    for (size_t i = 0; i < num_rounds; ++i) {
+      for (size_t len = 1; len <= sentence.length(); ++len) {
+        Syllabifier syllabifier(" '", true);
+        if (correctors[mode]) {
+          syllabifier.EnableCorrection(correctors[mode]);
+        }
+        syllabifier.BuildSyllableGraph(sentence.substr(0, len), *prism);
+        for (const auto& edge : syllabifier.syllable_graph().edges) {
+          if (edge.properties.is_correction)
+            ++corrections[mode];
+        }
+      }
+    }
+    elapsed[mode] = ElapsedMicroseconds(start);
+  }
+  size_t keystrokes = num_rounds * sentence.length();
+  std::cout << "correction_typing: syllables = " << syllabary.size()
+            << ", input = " << sentence << ", rounds = " << num_rounds
+            << std::endl
+            << "  no correction: " << elapsed[kNoCorrection] / keystrokes
+            << " us per keystroke" << std::endl
+            << "  near search: " << elapsed[kNearSearch] / keystrokes
+            << " us per keystroke, corrections = " << corrections[kNearSearch]
+            << std::endl
+            << "  edit distance: " << elapsed[kEditDistance] / keystrokes
+            << " us per keystroke, corrections = "
+            << corrections[kEditDistance] << std::endl;
+  prism->Remove();
+  edit_distance->Remove();
+  return 0;
+}
+
+// collects spellings with a deleted letter of random syllables, as in
+// building the corrections of a large syllabary
+static int BenchmarkSymDeleteCollect(size_t num_syllables) {
+  std::mt19937 rng(23);
+  std::uniform_int_distribution<size_t> pick_length(2, 6);
+  Syllabary syllabary;
+  while (syllabary.size() < num_syllables) {
+    syllabary.insert(RandomCode(rng, pick_length(rng)));
+  }
+  SymDeleteCollector collector(syllabary);
+  auto start = Clock::now();
+  Script script = collector.Collect(1);
+  double elapsed = ElapsedMicroseconds(start);
+  std::cout << "symdelete_collect: syllables = " << syllabary.size()
+            << ", keys = " << script.size() << std::endl
+            << "  " << elapsed / 1000 << " ms" << std::endl;
+  return 0;
+}
+
+struct PageFaults {
+  long minor = 0;
+  long major = 0;
+};
+
+static PageFaults CountPageFaults() {
+  PageFaults faults;
+#ifdef __linux__
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    faults.minor = usage.ru_minflt;
+    faults.major = usage.ru_majflt;
+  }
+#endif
+  return faults;
+}
+
+// drops the clean pages of the file from the page cache, to be read from
+// disk again. has no effect on file systems in memory.
+static void EvictFromPageCache(const string& file_name) {
+#ifdef __linux__
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+#endif
+}
+
+// opens a dictionary for the first keystrokes of a session with each load
+// policy, counting the page faults taken while loading and looking up
+static int BenchmarkDictColdStart(size_t num_phrases) {
+  const int kRounds = 5;
+  auto temp_path = boost::filesystem::temp_directory_path() /
+                   boost::filesystem::unique_path("rime_benchmark_%%%%%%%%");
+  Syllabary syllabary(std::begin(kPinyinSyllables), std::end(kPinyinSyllables));
+  Script script;
+  AbbreviatePinyin(syllabary, &script);
+  std::mt19937 rng(20110701);
+  std::uniform_int_distribution<SyllableId> pick(0, syllabary.size() - 1);
+  std::uniform_int_distribution<size_t> phrase_length(1, 5);
+  std::uniform_real_distribution<double> weight(1.0, 1000.0);
+  Vocabulary vocabulary;
+  for (size_t i = 0; i < num_phrases; ++i) {
+    auto e = New<ShortDictEntry>();
+    for (size_t n = phrase_length(rng); n > 0; --n) {
+      e->code.push_back(pick(rng));
+    }
+    e->text = std::to_string(i);
+    e->weight = weight(rng);
+    vocabulary.LocateEntries(e->code)->push_back(e);
+  }
+  vocabulary.SortHomophones();
+  const string table_file = temp_path.string() + ".table.bin";
+  const string prism_file = temp_path.string() + ".prism.bin";
+  {
+    Table table(table_file);
+    Prism prism(prism_file);
+    if (!table.Build(syllabary, vocabulary, num_phrases) || !table.Save() ||
+        !prism.Build(syllabary, &script) || !prism.Save()) {
+      std::cerr << "failed to build dictionary: " << temp_path << std::endl;
+      return 1;
+    }
+  }
+  std::cout << "dict_cold_start: phrases = " << num_phrases
+            << ", table size = " << boost::filesystem::file_size(table_file)
+            << ", prism size = " << boost::filesystem::file_size(prism_file)
+            << ", keystrokes = " << std::strlen(kPinyinInput) << std::endl;
+  struct {
+    const char* name;
+    MappedFileLoadPolicy policy;
+    bool warmup;
+  } configs[] = {
+      {"default", MappedFileLoadPolicy::kDefault, false},
+      {"sequential", MappedFileLoadPolicy::kSequential, false},
+      {"random", MappedFileLoadPolicy::kRandom, false},
+      {"willneed", MappedFileLoadPolicy::kWillNeed, false},
+      {"populate", MappedFileLoadPolicy::kPopulate, false},
+      {"lock", MappedFileLoadPolicy::kLock, false},
+      {"default + warmup", MappedFileLoadPolicy::kDefault, true},
+  };
+  const string input(kPinyinInput);
+  for (const auto& config : configs) {
+    double load_time = 0.0, lookup_time = 0.0;
+    PageFaults load_faults, lookup_faults;
+    size_t total_found = 0;
+    for (int round = 0; round < kRounds; ++round) {
+      EvictFromPageCache(table_file);
+      EvictFromPageCache(prism_file);
+      auto faults = CountPageFaults();
+      auto start = Clock::now();
+      Dictionary dict("benchmark", {}, {New<Table>(table_file)},
+                      New<Prism>(prism_file));
+      dict.set_load_policy(config.policy);
+      dict.set_warmup_on_load(config.warmup);
+      if (!dict.Load()) {
+        std::cerr << "failed to load dictionary: " << temp_path << std::endl;
+        return 1;
+      }
+      dict.FinishWarmup();
+      load_time += ElapsedMicroseconds(start);
+      auto loaded = CountPageFaults();
+      load_faults.minor += loaded.minor - faults.minor;
+      load_faults.major += loaded.major - faults.major;
+      start = Clock::now();
+      for (size_t len = 1; len <= input.length(); ++len) {
+        Syllabifier syllabifier;
+        syllabifier.BuildSyllableGraph(input.substr(0, len), *dict.prism());
+        const auto& graph = syllabifier.syllable_graph();
+        for (const auto& x : graph.vertices) {
+          if (!graph.has_edges(x.first))
+            continue;
+          if (auto result = dict.Lookup(graph, x.first)) {
+            for (const auto& y : *result) {
+              total_found += y.second.entry_count();
+            }
+          }
+        }
+      }
+      lookup_time += ElapsedMicroseconds(start);
+      auto looked_up = CountPageFaults();
+      lookup_faults.minor += looked_up.minor - loaded.minor;
+      lookup_faults.major += looked_up.major - loaded.major;
+    }
+    std::cout << "  " << config.name << ": load " << load_time / kRounds
+              << " us, page faults = " << load_faults.minor / kRounds << " / "
+              << load_faults.major / kRounds << "; first keystrokes "
+              << lookup_time / kRounds << " us, page faults = "
+              << lookup_faults.minor / kRounds << " / "
+              << lookup_faults.major / kRounds
+              << ", entries = " << total_found / kRounds << std::endl;
+  }
+  std::cout << "  (page faults are minor / major per round)" << std::endl;
+  boost::filesystem::remove(table_file);
+  boost::filesystem::remove(prism_file);
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  SetupLogging("rime.tools");
+
+  string option = argc > 1 ? argv[1] : "";
+  if (option == "userdb_lookup") {
+    string dict_name = argc > 2 ? argv[2] : "sbjm";
+    size_t num_entries =
+        argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 100000;
+    size_t num_lookups = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 10000;
+    return BenchmarkUserDbLookup(dict_name, num_entries, num_lookups);
+  }
+  if (option == "userdb_scan") {
+    size_t num_records =
+        argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+    return BenchmarkUserDbScan(num_records);
+  }
+  if (option == "userdb_graph") {
+    size_t num_phrases =
+        argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+    return BenchmarkUserDbGraph(num_phrases);
+  }
+  if (option == "userdb_iterators") {
+    size_t num_records =
+        argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+    return BenchmarkUserDbIterators(num_records);
+  }
+  if (option == "textdb_load") {
+    size_t num_records =
+        argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 500000;
+    return BenchmarkTextDbLoad(num_records);
+  }
+  if (option == "dict_predict") {
+    size_t num_packs = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 3;
+    return BenchmarkDictPredict(num_packs);
+  }
+  if (option == "table_query") {
+    size_t num_phrases =
+        argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+    return BenchmarkTableQuery(num_phrases);
+  }
+  if (option == "table_search") {
+    size_t num_phrases =
+        argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 500000;
+    return BenchmarkTableSearch(num_phrases);
+  }
+  if (option == "prism_expand") {
+    size_t num_rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000;
+    return BenchmarkPrismExpand(num_rounds);
+  }
+  if (option == "syllabify_typing") {
+    size_t num_rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+    return BenchmarkSyllabifyTyping(num_rounds);
+  }
+  if (option == "correction_typing") {
+    size_t num_rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100;
+    return BenchmarkCorrectionTyping(num_rounds);
+  }
+  if (option == "symdelete_collect") {
+    size_t num_syllables =
+        argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1500;
+    return BenchmarkSymDeleteCollect(num_syllables);
+  }
+  if (option == "dict_cold_start") {
+    size_t num_phrases =
+        argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 500000;
+    return BenchmarkDictColdStart(num_phrases);
+  }
+  std::cout << "benchmarks:" << std::endl
+            << "\tuserdb_lookup [dict_name] [num_entries] [num_lookups]"
+            << std::endl
+            << "\tuserdb_scan [num_records]" << std::endl
+            << "\tuserdb_graph [num_phrases]" << std::endl
+            << "\tuserdb_iterators [num_records]" << std::endl
+            << "\ttextdb_load [num_records]" << std::endl
+            << "\tdict_predict [num_packs]" << std::endl
+            << "\ttable_query [num_phrases]" << std::endl
+            << "\ttable_search [num_phrases]" << std::endl
+            << "\tprism_expand [num_rounds]" << std::endl
+            << "\tsyllabify_typing [num_rounds]" << std::endl
+            << "\tcorrection_typing [num_rounds]" << std::endl
+            << "\tsymdelete_collect [num_syllables]" << std::endl
+            << "\tdict_cold_start [num_phrases]" << std::endl;
+  return option.empty() ? 0 : 1;
+}